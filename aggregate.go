@@ -0,0 +1,252 @@
+package main
+
+/*
+   #include <ingest.h>
+*/
+import "C"
+
+import (
+	"fmt"
+	"sort"
+	"strings"
+)
+
+// Columns the aggregation table can be sorted by, cycled through with `s`
+const (
+	sortByCount = iota
+	sortByRate1s
+	sortByRate10s
+	sortByRate60s
+	sortByName
+	sortColumns
+)
+
+var sortColumnNames = [sortColumns]string{"count", "1s rate", "10s rate", "60s rate", "name"}
+
+// Lines of the aggregation table besides its rows: title, blank line, header,
+// help and its padding
+const aggregateChromeHeight = 5
+
+// aggregateRow is a row of the aggregation table: the events of a name in a
+// stream, or in all of them.
+type aggregateRow struct {
+	name     string
+	session  string
+	streamID int64 // -1 for all the streams
+	cpuID    int64 // -1 if unknown or for all the streams
+	count    uint64
+	rates    [C.EVENT_STATS_WINDOW_COUNT]float64 // Events per second, over 1, 10 and 60 seconds
+}
+
+// aggregateField is the histogram of a field of the events of a name.
+type aggregateField struct {
+	name, field        string
+	count              uint64
+	mean               float64
+	p50, p90, p99, max uint64
+}
+
+// aggregateView shows what the ingestion threads count of the events (see
+// event_stats.h) as a table, one row per event name, or per event name and
+// stream. Its storage is reused from one refresh to the next.
+type aggregateView struct {
+	column   int
+	byStream bool
+
+	samples      []C.event_stats_sample
+	fieldSamples []C.event_stats_field_sample
+	rows         []aggregateRow
+	groups       map[string]int // Row of each event name and session when grouping the streams
+	fields       []aggregateField
+	other        uint64 // Events left out of the rows
+}
+
+func newAggregateView() *aggregateView {
+	return &aggregateView{
+		samples:      make([]C.event_stats_sample, C.EVENT_STATS_MAX_ROWS),
+		fieldSamples: make([]C.event_stats_field_sample, C.EVENT_STATS_MAX_HISTOGRAMS),
+		groups:       make(map[string]int),
+	}
+}
+
+// refresh takes the counters of `ingest` in, `session` returning the session
+// tag of a trace id, or nil not to tell the sessions apart.
+func (v *aggregateView) refresh(ingest *C.ingest, session func(uint32) string) {
+	var other C.uint64_t
+	count := int(C.get_ingest_stats(ingest, &v.samples[0], C.uint64_t(len(v.samples)), &other))
+	if count > len(v.samples) {
+		v.samples = make([]C.event_stats_sample, count)
+		count = int(C.get_ingest_stats(ingest, &v.samples[0], C.uint64_t(len(v.samples)), &other))
+		if count > len(v.samples) {
+			count = len(v.samples)
+		}
+	}
+	v.other = uint64(other)
+
+	v.rows = v.rows[:0]
+	for k := range v.groups {
+		delete(v.groups, k)
+	}
+	for i := range v.samples[:count] {
+		sample := &v.samples[i]
+		row := aggregateRow{
+			name:     internedString(sample.name),
+			streamID: int64(sample.stream_id),
+			cpuID:    int64(sample.cpu_id),
+			count:    uint64(sample.count),
+		}
+		if session != nil {
+			row.session = session(uint32(sample.trace_id))
+		}
+		for w := range row.rates {
+			row.rates[w] = float64(sample.rates[w])
+		}
+
+		if v.byStream {
+			v.rows = append(v.rows, row)
+			continue
+		}
+		key := row.name + "\x00" + row.session
+		group, ok := v.groups[key]
+		if !ok {
+			row.streamID, row.cpuID = -1, -1
+			v.groups[key] = len(v.rows)
+			v.rows = append(v.rows, row)
+			continue
+		}
+		v.rows[group].count += row.count
+		for w := range row.rates {
+			v.rows[group].rates[w] += row.rates[w]
+		}
+	}
+	v.sort()
+
+	fieldCount := int(C.get_ingest_field_stats(ingest, &v.fieldSamples[0],
+		C.uint64_t(len(v.fieldSamples))))
+	v.fields = v.fields[:0]
+	for i := range v.fieldSamples[:fieldCount] {
+		sample := &v.fieldSamples[i]
+		field := aggregateField{
+			name:  internedString(sample.name),
+			field: internedString(sample.field),
+			count: uint64(sample.count),
+			p50:   uint64(sample.p50),
+			p90:   uint64(sample.p90),
+			p99:   uint64(sample.p99),
+			max:   uint64(sample.max),
+		}
+		if field.count > 0 {
+			field.mean = float64(sample.sum) / float64(field.count)
+		}
+		v.fields = append(v.fields, field)
+	}
+	sort.Slice(v.fields, func(i, j int) bool {
+		if v.fields[i].name != v.fields[j].name {
+			return v.fields[i].name < v.fields[j].name
+		}
+		return v.fields[i].field < v.fields[j].field
+	})
+}
+
+// sort orders the rows by the sort column, decreasing except for names, then
+// by name and stream.
+func (v *aggregateView) sort() {
+	sort.Slice(v.rows, func(i, j int) bool {
+		a, b := &v.rows[i], &v.rows[j]
+		switch v.column {
+		case sortByCount:
+			if a.count != b.count {
+				return a.count > b.count
+			}
+		case sortByRate1s, sortByRate10s, sortByRate60s:
+			if w := v.column - sortByRate1s; a.rates[w] != b.rates[w] {
+				return a.rates[w] > b.rates[w]
+			}
+		}
+		if a.name != b.name {
+			return a.name < b.name
+		}
+		if a.session != b.session {
+			return a.session < b.session
+		}
+		return a.streamID < b.streamID
+	})
+}
+
+// truncate cuts `s` to `width` runes, marking the cut.
+func truncate(s string, width int) string {
+	runes := []rune(s)
+	if len(runes) <= width {
+		return s
+	}
+	return string(runes[:width-1]) + "…"
+}
+
+// render returns the table, fitted in `height` lines: the histograms of the
+// fields first, then as many rows as fit.
+func (v *aggregateView) render(height int, sessions bool) string {
+	var b strings.Builder
+
+	grouping := "per event name"
+	if v.byStream {
+		grouping = "per event name and stream"
+	}
+	b.WriteString(titleStyle.Render("lttng-go • events"))
+	fmt.Fprintf(&b, "  %s, sorted by %s\n\n", grouping, sortColumnNames[v.column])
+
+	lines := height - aggregateChromeHeight
+	if len(v.fields) > 0 {
+		fmt.Fprintf(&b, "%-32s %-16s %12s %12s %12s %12s %12s %12s\n", "EVENT", "FIELD", "VALUES",
+			"MEAN", "P50", "P90", "P99", "MAX")
+		lines--
+		for _, f := range v.fields {
+			// Leave room for the rows
+			if lines <= height/2 {
+				break
+			}
+			fmt.Fprintf(&b, "%-32s %-16s %12d %12.1f %12d %12d %12d %12d\n", truncate(f.name, 32),
+				truncate(f.field, 16), f.count, f.mean, f.p50, f.p90, f.p99, f.max)
+			lines--
+		}
+		b.WriteByte('\n')
+		lines--
+	}
+
+	fmt.Fprintf(&b, "%-32s", "EVENT")
+	if sessions {
+		fmt.Fprintf(&b, " %-24s", "SESSION")
+	}
+	fmt.Fprintf(&b, " %8s %4s %12s %12s %12s %12s\n", "STREAM", "CPU", "COUNT", "1S /S", "10S /S",
+		"60S /S")
+	if v.other > 0 {
+		lines--
+	}
+
+	for i := range v.rows {
+		if i >= lines {
+			break
+		}
+		row := &v.rows[i]
+		fmt.Fprintf(&b, "%-32s", truncate(row.name, 32))
+		if sessions {
+			fmt.Fprintf(&b, " %-24s", truncate(row.session, 24))
+		}
+		stream, cpu := "*", "*"
+		if row.streamID >= 0 {
+			stream = fmt.Sprint(row.streamID)
+		}
+		if row.cpuID >= 0 {
+			cpu = fmt.Sprint(row.cpuID)
+		} else if row.streamID >= 0 {
+			cpu = "-"
+		}
+		fmt.Fprintf(&b, " %8s %4s %12d %12.1f %12.1f %12.1f\n", stream, cpu, row.count,
+			row.rates[0], row.rates[1], row.rates[2])
+	}
+	if v.other > 0 {
+		fmt.Fprintf(&b, "%d more events, past the %d counted rows\n", v.other, C.EVENT_STATS_MAX_ROWS)
+	}
+
+	b.WriteString(helpStyle.Render("s sort • g streams • a back • q quit"))
+	return b.String()
+}
@@ -0,0 +1,208 @@
+// Command bench measures the decoding pipeline of lttng-go on synthetic CTF
+// traces.
+//
+// It writes a trace of the requested shape, replays it through the same
+// graphs, decoders and ingestion threads as `lttng-go TRACE_DIR`, takes every
+// batch in on the Go side like the UI does, and reports the throughput, the
+// Go allocations and the latency from the graph to the consumer.
+package main
+
+/*
+   #cgo pkg-config: babeltrace2
+   #cgo CFLAGS: -I..
+   #cgo LDFLAGS: -lbabeltrace2 -lm
+   #include <ingest.h>
+   #include "synthetic_trace.h"
+*/
+import "C"
+
+import (
+	"flag"
+	"fmt"
+	"log"
+	"os"
+	"runtime"
+	"sort"
+	"time"
+	"unsafe"
+)
+
+// Batches the ingestion threads may publish ahead of the consumer
+const ingestRingCapacity = 64
+
+var shapes = map[string]C.synthetic_shape{
+	"ints":    C.SYNTHETIC_SHAPE_FLAT_INTS,
+	"strings": C.SYNTHETIC_SHAPE_STRINGS,
+	"nested":  C.SYNTHETIC_SHAPE_NESTED,
+	"arrays":  C.SYNTHETIC_SHAPE_LARGE_ARRAY,
+	"mixed":   C.SYNTHETIC_SHAPE_MIXED,
+}
+
+var byteArrays = map[string]C.byte_array_encoding{
+	"list":   C.BYTE_ARRAY_ENCODING_LIST,
+	"hex":    C.BYTE_ARRAY_ENCODING_HEX,
+	"base64": C.BYTE_ARRAY_ENCODING_BASE64,
+}
+
+// latency is the graph to consumer latency shared by the `events` of a batch.
+type latency struct {
+	ns     int64
+	events uint64
+}
+
+func main() {
+	events := flag.Uint64("events", 1000000, "events per data stream")
+	rate := flag.Uint64("rate", 1000000, "events per data stream and second, spacing the timestamps")
+	streams := flag.Uint("streams", 4, "data streams")
+	shape := flag.String("shape", "mixed", "payload: ints, strings, nested, arrays or mixed")
+	arrayLength := flag.Uint("array-length", 4096, "elements of the arrays payload")
+	workers := flag.Uint("workers", uint(runtime.NumCPU()), "decoding threads")
+	decodeThreads := flag.Uint("decode-threads", 0, "more threads rendering the batches of each worker")
+	binary := flag.Bool("binary", false, "render the binary encoding instead of JSON")
+	byteArray := flag.String("bytes", "list", "byte arrays: list, hex or base64")
+	countOnly := flag.Bool("count-only", false, "only count the events, rendering none of them")
+	table := flag.Uint64("table", 0, "events each worker keeps by column for exports")
+	keep := flag.String("keep", "", "write the trace to this directory and keep it")
+	flag.Parse()
+
+	cShape, ok := shapes[*shape]
+	cBytes, bytesOk := byteArrays[*byteArray]
+	if !ok || !bytesOk || *streams == 0 {
+		flag.Usage()
+		os.Exit(2)
+	}
+
+	dir := *keep
+	if dir == "" {
+		var err error
+		if dir, err = os.MkdirTemp("", "lttng-go-bench"); err != nil {
+			log.Fatal(err)
+		}
+		defer os.RemoveAll(dir)
+	} else if err := os.MkdirAll(dir, 0755); err != nil {
+		log.Fatal(err)
+	}
+
+	params := C.synthetic_trace_params{
+		stream_count: C.uint32_t(*streams),
+		event_count:  C.uint64_t(*events),
+		event_rate:   C.uint64_t(*rate),
+		shape:        cShape,
+		array_length: C.uint32_t(*arrayLength),
+	}
+	cDir := C.CString(dir)
+	defer C.free(unsafe.Pointer(cDir))
+	if !C.write_synthetic_trace(cDir, &params) {
+		log.Fatalf("Cannot write the trace to %s", dir)
+	}
+
+	ingest := C.create_offline_ingest(cDir, C.uint32_t(*workers), ingestRingCapacity,
+		C.OVERFLOW_POLICY_BLOCK, 0)
+	if ingest == nil {
+		log.Fatalf("Cannot read the trace of %s", dir)
+	}
+	defer C.destroy_ingest(ingest)
+	if *binary {
+		C.ingest_set_format(ingest, C.OUTPUT_FORMAT_BINARY)
+	}
+	C.ingest_set_byte_arrays(ingest, cBytes, 0)
+	if !C.ingest_set_decode_threads(ingest, C.uint32_t(*decodeThreads)) {
+		log.Fatal("The decoding threads cannot be started")
+	}
+	C.ingest_set_count_only(ingest, C.bool(*countOnly))
+	C.ingest_set_table_size(ingest, C.uint64_t(*table))
+
+	var before, after runtime.MemStats
+	runtime.ReadMemStats(&before)
+	start := time.Now()
+	if !C.start_ingest(ingest) {
+		log.Fatal("The ingestion threads cannot be started")
+	}
+
+	var (
+		total     uint64
+		bytes     uint64
+		latencies []latency
+	)
+	for C.ingest_wait(ingest) {
+		for batch := C.ingest_pop(ingest); batch != nil; batch = C.ingest_pop(ingest) {
+			latencies = append(latencies,
+				latency{int64(C.monotonic_ns() - batch.ingest_ns), uint64(batch.count)})
+			total += uint64(batch.count)
+			bytes += uint64(batch.arena.size)
+			consume(batch)
+			C.release_batch(batch)
+		}
+	}
+	elapsed := time.Since(start)
+	runtime.ReadMemStats(&after)
+
+	if C.get_ingest_state(ingest) == C.INGEST_STATE_FAILED {
+		log.Fatal("Trace processing failed")
+	}
+	if *countOnly {
+		total = countedEvents(ingest)
+	}
+	if total == 0 {
+		log.Fatal("No events were decoded")
+	}
+
+	fmt.Printf("shape %s, %d streams, %d workers, %d decode threads each\n", *shape, *streams,
+		*workers, *decodeThreads)
+	fmt.Printf("events:        %d (%.1f MiB rendered)\n", total, float64(bytes)/(1<<20))
+	fmt.Printf("throughput:    %.0f events/s\n", float64(total)/elapsed.Seconds())
+	fmt.Printf("cost:          %.1f ns/event\n", float64(elapsed.Nanoseconds())/float64(total))
+	fmt.Printf("Go allocs:     %.3f allocs/event\n",
+		float64(after.Mallocs-before.Mallocs)/float64(total))
+	if len(latencies) > 0 {
+		fmt.Printf("latency:       p50 %s, p99 %s\n",
+			percentile(latencies, total, 0.50), percentile(latencies, total, 0.99))
+	}
+}
+
+// countedEvents returns the number of events the ingestion threads counted
+// (see event_stats.h).
+func countedEvents(ingest *C.ingest) uint64 {
+	samples := make([]C.event_stats_sample, C.EVENT_STATS_MAX_ROWS)
+	var other C.uint64_t
+	count := int(C.get_ingest_stats(ingest, &samples[0], C.uint64_t(len(samples)), &other))
+	if count > len(samples) {
+		samples = make([]C.event_stats_sample, count)
+		C.get_ingest_stats(ingest, &samples[0], C.uint64_t(len(samples)), &other)
+	}
+
+	total := uint64(other)
+	for _, sample := range samples[:count] {
+		total += uint64(sample.count)
+	}
+	return total
+}
+
+// consume takes `batch` in the way the UI does: one copy of the whole arena to
+// the Go heap, of which each record is a sub-slice.
+func consume(batch *C.event_batch) {
+	arena := C.GoBytes(unsafe.Pointer(batch.arena.data), C.int(batch.arena.size))
+	records := unsafe.Slice(batch.records, batch.count)
+
+	var sink int
+	for i := range records {
+		sink += len(arena[records[i].offset : records[i].offset+records[i].length])
+	}
+	runtime.KeepAlive(sink)
+}
+
+// percentile returns the latency which the fraction `p` of the `total` events
+// do not exceed.
+func percentile(latencies []latency, total uint64, p float64) time.Duration {
+	sort.Slice(latencies, func(i, j int) bool { return latencies[i].ns < latencies[j].ns })
+
+	rank := uint64(p * float64(total))
+	var seen uint64
+	for _, l := range latencies {
+		seen += l.events
+		if seen > rank {
+			return time.Duration(l.ns)
+		}
+	}
+	return time.Duration(latencies[len(latencies)-1].ns)
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "event_writer.h"
+
+/*
+ * Largest data stream packet, past which a new packet is started.
+ */
+#define SYNTHETIC_PACKET_SIZE 65536
+
+/*
+ * Timestamp of the first event, in nanoseconds from the clock origin.
+ */
+#define SYNTHETIC_FIRST_TIMESTAMP_NS INT64_C(1600000000000000000)
+
+/*
+ * Payload of the synthetic events. Each shape is an event class of its
+ * own, of which SYNTHETIC_SHAPE_MIXED takes turns.
+ */
+typedef enum synthetic_shape {
+  SYNTHETIC_SHAPE_FLAT_INTS = 0,   /* Eight 64-bit integers */
+  SYNTHETIC_SHAPE_STRINGS = 1,     /* Two strings */
+  SYNTHETIC_SHAPE_NESTED = 2,      /* Structures within a structure */
+  SYNTHETIC_SHAPE_LARGE_ARRAY = 3, /* A sequence of `array_length` bytes */
+  SYNTHETIC_SHAPE_MIXED = 4,
+} synthetic_shape;
+
+typedef struct synthetic_trace_params {
+  uint32_t stream_count;
+  uint64_t event_count; /* Per data stream */
+  uint64_t event_rate;  /* Per data stream and second, spacing the timestamps */
+  synthetic_shape shape;
+  uint32_t array_length;
+} synthetic_trace_params;
+
+/*
+ * CTF 1.8 metadata of the synthetic traces, in the layout LTTng uses: a
+ * single stream class, of which every data stream file is an instance.
+ */
+static const char synthetic_metadata[] =
+    "/* CTF 1.8 */\n"
+    "\n"
+    "typealias integer { size = 8; align = 8; signed = false; } := uint8_t;\n"
+    "typealias integer { size = 32; align = 8; signed = false; } := uint32_t;\n"
+    "typealias integer { size = 64; align = 8; signed = false; } := uint64_t;\n"
+    "typealias integer { size = 64; align = 8; signed = true; } := int64_t;\n"
+    "\n"
+    "trace {\n"
+    "  major = 1;\n"
+    "  minor = 8;\n"
+    "  byte_order = le;\n"
+    "  packet.header := struct {\n"
+    "    uint32_t magic;\n"
+    "    uint32_t stream_id;\n"
+    "  };\n"
+    "};\n"
+    "\n"
+    "env {\n"
+    "  hostname = \"bench\";\n"
+    "  trace_name = \"synthetic\";\n"
+    "  domain = \"ust\";\n"
+    "  tracer_name = \"lttng-go-bench\";\n"
+    "};\n"
+    "\n"
+    "clock {\n"
+    "  name = \"monotonic\";\n"
+    "  freq = 1000000000;\n"
+    "  offset = 0;\n"
+    "};\n"
+    "\n"
+    "typealias integer {\n"
+    "  size = 64; align = 8; signed = false;\n"
+    "  map = clock.monotonic.value;\n"
+    "} := uint64_clock_monotonic_t;\n"
+    "\n"
+    "stream {\n"
+    "  id = 0;\n"
+    "  packet.context := struct {\n"
+    "    uint64_t content_size;\n"
+    "    uint64_t packet_size;\n"
+    "    uint64_clock_monotonic_t timestamp_begin;\n"
+    "    uint64_clock_monotonic_t timestamp_end;\n"
+    "    uint64_t events_discarded;\n"
+    "    uint32_t cpu_id;\n"
+    "  };\n"
+    "  event.header := struct {\n"
+    "    uint32_t id;\n"
+    "    uint64_clock_monotonic_t timestamp;\n"
+    "  };\n"
+    "};\n"
+    "\n"
+    "event {\n"
+    "  name = \"bench:flat_ints\";\n"
+    "  id = 0;\n"
+    "  stream_id = 0;\n"
+    "  fields := struct {\n"
+    "    int64_t a; int64_t b; int64_t c; int64_t d;\n"
+    "    uint64_t e; uint64_t f; uint64_t g; uint64_t h;\n"
+    "  };\n"
+    "};\n"
+    "\n"
+    "event {\n"
+    "  name = \"bench:strings\";\n"
+    "  id = 1;\n"
+    "  stream_id = 0;\n"
+    "  fields := struct {\n"
+    "    string path;\n"
+    "    string message;\n"
+    "  };\n"
+    "};\n"
+    "\n"
+    "event {\n"
+    "  name = \"bench:nested\";\n"
+    "  id = 2;\n"
+    "  stream_id = 0;\n"
+    "  fields := struct {\n"
+    "    uint64_t id;\n"
+    "    struct {\n"
+    "      int64_t x;\n"
+    "      int64_t y;\n"
+    "      struct { uint32_t flags; string label; } inner;\n"
+    "    } outer;\n"
+    "    uint32_t words[4];\n"
+    "  };\n"
+    "};\n"
+    "\n"
+    "event {\n"
+    "  name = \"bench:large_array\";\n"
+    "  id = 3;\n"
+    "  stream_id = 0;\n"
+    "  fields := struct {\n"
+    "    uint32_t _data_length;\n"
+    "    uint8_t data[_data_length];\n"
+    "  };\n"
+    "};\n";
+
+#define SYNTHETIC_PACKET_CONTEXT_SIZE 44
+
+static void append_u32(byte_buffer* const buffer, uint32_t const val) {
+  byte_buffer_append(buffer, &val, sizeof(val));
+}
+
+static void append_u64(byte_buffer* const buffer, uint64_t const val) {
+  byte_buffer_append(buffer, &val, sizeof(val));
+}
+
+static void append_cstring(byte_buffer* const buffer, const char* const str) {
+  byte_buffer_append(buffer, str, strlen(str) + 1);
+}
+
+/*
+ * Appends the event `seq` of shape `shape` (not SYNTHETIC_SHAPE_MIXED),
+ * header included, to `packet`.
+ */
+static void append_synthetic_event(byte_buffer* const packet,
+                                   const synthetic_trace_params* const params,
+                                   synthetic_shape const shape,
+                                   uint64_t const seq,
+                                   uint64_t const timestamp) {
+  char text[64];
+
+  append_u32(packet, (uint32_t)shape);
+  append_u64(packet, timestamp);
+
+  switch (shape) {
+    case SYNTHETIC_SHAPE_FLAT_INTS:
+      for (uint64_t i = 0; i < 8; i++) {
+        append_u64(packet, seq * 8 + i);
+      }
+      break;
+    case SYNTHETIC_SHAPE_STRINGS:
+      snprintf(text, sizeof(text), "/var/lib/bench/%" PRIu64 ".dat", seq % 1000);
+      append_cstring(packet, text);
+      snprintf(text, sizeof(text), "synthetic event number %" PRIu64, seq);
+      append_cstring(packet, text);
+      break;
+    case SYNTHETIC_SHAPE_NESTED:
+      append_u64(packet, seq);
+      append_u64(packet, seq * 3);
+      append_u64(packet, (uint64_t)-(int64_t)seq);
+      append_u32(packet, (uint32_t)seq & 0xff);
+      append_cstring(packet, seq % 2 ? "odd" : "even");
+      for (uint32_t i = 0; i < 4; i++) {
+        append_u32(packet, (uint32_t)seq + i);
+      }
+      break;
+    case SYNTHETIC_SHAPE_LARGE_ARRAY:
+      append_u32(packet, params->array_length);
+      byte_buffer_reserve(packet, params->array_length);
+      for (uint32_t i = 0; i < params->array_length; i++) {
+        packet->data[packet->size++] = (char)(seq + i);
+      }
+      break;
+    case SYNTHETIC_SHAPE_MIXED:
+      break;
+  }
+}
+
+/*
+ * Writes the data stream `stream` of the synthetic trace to `path`.
+ */
+static bool write_synthetic_stream(const char* const path,
+                                   const synthetic_trace_params* const params,
+                                   uint32_t const stream) {
+  FILE* const file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+
+  uint64_t const spacing_ns = params->event_rate ? 1000000000 / params->event_rate : 1;
+  byte_buffer packet = {0};
+  uint64_t seq = 0;
+  bool ok = true;
+
+  while (ok && seq < params->event_count) {
+    uint64_t const first_timestamp = SYNTHETIC_FIRST_TIMESTAMP_NS + seq * spacing_ns + stream;
+    uint64_t timestamp = first_timestamp;
+
+    packet.size = 0;
+    append_u32(&packet, 0xC1FC1FC1);
+    append_u32(&packet, 0);
+    /* Sizes and end timestamp are filled in once the packet is complete */
+    byte_buffer_reserve(&packet, SYNTHETIC_PACKET_CONTEXT_SIZE);
+    memset(packet.data + packet.size, 0, SYNTHETIC_PACKET_CONTEXT_SIZE);
+    packet.size += SYNTHETIC_PACKET_CONTEXT_SIZE;
+    memcpy(packet.data + 24, &first_timestamp, sizeof(first_timestamp));
+    memcpy(packet.data + 48, &stream, sizeof(stream));
+
+    do {
+      synthetic_shape const shape = params->shape == SYNTHETIC_SHAPE_MIXED
+                                        ? (synthetic_shape)(seq % SYNTHETIC_SHAPE_MIXED)
+                                        : params->shape;
+      timestamp = SYNTHETIC_FIRST_TIMESTAMP_NS + seq * spacing_ns + stream;
+      append_synthetic_event(&packet, params, shape, seq, timestamp);
+      seq++;
+    } while (seq < params->event_count && packet.size < SYNTHETIC_PACKET_SIZE);
+
+    uint64_t const size_bits = (uint64_t)packet.size * 8;
+    memcpy(packet.data + 8, &size_bits, sizeof(size_bits));
+    memcpy(packet.data + 16, &size_bits, sizeof(size_bits));
+    memcpy(packet.data + 32, &timestamp, sizeof(timestamp));
+
+    ok = fwrite(packet.data, 1, packet.size, file) == packet.size;
+  }
+
+  byte_buffer_destroy(&packet);
+  return fclose(file) == 0 && ok;
+}
+
+/*
+ * Writes a CTF trace of `params->stream_count` data streams to the
+ * existing directory `dir`, which src.ctf.fs then reads like any LTTng
+ * trace directory.
+ */
+static bool write_synthetic_trace(const char* const dir,
+                                  const synthetic_trace_params* const params) {
+  char path[4096];
+
+  snprintf(path, sizeof(path), "%s/metadata", dir);
+  FILE* const metadata = fopen(path, "w");
+  if (!metadata) {
+    return false;
+  }
+  bool const metadata_written = fputs(synthetic_metadata, metadata) >= 0;
+  if (fclose(metadata) != 0 || !metadata_written) {
+    return false;
+  }
+
+  for (uint32_t stream = 0; stream < params->stream_count; stream++) {
+    snprintf(path, sizeof(path), "%s/stream_%" PRIu32, dir, stream);
+    if (!write_synthetic_stream(path, params, stream)) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -1,243 +1,427 @@
 #pragma once
 
-#include <stdio.h>
+#include <pthread.h>
 #include <string.h>
-#include <time.h>
 
 #include <babeltrace2/babeltrace.h>
-#include <json-c/json.h>
 
+#include "decoder_cache.h"
+#include "event_writer.h"
 #include "fail_fast_if.h"
+#include "timestamp_format.h"
+
+static size_t AddFieldStruct(event_writer* writer,
+                             const field_op* ops,
+                             uint32_t op,
+                             const bt_field* field);
+static void AddField(event_writer* writer,
+                     const field_op* ops,
+                     uint32_t op,
+                     const bt_field* field);
+
+static void AddFieldUnsignedInteger(event_writer* writer,
+                                    const field_op* fieldOp,
+                                    const bt_field* field) {
+  uint64_t val = bt_field_integer_unsigned_get_value(field);
+  writer_uint64(writer, fieldOp->name, fieldOp->name_len, val);
+}
 
-static void AddFieldStruct(json_object* jobj, char const* structName, const bt_field* field);
-static void AddField(json_object* jobj, char const* fieldName, const bt_field* field);
+static void AddFieldSignedInteger(event_writer* writer,
+                                  const field_op* fieldOp,
+                                  const bt_field* field) {
+  int64_t val = bt_field_integer_signed_get_value(field);
+  writer_int64(writer, fieldOp->name, fieldOp->name_len, val);
+}
 
-static bool startsWith(const char* str, const char* query_prefix) {
-  if (!str || !query_prefix) {
-    return false;
-  }
+static void AddFieldBool(event_writer* writer, const field_op* fieldOp, const bt_field* field) {
+  bool val = bt_field_bool_get_value(field) == BT_TRUE;
+  writer_bool(writer, fieldOp->name, fieldOp->name_len, val);
+}
 
-  const size_t lenstr = strlen(str);
-  const size_t lenpre = strlen(query_prefix);
-  return lenpre > lenstr ? false : strncmp(str, query_prefix, lenpre) == 0;
+static void AddFieldString(event_writer* writer, const field_op* fieldOp, const bt_field* field) {
+  const char* val = bt_field_string_get_value(field);
+  uint64_t len = bt_field_string_get_length(field);
+  writer_string(writer, fieldOp->name, fieldOp->name_len, val, len);
 }
 
-static bool endsWith(const char* str, const char* query_suffix) {
-  if (!str || !query_suffix) {
-    return false;
-  }
+static void AddFieldSingleReal(event_writer* writer,
+                               const field_op* fieldOp,
+                               const bt_field* field) {
+  float val = bt_field_real_single_precision_get_value(field);
+  writer_double(writer, fieldOp->name, fieldOp->name_len, val);
+}
 
-  const size_t lenstr = strlen(str);
-  const size_t lensuf = strlen(query_suffix);
-  return lensuf > lenstr ? false : strncmp(str + lenstr - lensuf, query_suffix, lensuf) == 0;
+static void AddFieldDoubleReal(event_writer* writer,
+                               const field_op* fieldOp,
+                               const bt_field* field) {
+  double val = bt_field_real_double_precision_get_value(field);
+  writer_double(writer, fieldOp->name, fieldOp->name_len, val);
 }
 
-void AddFieldInteger(json_object* jobj, char const* const fieldName, const bt_field* field) {
-  uint64_t val = bt_field_integer_unsigned_get_value(field);
+static void AddFieldBitArray(event_writer* writer, const field_op* fieldOp, const bt_field* field) {
+  uint64_t val = bt_field_bit_array_get_value_as_integer(field);
+  writer_uint64(writer, fieldOp->name, fieldOp->name_len, val);
+}
 
-  if (fieldName) {
-    json_object_object_add(jobj, fieldName, json_object_new_int64(val));
-  } else {
-    FAIL_FAST_IF(!json_object_is_type(jobj, json_type_array));
-    json_object_array_add(jobj, json_object_new_int64(val));
+// Bytes gathered from the fields of a byte array before being encoded, a
+// multiple of 3 so that base64 only pads the last ones
+#define BYTE_ARRAY_CHUNK 768
+
+// Values gathered from the fields of an integer array before being written.
+// libbabeltrace2 only hands array elements out one field at a time, so each
+// one is still borrowed, but the values are then written in one pass per
+// chunk instead of one writer call each
+#define INTEGER_ARRAY_CHUNK 256
+
+static void AddFieldUnsignedArray(event_writer* writer,
+                                  const field_op* fieldOp,
+                                  const bt_field* field) {
+  writer_begin_array(writer, fieldOp->name, fieldOp->name_len);
+
+  uint64_t numElements = bt_field_array_get_length(field);
+  uint64_t chunk[INTEGER_ARRAY_CHUNK];
+  for (uint64_t i = 0; i < numElements;) {
+    size_t chunkSize = numElements - i < INTEGER_ARRAY_CHUNK ? (size_t)(numElements - i)
+                                                             : INTEGER_ARRAY_CHUNK;
+    for (size_t j = 0; j < chunkSize; j++) {
+      const bt_field* elementField =
+          bt_field_array_borrow_element_field_by_index_const(field, i + j);
+      chunk[j] = bt_field_integer_unsigned_get_value(elementField);
+    }
+    writer_uint64_values(writer, chunk, chunkSize);
+    i += chunkSize;
   }
-}
 
-static void AddFieldBool(json_object* jobj, char const* const fieldName, const bt_field* field) {
-  bool val = bt_field_bool_get_value(field) == BT_TRUE;
-  json_object_object_add(jobj, fieldName, json_object_new_boolean(val));
+  writer_end_array(writer);
 }
 
-static void AddFieldString(json_object* jobj, char const* fieldName, const bt_field* field) {
-  const char* val = bt_field_string_get_value(field);
-  uint64_t len = bt_field_string_get_length(field);
-  json_object_object_add(jobj, fieldName, json_object_new_string(val));
-}
+static void AddFieldSignedArray(event_writer* writer,
+                                const field_op* fieldOp,
+                                const bt_field* field) {
+  writer_begin_array(writer, fieldOp->name, fieldOp->name_len);
 
-static void AddFieldReal(json_object* jobj, char const* fieldName, const bt_field* field) {
-  float val = bt_field_real_single_precision_get_value(field);
-  json_object_object_add(jobj, fieldName, json_object_new_double(val));
+  uint64_t numElements = bt_field_array_get_length(field);
+  int64_t chunk[INTEGER_ARRAY_CHUNK];
+  for (uint64_t i = 0; i < numElements;) {
+    size_t chunkSize = numElements - i < INTEGER_ARRAY_CHUNK ? (size_t)(numElements - i)
+                                                             : INTEGER_ARRAY_CHUNK;
+    for (size_t j = 0; j < chunkSize; j++) {
+      const bt_field* elementField =
+          bt_field_array_borrow_element_field_by_index_const(field, i + j);
+      chunk[j] = bt_field_integer_signed_get_value(elementField);
+    }
+    writer_int64_values(writer, chunk, chunkSize);
+    i += chunkSize;
+  }
+
+  writer_end_array(writer);
 }
 
-static void AddFieldBitArray(json_object* jobj,
-                             char const* const fieldName,
-                             const bt_field* field) {
-  uint64_t val = bt_field_bit_array_get_value_as_integer(field);
-  json_object_object_add(jobj, fieldName, json_object_new_int64(val));
+// Writes the first `writer->bytes_max` bytes as a string, see
+// byte_array_encoding
+static void AddFieldByteArray(event_writer* writer,
+                              const field_op* fieldOp,
+                              const bt_field* field) {
+  uint64_t numElements = bt_field_array_get_length(field);
+  uint64_t numWritten = numElements;
+  if (writer->bytes_max && numWritten > writer->bytes_max) {
+    numWritten = writer->bytes_max;
+  }
+  bool truncated = numWritten < numElements;
+
+  size_t size = encoded_bytes_size(writer->bytes, numWritten) + (truncated ? 3 : 0);
+  char* out = writer_string_in_place(writer, fieldOp->name, fieldOp->name_len, size);
+
+  uint8_t chunk[BYTE_ARRAY_CHUNK];
+  for (uint64_t i = 0; i < numWritten;) {
+    size_t chunkSize = numWritten - i < BYTE_ARRAY_CHUNK ? (size_t)(numWritten - i)
+                                                         : BYTE_ARRAY_CHUNK;
+    for (size_t j = 0; j < chunkSize; j++) {
+      const bt_field* elementField =
+          bt_field_array_borrow_element_field_by_index_const(field, i + j);
+      chunk[j] = (uint8_t)bt_field_integer_unsigned_get_value(elementField);
+    }
+    out += encode_bytes(writer->bytes, chunk, chunkSize, out);
+    i += chunkSize;
+  }
+
+  if (truncated) {
+    memcpy(out, "...", 3);
+  }
 }
 
-static void AddFieldArray(json_object* jobj, char const* fieldName, const bt_field* field) {
-  json_object* array_jobj = json_object_new_array();
-  json_object_object_add(jobj, fieldName, array_jobj);
+// Static and dynamic arrays only differ in where their length comes from,
+// which the field already knows
+static void AddFieldArray(event_writer* writer,
+                          const field_op* ops,
+                          uint32_t op,
+                          const bt_field* field) {
+  switch (ops[op].kernel) {
+    case ARRAY_KERNEL_BYTES:
+      if (writer->bytes != BYTE_ARRAY_ENCODING_LIST) {
+        AddFieldByteArray(writer, &ops[op], field);
+        return;
+      }
+      AddFieldUnsignedArray(writer, &ops[op], field);
+      return;
+    case ARRAY_KERNEL_UNSIGNED:
+      AddFieldUnsignedArray(writer, &ops[op], field);
+      return;
+    case ARRAY_KERNEL_SIGNED:
+      AddFieldSignedArray(writer, &ops[op], field);
+      return;
+    case ARRAY_KERNEL_FIELDS:
+      break;
+  }
+
+  writer_begin_array(writer, ops[op].name, ops[op].name_len);
 
   uint64_t numElements = bt_field_array_get_length(field);
   for (uint64_t i = 0; i < numElements; i++) {
     const bt_field* elementField = bt_field_array_borrow_element_field_by_index_const(field, i);
 
-    AddField(array_jobj, NULL, elementField);
+    // The element op directly follows the array op
+    AddField(writer, ops, op + 1, elementField);
   }
+
+  writer_end_array(writer);
 }
 
-static void AddFieldEnum(json_object* jobj, char const* const fieldName, const bt_field* field) {
+// The labels of an enumeration field are looked up in a buffer of its
+// class, shared by all the fields of the class: the events of a batch
+// being decoded by several threads (see decode_pool.h), the lookups must
+// not overlap. The labels themselves belong to the mappings of the class.
+static pthread_mutex_t enumLabelsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Enumerations are written as their first label, or as their integer value
+// when no mapping contains it
+static void AddFieldUnsignedEnum(event_writer* writer,
+                                 const field_op* fieldOp,
+                                 const bt_field* field) {
   const char* const* labels = NULL;
   uint64_t labelsCount = 0;
+  const char* label = NULL;
+  pthread_mutex_lock(&enumLabelsLock);
   bt_field_enumeration_unsigned_get_mapping_labels(field, &labels, &labelsCount);
+  if (labelsCount > 0) {
+    label = labels[0];
+  }
+  pthread_mutex_unlock(&enumLabelsLock);
 
+  if (label) {
+    writer_string(writer, fieldOp->name, fieldOp->name_len, label, strlen(label));
+  } else {
+    AddFieldUnsignedInteger(writer, fieldOp, field);
+  }
+}
+
+static void AddFieldSignedEnum(event_writer* writer,
+                               const field_op* fieldOp,
+                               const bt_field* field) {
+  const char* const* labels = NULL;
+  uint64_t labelsCount = 0;
+  const char* label = NULL;
+  pthread_mutex_lock(&enumLabelsLock);
+  bt_field_enumeration_signed_get_mapping_labels(field, &labels, &labelsCount);
   if (labelsCount > 0) {
-    json_object_object_add(jobj, fieldName, json_object_new_string(labels[0]));
+    label = labels[0];
+  }
+  pthread_mutex_unlock(&enumLabelsLock);
+
+  if (label) {
+    writer_string(writer, fieldOp->name, fieldOp->name_len, label, strlen(label));
+  } else {
+    AddFieldSignedInteger(writer, fieldOp, field);
+  }
+}
+
+// An option is written as its content, or as null when it has none
+static void AddFieldOption(event_writer* writer,
+                           const field_op* ops,
+                           uint32_t op,
+                           const bt_field* field) {
+  const bt_field* contentField = bt_field_option_borrow_field_const(field);
+
+  if (contentField) {
+    // The content op directly follows the option op, with the same name
+    AddField(writer, ops, op + 1, contentField);
   } else {
-    uint64_t val = bt_field_integer_unsigned_get_value(field);
-    json_object_object_add(jobj, fieldName, json_object_new_int64(val));
+    writer_null(writer, ops[op].name, ops[op].name_len);
   }
 }
 
-static void AddField(json_object* jobj, char const* fieldName, const bt_field* field) {
-  // Skip added '_foo_sequence_field_length' type fields
-  if (startsWith(fieldName, "_") && endsWith(fieldName, "_length")) {
-    return;
+// A variant is written as an object of a single member: its selected option
+static void AddFieldVariant(event_writer* writer,
+                            const field_op* ops,
+                            uint32_t op,
+                            const bt_field* field) {
+  uint64_t selected = bt_field_variant_get_selected_option_index(field);
+  const bt_field* optionField = bt_field_variant_borrow_selected_option_field_const(field);
+
+  writer_begin_object(writer, ops[op].name, ops[op].name_len);
+
+  // Option ops follow the variant op, each one spanning up to its `end`
+  uint32_t option = op + 1;
+  while (ops[option].index != selected) {
+    option = ops[option].end;
   }
+  AddField(writer, ops, option, optionField);
 
-  bt_field_class_type fieldType = bt_field_get_class_type(field);
-  switch (fieldType) {
+  writer_end_object(writer);
+}
+
+// Fields of the classes is_decodable_field_class_type() rejects are left
+// out, and counted once per class when their layout is compiled
+static void AddField(event_writer* writer,
+                     const field_op* ops,
+                     uint32_t op,
+                     const bt_field* field) {
+  const field_op* const fieldOp = &ops[op];
+
+  switch (fieldOp->type) {
     case BT_FIELD_CLASS_TYPE_BOOL:
-      AddFieldBool(jobj, fieldName, field);
+      AddFieldBool(writer, fieldOp, field);
       return;
     case BT_FIELD_CLASS_TYPE_BIT_ARRAY:
-      AddFieldBitArray(jobj, fieldName, field);
+      AddFieldBitArray(writer, fieldOp, field);
       return;
     case BT_FIELD_CLASS_TYPE_UNSIGNED_INTEGER:
-    case BT_FIELD_CLASS_TYPE_INTEGER:
+      AddFieldUnsignedInteger(writer, fieldOp, field);
+      return;
     case BT_FIELD_CLASS_TYPE_SIGNED_INTEGER:
-      AddFieldInteger(jobj, fieldName, field);
+      AddFieldSignedInteger(writer, fieldOp, field);
       return;
-    case BT_FIELD_CLASS_TYPE_ENUMERATION:
     case BT_FIELD_CLASS_TYPE_UNSIGNED_ENUMERATION:
+      AddFieldUnsignedEnum(writer, fieldOp, field);
+      return;
     case BT_FIELD_CLASS_TYPE_SIGNED_ENUMERATION:
-      AddFieldEnum(jobj, fieldName, field);
+      AddFieldSignedEnum(writer, fieldOp, field);
       return;
-    case BT_FIELD_CLASS_TYPE_REAL:
     case BT_FIELD_CLASS_TYPE_SINGLE_PRECISION_REAL:
+      AddFieldSingleReal(writer, fieldOp, field);
+      return;
     case BT_FIELD_CLASS_TYPE_DOUBLE_PRECISION_REAL:
-      AddFieldReal(jobj, fieldName, field);
+      AddFieldDoubleReal(writer, fieldOp, field);
       return;
     case BT_FIELD_CLASS_TYPE_STRING:
-      AddFieldString(jobj, fieldName, field);
+      AddFieldString(writer, fieldOp, field);
       return;
     case BT_FIELD_CLASS_TYPE_STRUCTURE:
-      AddFieldStruct(jobj, fieldName, field);
+      AddFieldStruct(writer, ops, op, field);
       return;
-    case BT_FIELD_CLASS_TYPE_DYNAMIC_ARRAY:
     case BT_FIELD_CLASS_TYPE_STATIC_ARRAY:
     case BT_FIELD_CLASS_TYPE_DYNAMIC_ARRAY_WITHOUT_LENGTH_FIELD:
     case BT_FIELD_CLASS_TYPE_DYNAMIC_ARRAY_WITH_LENGTH_FIELD:
-      AddFieldArray(jobj, fieldName, field);
+      AddFieldArray(writer, ops, op, field);
       return;
     case BT_FIELD_CLASS_TYPE_OPTION_WITHOUT_SELECTOR_FIELD:
     case BT_FIELD_CLASS_TYPE_OPTION_WITH_BOOL_SELECTOR_FIELD:
     case BT_FIELD_CLASS_TYPE_OPTION_WITH_UNSIGNED_INTEGER_SELECTOR_FIELD:
     case BT_FIELD_CLASS_TYPE_OPTION_WITH_SIGNED_INTEGER_SELECTOR_FIELD:
-      // AddFieldOption(builder, itr, fieldName, field);
+      AddFieldOption(writer, ops, op, field);
       return;
     case BT_FIELD_CLASS_TYPE_VARIANT_WITHOUT_SELECTOR_FIELD:
     case BT_FIELD_CLASS_TYPE_VARIANT_WITH_UNSIGNED_INTEGER_SELECTOR_FIELD:
     case BT_FIELD_CLASS_TYPE_VARIANT_WITH_SIGNED_INTEGER_SELECTOR_FIELD:
-      // AddFieldVariant(builder, itr, fieldName, field);
+      AddFieldVariant(writer, ops, op, field);
       return;
-      // Unimplemented
-    case BT_FIELD_CLASS_TYPE_ARRAY:
-    case BT_FIELD_CLASS_TYPE_OPTION:
-    case BT_FIELD_CLASS_TYPE_OPTION_WITH_SELECTOR_FIELD:
-    case BT_FIELD_CLASS_TYPE_OPTION_WITH_INTEGER_SELECTOR_FIELD:
-    case BT_FIELD_CLASS_TYPE_VARIANT:
-    case BT_FIELD_CLASS_TYPE_VARIANT_WITH_SELECTOR_FIELD:
-    case BT_FIELD_CLASS_TYPE_VARIANT_WITH_INTEGER_SELECTOR_FIELD:
-    case __BT_FIELD_CLASS_TYPE_BIG_VALUE:
-      printf("WARNING: Field decoder is not implemented\n");
+    default:
       return;
   }
-  printf("WARNING: not all field types have been listed.\n");
 }
 
-static void AddFieldStruct(json_object* jobj, char const* structName, const bt_field* field) {
-  const bt_field_class* fieldClass = bt_field_borrow_class_const(field);
-  uint64_t numFields = bt_field_class_structure_get_member_count(fieldClass);
-  json_object* struct_jobj = json_object_new_object();
-
-  for (uint64_t i = 0; i < numFields; i++) {
-    const bt_field_class_structure_member* structFieldClass =
-        bt_field_class_structure_borrow_member_by_index_const(fieldClass, i);
+// Returns the offset of the structure value within the output buffer
+static size_t AddFieldStruct(event_writer* writer,
+                             const field_op* ops,
+                             uint32_t op,
+                             const bt_field* field) {
+  size_t valueStart = writer_begin_object(writer, ops[op].name, ops[op].name_len);
 
-    const char* structFieldName = bt_field_class_structure_member_get_name(structFieldClass);
-    const bt_field* structField = bt_field_structure_borrow_member_field_by_index_const(field, i);
+  // Member ops follow the structure op, each one spanning up to its `end`
+  for (uint32_t member = op + 1; member < ops[op].end; member = ops[member].end) {
+    const bt_field* structField =
+        bt_field_structure_borrow_member_field_by_index_const(field, ops[member].index);
 
-    AddField(struct_jobj, structFieldName, structField);
+    AddField(writer, ops, member, structField);
   }
 
-  json_object_object_add(jobj, structName, struct_jobj);
+  writer_end_object(writer);
+  return valueStart;
 }
 
-static void AddEventName(json_object* const jobj, bt_event_class const* const event_class) {
-  json_object_object_add(jobj, "name",
-                         json_object_new_string(bt_event_class_get_name(event_class)));
+static void AddEventName(event_writer* const writer, event_decoder const* const decoder) {
+  writer_string(writer, "name", 4, decoder->name, strlen(decoder->name));
 }
 
-static void AddPayload(json_object* const jobj, bt_event const* const event) {
+// Returns the offset of the payload value within the output buffer, or
+// SIZE_MAX if the event has no payload
+static size_t AddPayload(event_writer* const writer,
+                         event_decoder const* const decoder,
+                         bt_event const* const event) {
+  if (decoder->payload == NO_FIELD_OP) {
+    return SIZE_MAX;
+  }
+
   const bt_field* payloadField = bt_event_borrow_payload_field_const(event);
-  AddFieldStruct(jobj, "payload", payloadField);
+  return AddFieldStruct(writer, decoder->ops, decoder->payload, payloadField);
 }
 
-static void AddTimestamp(json_object* jobj, const bt_clock_snapshot* clock) {
+static int64_t GetTimestampNs(const bt_clock_snapshot* clock) {
   int64_t nanosFromEpoch = 0;
   bt_clock_snapshot_get_ns_from_origin_status clockStatus =
       bt_clock_snapshot_get_ns_from_origin(clock, &nanosFromEpoch);
   FAIL_FAST_IF(clockStatus != BT_CLOCK_SNAPSHOT_GET_NS_FROM_ORIGIN_STATUS_OK);
-  time_t t = (time_t)(nanosFromEpoch / 1e9);
-  json_object_object_add(jobj, "time", json_object_new_string(strtok(ctime(&t), "\n")));
+  return nanosFromEpoch;
 }
 
-static void AddPacketContext(json_object* jobj, const bt_event* event) {
-  const bt_packet* packet = bt_event_borrow_packet_const(event);
-  const bt_field* packetContext = bt_packet_borrow_context_field_const(packet);
-  AddFieldStruct(jobj, "packet_context", packetContext);
+// `time` is the rendering of the timestamp by format_timestamp(), written
+// as a number instead when empty. Returns the offset of the rendering
+// within the output buffer, which only holds for a non-empty `time`
+static size_t AddTimestamp(event_writer* writer,
+                           const char* time,
+                           size_t timeLen,
+                           int64_t nanosFromEpoch) {
+  if (timeLen == 0) {
+    writer_int64(writer, "time", 4, nanosFromEpoch);
+    return writer->buffer->size;
+  }
+  char* const out = writer_string_in_place(writer, "time", 4, timeLen);
+  memcpy(out, time, timeLen);
+  return (size_t)(out - writer->buffer->data);
 }
 
-static void AddStreamEventContext(json_object* jobj, const bt_event* event) {
-  const bt_field* streamEventContext = bt_event_borrow_common_context_field_const(event);
-  if (streamEventContext) {
-    AddFieldStruct(jobj, "stream_event_context", streamEventContext);
+static void AddPacketContext(event_writer* writer,
+                             const event_decoder* decoder,
+                             const bt_event* event) {
+  if (decoder->packet_context != NO_FIELD_OP) {
+    const bt_packet* packet = bt_event_borrow_packet_const(event);
+    const bt_field* packetContext = bt_packet_borrow_context_field_const(packet);
+    AddFieldStruct(writer, decoder->ops, decoder->packet_context, packetContext);
   }
 }
 
-static void AddEventContext(json_object* jobj, const bt_event* event) {
-  const bt_field* eventContext = bt_event_borrow_specific_context_field_const(event);
-
-  if (eventContext) {
-    AddFieldStruct(jobj, "event_context", eventContext);
+static void AddStreamEventContext(event_writer* writer,
+                                  const event_decoder* decoder,
+                                  const bt_event* event) {
+  if (decoder->common_context != NO_FIELD_OP) {
+    const bt_field* streamEventContext = bt_event_borrow_common_context_field_const(event);
+    AddFieldStruct(writer, decoder->ops, decoder->common_context, streamEventContext);
   }
 }
 
-static void AddEventHeader(json_object* jobj, const bt_event* event) {
-  const bt_packet* packet = bt_event_borrow_packet_const(event);
-  const bt_stream* stream = bt_packet_borrow_stream_const(packet);
-  const bt_trace* trace = bt_stream_borrow_trace_const(stream);
-
-  json_object* event_hearder_jobj = json_object_new_object();
-  json_object_object_add(jobj, "event_header", event_hearder_jobj);
-
-  {
-    const char* traceName = bt_trace_get_name(trace);
-    if (!traceName) {
-      traceName = "Unknown";
-    }
-
-    json_object_object_add(event_hearder_jobj, "trace", json_object_new_string(traceName));
-
-    uint64_t count = bt_trace_get_environment_entry_count(trace);
-    for (uint64_t i = 0; i < count; i++) {
-      const char* name = NULL;
-      const bt_value* val = NULL;
-      bt_trace_borrow_environment_entry_by_index_const(trace, i, &name, &val);
-      // TODO: Add these values to the jsonBuilder
-    }
+static void AddEventContext(event_writer* writer,
+                            const event_decoder* decoder,
+                            const bt_event* event) {
+  if (decoder->specific_context != NO_FIELD_OP) {
+    const bt_field* eventContext = bt_event_borrow_specific_context_field_const(event);
+    AddFieldStruct(writer, decoder->ops, decoder->specific_context, eventContext);
   }
 }
+
+// The trace of the event is only referred to: its name and environment are
+// in the trace record of the same id (see write_trace_info())
+static void AddEventHeader(event_writer* writer, const trace_info* trace) {
+  writer_begin_object(writer, "event_header", 12);
+  writer_int64(writer, "trace_id", 8, trace->id);
+  writer_end_object(writer);
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <babeltrace2/babeltrace.h>
+
+#include "decode_event.h"
+#include "event_batch.h"
+#include "fail_fast_if.h"
+
+/*
+ * Fewest jobs worth waking one more decoding thread for: below that,
+ * handing the jobs over costs more than rendering them.
+ */
+#define DECODE_POOL_MIN_JOBS 64
+
+/*
+ * An event selected for rendering, with everything which depends on the
+ * order of the events (decoder lookups, filtering, relative timestamps)
+ * already done: jobs can be rendered in any order, by any thread.
+ */
+typedef struct decode_job {
+  const bt_event* event;
+  const event_decoder* decoder;
+  const trace_info* trace;
+  uint32_t time_len; /* 0: the timestamp is written as a number */
+  char time[48];
+} decode_job;
+
+/*
+ * Renders `job` with `writer` and completes its `record`, of which the
+ * name, timestamp, stream and trace are already set.
+ */
+static void render_decode_job(event_writer* const writer,
+                              const decode_job* const job,
+                              event_record* const record) {
+  size_t const start = writer->buffer->size;
+  writer_begin_record(writer);
+  writer_begin_object(writer, NULL, 0);
+
+  AddEventName(writer, job->decoder);
+  size_t const timeStart = AddTimestamp(writer, job->time, job->time_len, record->timestamp_ns);
+  record->time_offset = (uint32_t)(timeStart - start);
+  record->time_length = job->time_len;
+  AddPacketContext(writer, job->decoder, job->event);
+  AddEventHeader(writer, job->trace);
+  AddStreamEventContext(writer, job->decoder, job->event);
+  AddEventContext(writer, job->decoder, job->event);
+
+  size_t const payloadStart = AddPayload(writer, job->decoder, job->event);
+  record->payload_offset = payloadStart == SIZE_MAX ? writer->buffer->size : payloadStart;
+  record->payload_length = writer->buffer->size - record->payload_offset;
+
+  writer_end_object(writer);
+  record->offset = writer_end_record(writer);
+  record->length = writer->buffer->size - record->offset;
+}
+
+struct decode_pool;
+
+/*
+ * A thread of a decode_pool, rendering the jobs of its range into its
+ * own scratch buffer.
+ */
+typedef struct decode_thread {
+  pthread_t thread;
+  struct decode_pool* pool;
+  uint64_t generation; /* Of the last range rendered */
+  uint64_t first_job;
+  uint64_t end_job;
+  byte_buffer scratch;
+} decode_thread;
+
+/*
+ * A fixed set of threads which, along with the thread running the graph,
+ * render the events of each batch.
+ *
+ * The jobs of a batch are split into contiguous ranges, one per thread,
+ * the calling thread taking the first one and rendering it into the
+ * arena of the batch directly. The renderings of the other ranges are
+ * then appended in order: records keep the slots, and the arena the
+ * order, the messages came in.
+ */
+typedef struct decode_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t start; /* `generation` changed or `stopping` was set */
+  pthread_cond_t done;  /* `pending` dropped to 0 */
+  uint64_t generation;
+  uint32_t pending;
+  bool stopping;
+
+  decode_thread* threads;
+  uint32_t thread_count;
+
+  /* Jobs of the current batch, reused across batches */
+  decode_job* jobs;
+  uint64_t job_capacity;
+
+  /* What the threads render, for the current generation */
+  const event_writer* writer;
+  event_record* records;
+} decode_pool;
+
+static void render_decode_range(decode_pool* const pool,
+                                byte_buffer* const buffer,
+                                uint64_t const first_job,
+                                uint64_t const end_job) {
+  event_writer writer = *pool->writer;
+  writer.buffer = buffer;
+
+  for (uint64_t i = first_job; i < end_job; i++) {
+    render_decode_job(&writer, &pool->jobs[i], &pool->records[i]);
+  }
+}
+
+static void* decode_thread_main(void* const data) {
+  decode_thread* const thread = (decode_thread*)data;
+  decode_pool* const pool = thread->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!pool->stopping && thread->generation == pool->generation) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    thread->generation = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    thread->scratch.size = 0;
+    render_decode_range(pool, &thread->scratch, thread->first_job, thread->end_job);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+static void destroy_decode_pool(decode_pool* const pool) {
+  if (!pool) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (uint32_t i = 0; i < pool->thread_count; i++) {
+    pthread_join(pool->threads[i].thread, NULL);
+    byte_buffer_destroy(&pool->threads[i].scratch);
+  }
+  free(pool->threads);
+  free(pool->jobs);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+/*
+ * Returns a pool of `thread_count` threads helping the thread running
+ * the graph, or NULL if they cannot be started.
+ */
+static decode_pool* create_decode_pool(uint32_t const thread_count) {
+  decode_pool* const pool = (decode_pool*)calloc(1, sizeof(decode_pool));
+  FAIL_FAST_IF(!pool);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  pool->threads = (decode_thread*)calloc(thread_count ? thread_count : 1, sizeof(decode_thread));
+  FAIL_FAST_IF(!pool->threads);
+  for (uint32_t i = 0; i < thread_count; i++) {
+    decode_thread* const thread = &pool->threads[i];
+    thread->pool = pool;
+    if (pthread_create(&thread->thread, NULL, decode_thread_main, thread) != 0) {
+      destroy_decode_pool(pool);
+      return NULL;
+    }
+    pool->thread_count++;
+  }
+  return pool;
+}
+
+/*
+ * Returns room for the jobs of `count` messages.
+ */
+static decode_job* reserve_decode_jobs(decode_pool* const pool, uint64_t const count) {
+  if (count > pool->job_capacity) {
+    pool->job_capacity = count > pool->job_capacity * 2 ? count : pool->job_capacity * 2;
+    pool->jobs = (decode_job*)realloc(pool->jobs, pool->job_capacity * sizeof(decode_job));
+    FAIL_FAST_IF(!pool->jobs);
+  }
+  return pool->jobs;
+}
+
+/*
+ * Renders the first `job_count` jobs of `pool` with `writer`, whose
+ * buffer is the arena of `batch`, into the records of `batch` from
+ * `first_record` on, which are already counted in the batch.
+ */
+static void run_decode_pool(decode_pool* const pool,
+                            const event_writer* const writer,
+                            event_batch* const batch,
+                            uint64_t const first_record,
+                            uint64_t const job_count) {
+  if (job_count == 0) {
+    return;
+  }
+
+  pool->writer = writer;
+  pool->records = &batch->records[first_record];
+
+  uint64_t active = job_count / DECODE_POOL_MIN_JOBS;
+  if (active > (uint64_t)pool->thread_count + 1) {
+    active = (uint64_t)pool->thread_count + 1;
+  }
+  if (active <= 1) {
+    render_decode_range(pool, &batch->arena, 0, job_count);
+    return;
+  }
+
+  /* Range 0 is ours, range i + 1 is the one of thread i, empty if not active */
+  uint64_t const per_range = job_count / active;
+  uint64_t const own_end = job_count - per_range * (active - 1);
+  uint64_t next = own_end;
+
+  pthread_mutex_lock(&pool->lock);
+  for (uint32_t i = 0; i < pool->thread_count; i++) {
+    decode_thread* const thread = &pool->threads[i];
+    thread->first_job = next;
+    thread->end_job = i + 1 < active ? next + per_range : next;
+    next = thread->end_job;
+  }
+  pool->pending = pool->thread_count;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  render_decode_range(pool, &batch->arena, 0, own_end);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  /* Append the other renderings in order, moving their records along */
+  for (uint32_t i = 0; i < pool->thread_count; i++) {
+    decode_thread* const thread = &pool->threads[i];
+    if (thread->first_job == thread->end_job) {
+      continue;
+    }
+
+    uint64_t const base = batch->arena.size;
+
+    byte_buffer_append(&batch->arena, thread->scratch.data, thread->scratch.size);
+    for (uint64_t job = thread->first_job; job < thread->end_job; job++) {
+      pool->records[job].offset += base;
+      pool->records[job].payload_offset += base;
+    }
+  }
+}
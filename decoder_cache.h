@@ -0,0 +1,520 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <babeltrace2/babeltrace.h>
+
+#include "fail_fast_if.h"
+#include "trace_registry.h"
+
+/*
+ * Index of an absent layout (e.g. an event class without a specific
+ * context field class).
+ */
+#define NO_FIELD_OP UINT32_MAX
+
+/*
+ * How the elements of an array are written. Integer elements skip the
+ * dispatch of AddField() for each of them, and bytes may also be written
+ * as a single string (see byte_array_encoding).
+ */
+typedef enum array_kernel {
+  ARRAY_KERNEL_FIELDS = 0,
+  ARRAY_KERNEL_UNSIGNED = 1,
+  ARRAY_KERNEL_SIGNED = 2,
+  ARRAY_KERNEL_BYTES = 3, /* Unsigned integers of at most 8 bits */
+} array_kernel;
+
+/*
+ * A single compiled decoding step.
+ *
+ * A layout is a flat, pre-order array of ops: the member ops of a
+ * structure, the element op of an array, the option ops of a variant
+ * and the content op of an option directly follow their parent, and
+ * `end` is the index one past the last op of the subtree.
+ * Decoding an event then only walks this array and borrows fields by
+ * index instead of rediscovering the field classes.
+ */
+typedef struct field_op {
+  bt_field_class_type type;
+  const char* name; /* Interned, NULL for array elements */
+  uint32_t name_len;
+  uint32_t end;
+  uint64_t index; /* Member (or option) index within the parent structure (or variant) */
+  array_kernel kernel; /* Arrays only */
+} field_op;
+
+/*
+ * Compiled layouts of one event class. The four roots index into the
+ * shared `ops` array.
+ *
+ * The `filter_` members cache what the event filter of generation
+ * `filter_generation` decided for the class (see event_filter.h), and
+ * the `stats_` members where the event stats find the fields they keep
+ * histograms of (see event_stats.h), and the `table_` members the class
+ * of the event table storing the events (see event_table.h).
+ */
+typedef struct event_decoder {
+  const bt_event_class* event_class;
+  const char* name;
+  field_op* ops;
+  uint32_t op_count;
+  uint32_t op_capacity;
+  uint32_t packet_context;
+  uint32_t common_context;
+  uint32_t specific_context;
+  uint32_t payload;
+
+  uint64_t filter_generation;
+  bool filter_rejects;
+  uint32_t* filter_leaves; /* Op of the field of each predicate */
+
+  bool stats_compiled;
+  uint32_t* stats_leaves; /* Op of each histogram field, then its histogram */
+
+  bool table_compiled;
+  uint32_t table_class;
+} event_decoder;
+
+/*
+ * Registry entry of a trace, see decoder_cache_trace_info().
+ */
+typedef struct cached_trace {
+  const bt_trace* trace;
+  const trace_info* info;
+} cached_trace;
+
+/*
+ * Event decoders keyed by the address of their event class.
+ *
+ * The cache holds a reference on every cached event class so that an
+ * address cannot be recycled while an entry still points to it. All the
+ * entries are dropped whenever a trace class that was never seen before
+ * shows up. A zero-initialized cache is empty and ready to use.
+ */
+typedef struct decoder_cache {
+  event_decoder** entries; /* Open addressing, linear probing */
+  uint64_t capacity;
+  uint64_t count;
+
+  char** strings; /* Interned names, open addressing */
+  uint64_t string_capacity;
+  uint64_t string_count;
+
+  const bt_trace_class** trace_classes;
+  uint64_t trace_class_count;
+  uint64_t trace_class_capacity;
+
+  /* Where the traces get their id, set by the owner of the cache */
+  trace_registry* registry;
+  cached_trace* traces; /* Also referenced, traces being few */
+  uint64_t trace_count;
+  uint64_t trace_capacity;
+  uint64_t last_trace; /* Index of the trace of the last lookup */
+
+  /* Field classes compiled so far which cannot be decoded, read by any thread */
+  uint64_t unknown_field_classes;
+} decoder_cache;
+
+static bool startsWith(const char* str, const char* query_prefix) {
+  if (!str || !query_prefix) {
+    return false;
+  }
+
+  const size_t lenstr = strlen(str);
+  const size_t lenpre = strlen(query_prefix);
+  return lenpre > lenstr ? false : strncmp(str, query_prefix, lenpre) == 0;
+}
+
+static bool endsWith(const char* str, const char* query_suffix) {
+  if (!str || !query_suffix) {
+    return false;
+  }
+
+  const size_t lenstr = strlen(str);
+  const size_t lensuf = strlen(query_suffix);
+  return lensuf > lenstr ? false : strncmp(str + lenstr - lensuf, query_suffix, lensuf) == 0;
+}
+
+static uint64_t hash_pointer(const void* const ptr) {
+  return ((uint64_t)(uintptr_t)ptr >> 4) * UINT64_C(0x9e3779b97f4a7c15);
+}
+
+static uint64_t hash_string(const char* str) {
+  /* FNV-1a */
+  uint64_t hash = UINT64_C(0xcbf29ce484222325);
+  for (; *str; str++) {
+    hash = (hash ^ (unsigned char)*str) * UINT64_C(0x100000001b3);
+  }
+  return hash;
+}
+
+/*
+ * Returns the unique copy of `str` owned by `cache`, or NULL if `str` is
+ * NULL. Interned strings stay valid until decoder_cache_destroy().
+ */
+static const char* decoder_cache_intern(decoder_cache* const cache, const char* const str) {
+  if (!str) {
+    return NULL;
+  }
+
+  if ((cache->string_count + 1) * 2 > cache->string_capacity) {
+    uint64_t const old_capacity = cache->string_capacity;
+    char** const old_strings = cache->strings;
+
+    cache->string_capacity = old_capacity ? old_capacity * 2 : 256;
+    cache->strings = (char**)calloc(cache->string_capacity, sizeof(char*));
+    FAIL_FAST_IF(!cache->strings);
+
+    for (uint64_t i = 0; i < old_capacity; i++) {
+      if (old_strings[i]) {
+        uint64_t slot = hash_string(old_strings[i]) & (cache->string_capacity - 1);
+        while (cache->strings[slot]) {
+          slot = (slot + 1) & (cache->string_capacity - 1);
+        }
+        cache->strings[slot] = old_strings[i];
+      }
+    }
+    free(old_strings);
+  }
+
+  uint64_t slot = hash_string(str) & (cache->string_capacity - 1);
+  while (cache->strings[slot]) {
+    if (strcmp(cache->strings[slot], str) == 0) {
+      return cache->strings[slot];
+    }
+    slot = (slot + 1) & (cache->string_capacity - 1);
+  }
+
+  cache->strings[slot] = strdup(str);
+  FAIL_FAST_IF(!cache->strings[slot]);
+  cache->string_count++;
+  return cache->strings[slot];
+}
+
+/*
+ * Returns whether AddField() can decode the fields of class type `type`.
+ */
+static bool is_decodable_field_class_type(bt_field_class_type const type) {
+  switch (type) {
+    case BT_FIELD_CLASS_TYPE_BOOL:
+    case BT_FIELD_CLASS_TYPE_BIT_ARRAY:
+    case BT_FIELD_CLASS_TYPE_UNSIGNED_INTEGER:
+    case BT_FIELD_CLASS_TYPE_SIGNED_INTEGER:
+    case BT_FIELD_CLASS_TYPE_UNSIGNED_ENUMERATION:
+    case BT_FIELD_CLASS_TYPE_SIGNED_ENUMERATION:
+    case BT_FIELD_CLASS_TYPE_SINGLE_PRECISION_REAL:
+    case BT_FIELD_CLASS_TYPE_DOUBLE_PRECISION_REAL:
+    case BT_FIELD_CLASS_TYPE_STRING:
+    case BT_FIELD_CLASS_TYPE_STRUCTURE:
+    case BT_FIELD_CLASS_TYPE_STATIC_ARRAY:
+    case BT_FIELD_CLASS_TYPE_DYNAMIC_ARRAY_WITHOUT_LENGTH_FIELD:
+    case BT_FIELD_CLASS_TYPE_DYNAMIC_ARRAY_WITH_LENGTH_FIELD:
+    case BT_FIELD_CLASS_TYPE_OPTION_WITHOUT_SELECTOR_FIELD:
+    case BT_FIELD_CLASS_TYPE_OPTION_WITH_BOOL_SELECTOR_FIELD:
+    case BT_FIELD_CLASS_TYPE_OPTION_WITH_UNSIGNED_INTEGER_SELECTOR_FIELD:
+    case BT_FIELD_CLASS_TYPE_OPTION_WITH_SIGNED_INTEGER_SELECTOR_FIELD:
+    case BT_FIELD_CLASS_TYPE_VARIANT_WITHOUT_SELECTOR_FIELD:
+    case BT_FIELD_CLASS_TYPE_VARIANT_WITH_UNSIGNED_INTEGER_SELECTOR_FIELD:
+    case BT_FIELD_CLASS_TYPE_VARIANT_WITH_SIGNED_INTEGER_SELECTOR_FIELD:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static uint32_t push_field_op(event_decoder* const decoder) {
+  if (decoder->op_count == decoder->op_capacity) {
+    decoder->op_capacity = decoder->op_capacity ? decoder->op_capacity * 2 : 16;
+    decoder->ops = (field_op*)realloc(decoder->ops, decoder->op_capacity * sizeof(field_op));
+    FAIL_FAST_IF(!decoder->ops);
+  }
+  return decoder->op_count++;
+}
+
+/*
+ * Appends the ops decoding a field of class `field_class` named `name`
+ * (member `index` of its parent structure) to `decoder` and returns the
+ * index of its root op.
+ */
+static uint32_t compile_field_class(decoder_cache* const cache,
+                                    event_decoder* const decoder,
+                                    const bt_field_class* const field_class,
+                                    const char* const name,
+                                    uint64_t const index) {
+  uint32_t const op = push_field_op(decoder);
+  bt_field_class_type const type = bt_field_class_get_type(field_class);
+  const char* const interned_name = decoder_cache_intern(cache, name);
+
+  decoder->ops[op].type = type;
+  decoder->ops[op].name = interned_name;
+  decoder->ops[op].name_len = interned_name ? (uint32_t)strlen(interned_name) : 0;
+  decoder->ops[op].index = index;
+  decoder->ops[op].kernel = ARRAY_KERNEL_FIELDS;
+
+  if (type == BT_FIELD_CLASS_TYPE_STRUCTURE) {
+    uint64_t const member_count = bt_field_class_structure_get_member_count(field_class);
+    for (uint64_t i = 0; i < member_count; i++) {
+      const bt_field_class_structure_member* const member =
+          bt_field_class_structure_borrow_member_by_index_const(field_class, i);
+      const char* const member_name = bt_field_class_structure_member_get_name(member);
+
+      // Skip added '_foo_sequence_field_length' type fields
+      if (startsWith(member_name, "_") && endsWith(member_name, "_length")) {
+        continue;
+      }
+
+      compile_field_class(cache, decoder,
+                          bt_field_class_structure_member_borrow_field_class_const(member),
+                          member_name, i);
+    }
+  } else if (bt_field_class_type_is(type, BT_FIELD_CLASS_TYPE_ARRAY)) {
+    const bt_field_class* const element_class =
+        bt_field_class_array_borrow_element_field_class_const(field_class);
+    bt_field_class_type const element_type = bt_field_class_get_type(element_class);
+
+    compile_field_class(cache, decoder, element_class, NULL, 0);
+    if (element_type == BT_FIELD_CLASS_TYPE_UNSIGNED_INTEGER) {
+      decoder->ops[op].kernel = bt_field_class_integer_get_field_value_range(element_class) <= 8
+                                    ? ARRAY_KERNEL_BYTES
+                                    : ARRAY_KERNEL_UNSIGNED;
+    } else if (element_type == BT_FIELD_CLASS_TYPE_SIGNED_INTEGER) {
+      decoder->ops[op].kernel = ARRAY_KERNEL_SIGNED;
+    }
+  } else if (bt_field_class_type_is(type, BT_FIELD_CLASS_TYPE_OPTION)) {
+    // The content is written in place of the option, under the same name
+    compile_field_class(cache, decoder,
+                        bt_field_class_option_borrow_field_class_const(field_class), name, 0);
+  } else if (bt_field_class_type_is(type, BT_FIELD_CLASS_TYPE_VARIANT)) {
+    uint64_t const option_count = bt_field_class_variant_get_option_count(field_class);
+    for (uint64_t i = 0; i < option_count; i++) {
+      const bt_field_class_variant_option* const option =
+          bt_field_class_variant_borrow_option_by_index_const(field_class, i);
+      compile_field_class(cache, decoder,
+                          bt_field_class_variant_option_borrow_field_class_const(option),
+                          bt_field_class_variant_option_get_name(option), i);
+    }
+  } else if (!is_decodable_field_class_type(type)) {
+    __atomic_store_n(&cache->unknown_field_classes,
+                     __atomic_load_n(&cache->unknown_field_classes, __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELAXED);
+  }
+
+  /* `decoder->ops` may have moved while compiling the children */
+  decoder->ops[op].end = decoder->op_count;
+  return op;
+}
+
+static uint32_t compile_root_field_class(decoder_cache* const cache,
+                                         event_decoder* const decoder,
+                                         const bt_field_class* const field_class,
+                                         const char* const name) {
+  if (!field_class) {
+    return NO_FIELD_OP;
+  }
+  return compile_field_class(cache, decoder, field_class, name, 0);
+}
+
+static event_decoder* compile_event_class(decoder_cache* const cache,
+                                          const bt_event_class* const event_class) {
+  const bt_stream_class* const stream_class = bt_event_class_borrow_stream_class_const(event_class);
+  event_decoder* const decoder = (event_decoder*)calloc(1, sizeof(event_decoder));
+  FAIL_FAST_IF(!decoder);
+
+  bt_event_class_get_ref(event_class);
+  decoder->event_class = event_class;
+  decoder->name = decoder_cache_intern(cache, bt_event_class_get_name(event_class));
+  decoder->packet_context = compile_root_field_class(
+      cache, decoder, bt_stream_class_borrow_packet_context_field_class_const(stream_class),
+      "packet_context");
+  decoder->common_context = compile_root_field_class(
+      cache, decoder, bt_stream_class_borrow_event_common_context_field_class_const(stream_class),
+      "stream_event_context");
+  decoder->specific_context = compile_root_field_class(
+      cache, decoder, bt_event_class_borrow_specific_context_field_class_const(event_class),
+      "event_context");
+  decoder->payload = compile_root_field_class(
+      cache, decoder, bt_event_class_borrow_payload_field_class_const(event_class), "payload");
+  return decoder;
+}
+
+static void destroy_event_decoder(event_decoder* const decoder) {
+  bt_event_class_put_ref(decoder->event_class);
+  free(decoder->ops);
+  free(decoder->filter_leaves);
+  free(decoder->stats_leaves);
+  free(decoder);
+}
+
+static void insert_event_decoder(decoder_cache* const cache, event_decoder* const decoder) {
+  uint64_t slot = hash_pointer(decoder->event_class) & (cache->capacity - 1);
+  while (cache->entries[slot]) {
+    slot = (slot + 1) & (cache->capacity - 1);
+  }
+  cache->entries[slot] = decoder;
+  cache->count++;
+}
+
+/*
+ * Returns the decoder of `event_class`, compiling it on first use.
+ */
+static event_decoder* decoder_cache_lookup(decoder_cache* const cache,
+                                           const bt_event_class* const event_class) {
+  if (cache->capacity) {
+    uint64_t slot = hash_pointer(event_class) & (cache->capacity - 1);
+    while (cache->entries[slot]) {
+      if (cache->entries[slot]->event_class == event_class) {
+        return cache->entries[slot];
+      }
+      slot = (slot + 1) & (cache->capacity - 1);
+    }
+  }
+
+  if ((cache->count + 1) * 2 > cache->capacity) {
+    uint64_t const old_capacity = cache->capacity;
+    event_decoder** const old_entries = cache->entries;
+
+    cache->capacity = old_capacity ? old_capacity * 2 : 64;
+    cache->entries = (event_decoder**)calloc(cache->capacity, sizeof(event_decoder*));
+    FAIL_FAST_IF(!cache->entries);
+    cache->count = 0;
+
+    for (uint64_t i = 0; i < old_capacity; i++) {
+      if (old_entries[i]) {
+        insert_event_decoder(cache, old_entries[i]);
+      }
+    }
+    free(old_entries);
+  }
+
+  event_decoder* const decoder = compile_event_class(cache, event_class);
+  insert_event_decoder(cache, decoder);
+  return decoder;
+}
+
+/*
+ * Drops all the compiled event decoders. Interned names are kept: they
+ * are few and most of them are shared by the next trace class anyway.
+ */
+static void decoder_cache_clear(decoder_cache* const cache) {
+  for (uint64_t i = 0; i < cache->capacity; i++) {
+    if (cache->entries[i]) {
+      destroy_event_decoder(cache->entries[i]);
+      cache->entries[i] = NULL;
+    }
+  }
+  cache->count = 0;
+}
+
+/*
+ * Returns whether messages of `trace_class` were already announced to
+ * `cache`, in which case decoder_cache_add_trace_class() keeps the
+ * cached decoders.
+ */
+static bool decoder_cache_has_trace_class(const decoder_cache* const cache,
+                                          const bt_trace_class* const trace_class) {
+  for (uint64_t i = 0; i < cache->trace_class_count; i++) {
+    if (cache->trace_classes[i] == trace_class) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Records that messages of `trace_class` are about to flow, invalidating
+ * all the cached decoders if it is a trace class never seen before.
+ */
+static void decoder_cache_add_trace_class(decoder_cache* const cache,
+                                          const bt_trace_class* const trace_class) {
+  if (decoder_cache_has_trace_class(cache, trace_class)) {
+    return;
+  }
+
+  decoder_cache_clear(cache);
+
+  if (cache->trace_class_count == cache->trace_class_capacity) {
+    cache->trace_class_capacity = cache->trace_class_capacity ? cache->trace_class_capacity * 2 : 4;
+    cache->trace_classes = (const bt_trace_class**)realloc(
+        cache->trace_classes, cache->trace_class_capacity * sizeof(bt_trace_class*));
+    FAIL_FAST_IF(!cache->trace_classes);
+  }
+  bt_trace_class_get_ref(trace_class);
+  cache->trace_classes[cache->trace_class_count++] = trace_class;
+}
+
+/*
+ * Returns the registry entry of `trace`, registering it the first time
+ * the cache sees it. Looking up the trace of the previous event, the
+ * common case, is a single comparison.
+ */
+static const trace_info* decoder_cache_trace_info(decoder_cache* const cache,
+                                                  const bt_trace* const trace) {
+  if (cache->last_trace < cache->trace_count && cache->traces[cache->last_trace].trace == trace) {
+    return cache->traces[cache->last_trace].info;
+  }
+
+  for (uint64_t i = 0; i < cache->trace_count; i++) {
+    if (cache->traces[i].trace == trace) {
+      cache->last_trace = i;
+      return cache->traces[i].info;
+    }
+  }
+
+  FAIL_FAST_IF(!cache->registry);
+  if (cache->trace_count == cache->trace_capacity) {
+    cache->trace_capacity = cache->trace_capacity ? cache->trace_capacity * 2 : 4;
+    cache->traces =
+        (cached_trace*)realloc(cache->traces, cache->trace_capacity * sizeof(cached_trace));
+    FAIL_FAST_IF(!cache->traces);
+  }
+  bt_trace_get_ref(trace);
+  cache->traces[cache->trace_count].trace = trace;
+  cache->traces[cache->trace_count].info = trace_registry_add(cache->registry, trace);
+  cache->last_trace = cache->trace_count++;
+  return cache->traces[cache->last_trace].info;
+}
+
+/*
+ * Drops all the compiled event decoders and releases the trace classes
+ * and traces, once the graph they come from is gone. Interned names are
+ * kept, as whoever counted events by name still points to them.
+ */
+static void decoder_cache_reset(decoder_cache* const cache) {
+  decoder_cache_clear(cache);
+
+  for (uint64_t i = 0; i < cache->trace_class_count; i++) {
+    bt_trace_class_put_ref(cache->trace_classes[i]);
+  }
+  cache->trace_class_count = 0;
+
+  for (uint64_t i = 0; i < cache->trace_count; i++) {
+    bt_trace_put_ref(cache->traces[i].trace);
+  }
+  cache->trace_count = 0;
+  cache->last_trace = 0;
+}
+
+/*
+ * Releases everything owned by `cache`, leaving it empty and reusable
+ * with the same registry.
+ */
+static void decoder_cache_destroy(decoder_cache* const cache) {
+  decoder_cache_reset(cache);
+  free(cache->entries);
+
+  for (uint64_t i = 0; i < cache->string_capacity; i++) {
+    free(cache->strings[i]);
+  }
+  free(cache->strings);
+  free(cache->trace_classes);
+  free(cache->traces);
+
+  trace_registry* const registry = cache->registry;
+  memset(cache, 0, sizeof(*cache));
+  cache->registry = registry;
+}
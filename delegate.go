@@ -3,6 +3,7 @@ package main
 import (
 	"fmt"
 	"io"
+	"unicode/utf8"
 
 	"github.com/charmbracelet/bubbles/list"
 	tea "github.com/charmbracelet/bubbletea"
@@ -11,11 +12,15 @@ import (
 
 type lttngDelegate struct {
 	defaultDelegate list.DefaultDelegate
+	rows            *rowCache
+	filter          *eventFilter
 }
 
-func newLttngDelegate() lttngDelegate {
+func newLttngDelegate(filter *eventFilter) lttngDelegate {
 	return lttngDelegate{
 		defaultDelegate: list.NewDefaultDelegate(),
+		rows:            newRowCache(),
+		filter:          filter,
 	}
 }
 
@@ -25,7 +30,7 @@ func (d lttngDelegate) Height() int {
 }
 
 // Render prints an item.
-func (d lttngDelegate) Render(w io.Writer, m list.Model, index int, item list.Item) {
+func (d lttngDelegate) Render(w io.Writer, m list.Model, index int, listItem list.Item) {
 	var (
 		title, desc             string
 		matchedRunesTitle       []int
@@ -33,7 +38,11 @@ func (d lttngDelegate) Render(w io.Writer, m list.Model, index int, item list.It
 		s                       = &d.defaultDelegate.Styles
 	)
 
-	if i, ok := item.(list.DefaultItem); ok {
+	if i, ok := listItem.(item); ok {
+		// Only the visible rows get there: wrap them lazily
+		title = i.Title()
+		desc = d.rows.description(i, m.Width())
+	} else if i, ok := listItem.(list.DefaultItem); ok {
 		title = i.Title()
 		desc = i.Description()
 	} else {
@@ -43,20 +52,20 @@ func (d lttngDelegate) Render(w io.Writer, m list.Model, index int, item list.It
 	// Conditions
 	var (
 		isSelected  = index == m.Index()
-		emptyFilter = m.FilterState() == list.Filtering && m.FilterValue() == ""
-		isFiltered  = m.FilterState() == list.Filtering || m.FilterState() == list.FilterApplied
+		emptyFilter = d.filter.state == list.Filtering && !d.filter.Active()
+		isFiltered  = d.filter.Active()
 	)
 
 	if isFiltered {
 		// Get indices of matched characters
-		matchedRunes := m.MatchesForItem(index)
-		matchedRunesTitle, matchedRunesDescription = getMatchedRunesForTitleAndDesciption(matchedRunes, len(title))
+		matchedRunesTitle = getMatchedRunes(title, d.filter.query)
+		matchedRunesDescription = getMatchedRunes(desc, d.filter.query)
 	}
 
 	if emptyFilter {
 		title = s.DimmedTitle.Render(title)
 		desc = s.DimmedDesc.Render(desc)
-	} else if isSelected && m.FilterState() != list.Filtering {
+	} else if isSelected && d.filter.state != list.Filtering {
 		if isFiltered {
 			// Highlight matches
 			{
@@ -107,16 +116,26 @@ func (d lttngDelegate) Update(msg tea.Msg, m *list.Model) tea.Cmd {
 	return d.defaultDelegate.Update(msg, m)
 }
 
-func getMatchedRunesForTitleAndDesciption(matchedRunes []int, titleLength int) ([]int, []int) {
-	var matchedRunesTitle []int
-	var matchedRunesDescription []int
+// getMatchedRunes returns the indices of the runes of `s` which are part of an
+// occurrence of the lowercase `query`, ignoring the case of ASCII letters.
+func getMatchedRunes(s string, query string) []int {
+	var matchedRunes []int
+	text := []byte(s)
+	runeIndex, byteIndex := 0, 0
+
+	for {
+		match := indexFold(text[byteIndex:], query)
+		if match < 0 {
+			return matchedRunes
+		}
+		match += byteIndex
 
-	for _, index := range matchedRunes {
-		if index < titleLength {
-			matchedRunesTitle = append(matchedRunesTitle, index)
-		} else {
-			matchedRunesDescription = append(matchedRunesDescription, index-titleLength)
+		runeIndex += utf8.RuneCount(text[byteIndex:match])
+		end := match + len(query)
+		for byteIndex = match; byteIndex < end; runeIndex++ {
+			_, size := utf8.DecodeRune(text[byteIndex:])
+			byteIndex += size
+			matchedRunes = append(matchedRunes, runeIndex)
 		}
 	}
-	return matchedRunesTitle, matchedRunesDescription
 }
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "event_writer.h"
+#include "fail_fast_if.h"
+
+/*
+ * At most this many released batches are kept for reuse; any extra one
+ * is freed so that a burst does not pin its memory forever.
+ */
+#define BATCH_POOL_MAX_FREE 4
+
+struct batch_pool;
+
+/*
+ * Typed view of one rendered event.
+ *
+ * The full rendering is the `length` bytes at `offset` within the arena
+ * of its batch, and the rendering of the payload structure alone is the
+ * `payload_length` bytes at `payload_offset` (empty without payload).
+ * When the time is rendered as a string, its `time_length` bytes are at
+ * `time_offset` from `offset`, which moving the record leaves valid.
+ *
+ * `name` is interned by the decoder cache: it stays valid, and keeps the
+ * same address for a given name, until destroy_relay_data(). `trace_id`
+ * is the id of the trace of the event in the trace registry.
+ */
+typedef struct event_record {
+  uint64_t offset;
+  uint64_t length;
+  uint64_t payload_offset;
+  uint64_t payload_length;
+  uint32_t time_offset;
+  uint32_t time_length; /* 0 when the time is rendered as a number */
+  const char* name;
+  int64_t timestamp_ns;
+  uint64_t stream_id;
+  uint32_t trace_id;
+} event_record;
+
+/*
+ * The records rendered from one bt_graph_run_once() call.
+ *
+ * All the records live back to back in the single contiguous `arena`
+ * and `records` describes each one of them. Consumers can therefore
+ * copy a whole batch at once, or slice it in place, instead of walking
+ * one C string per record.
+ *
+ * A batch is owned by whoever run_graph_once() returned it to until it
+ * is handed back with release_batch(). Its memory is then recycled by
+ * the next batch instead of being freed.
+ */
+typedef struct event_batch {
+  byte_buffer arena;
+  event_record* records;
+  uint64_t count;
+  uint64_t capacity;
+
+  /* monotonic_ns() when its earliest messages left the graph */
+  int64_t ingest_ns;
+
+  struct batch_pool* pool;
+  struct event_batch* next; /* Free list link */
+} event_batch;
+
+/*
+ * Released batches. Batches are acquired by the thread running the graph
+ * and released by whichever thread consumed them, hence the lock.
+ */
+typedef struct batch_pool {
+  pthread_mutex_t lock;
+  event_batch* free;
+  uint64_t free_count;
+} batch_pool;
+
+static int64_t monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void init_batch_pool(batch_pool* const pool) {
+  pthread_mutex_init(&pool->lock, NULL);
+  pool->free = NULL;
+  pool->free_count = 0;
+}
+
+/*
+ * Returns an empty batch, reusing a released one when possible.
+ */
+static event_batch* acquire_batch(batch_pool* const pool) {
+  pthread_mutex_lock(&pool->lock);
+  event_batch* batch = pool->free;
+  if (batch) {
+    pool->free = batch->next;
+    pool->free_count--;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (!batch) {
+    batch = (event_batch*)calloc(1, sizeof(event_batch));
+    FAIL_FAST_IF(!batch);
+    batch->pool = pool;
+  }
+
+  batch->next = NULL;
+  batch->count = 0;
+  batch->arena.size = 0;
+  return batch;
+}
+
+/*
+ * Makes room for `count` records in `batch`.
+ */
+static void reserve_batch(event_batch* const batch, uint64_t const count) {
+  if (count <= batch->capacity) {
+    return;
+  }
+
+  batch->capacity = count > batch->capacity * 2 ? count : batch->capacity * 2;
+  batch->records =
+      (event_record*)realloc(batch->records, batch->capacity * sizeof(event_record));
+  FAIL_FAST_IF(!batch->records);
+}
+
+/*
+ * Returns the slot of the next record of `batch`, which becomes part of
+ * the batch once push_batch_record() is called.
+ */
+static event_record* next_batch_record(event_batch* const batch) {
+  reserve_batch(batch, batch->count + 1);
+  return &batch->records[batch->count];
+}
+
+/*
+ * Completes the record which was rendered into the slot returned by
+ * next_batch_record(), from its `offset` up to the end of the arena.
+ */
+static void push_batch_record(event_batch* const batch) {
+  event_record* const record = &batch->records[batch->count++];
+  record->length = batch->arena.size - record->offset;
+}
+
+/*
+ * Keeps only one record out of every `interval` records of `batch`,
+ * `sequence` counting the records seen so far across calls, and moves
+ * the kept renderings down so that the arena stays contiguous.
+ *
+ * Returns the number of bytes of the removed renderings.
+ */
+static uint64_t sample_batch(event_batch* const batch,
+                             uint64_t const interval,
+                             uint64_t* const sequence) {
+  uint64_t kept = 0;
+  uint64_t arena_size = 0;
+
+  for (uint64_t i = 0; i < batch->count; i++) {
+    if ((*sequence)++ % interval != 0) {
+      continue;
+    }
+
+    event_record record = batch->records[i];
+    uint64_t const shift = record.offset - arena_size;
+    memmove(batch->arena.data + arena_size, batch->arena.data + record.offset, record.length);
+    record.offset -= shift;
+    record.payload_offset -= shift;
+    batch->records[kept++] = record;
+    arena_size += record.length;
+  }
+
+  uint64_t const removed = batch->arena.size - arena_size;
+  batch->count = kept;
+  batch->arena.size = arena_size;
+  return removed;
+}
+
+static void destroy_batch(event_batch* const batch) {
+  byte_buffer_destroy(&batch->arena);
+  free(batch->records);
+  free(batch);
+}
+
+/*
+ * Hands `batch` back to its pool. `batch` and its records must not be
+ * used anymore.
+ */
+static void release_batch(event_batch* const batch) {
+  batch_pool* const pool = batch->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  bool const keep = pool->free_count < BATCH_POOL_MAX_FREE;
+  if (keep) {
+    batch->next = pool->free;
+    pool->free = batch;
+    pool->free_count++;
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (!keep) {
+    destroy_batch(batch);
+  }
+}
+
+/*
+ * Frees all the released batches of `pool`. No batch of `pool` may be
+ * in flight anymore.
+ */
+static void destroy_batch_pool(batch_pool* const pool) {
+  while (pool->free) {
+    event_batch* const batch = pool->free;
+    pool->free = batch->next;
+    destroy_batch(batch);
+  }
+  pool->free_count = 0;
+  pthread_mutex_destroy(&pool->lock);
+}
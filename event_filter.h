@@ -0,0 +1,579 @@
+#pragma once
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <babeltrace2/babeltrace.h>
+
+#include "decoder_cache.h"
+#include "fail_fast_if.h"
+
+/*
+ * Maximum number of dot-separated names in a field path.
+ */
+#define EVENT_FILTER_MAX_PATH 8
+
+typedef enum filter_comparison {
+  FILTER_COMPARISON_EQ = 0,
+  FILTER_COMPARISON_NE = 1,
+  FILTER_COMPARISON_LT = 2,
+  FILTER_COMPARISON_LE = 3,
+  FILTER_COMPARISON_GT = 4,
+  FILTER_COMPARISON_GE = 5,
+} filter_comparison;
+
+/*
+ * The roots of an event_decoder, named as in the rendered events.
+ */
+typedef enum filter_root {
+  FILTER_ROOT_PAYLOAD = 0,
+  FILTER_ROOT_PACKET_CONTEXT = 1,
+  FILTER_ROOT_STREAM_EVENT_CONTEXT = 2,
+  FILTER_ROOT_EVENT_CONTEXT = 3,
+} filter_root;
+
+/*
+ * Compares a field to a constant, e.g. `payload.prev_tid>=100`.
+ */
+typedef struct filter_predicate {
+  filter_root root;
+  char* path[EVENT_FILTER_MAX_PATH];
+  uint32_t path_len;
+  filter_comparison comparison;
+
+  char* string; /* The constant as written */
+  bool is_signed;
+  bool is_unsigned;
+  bool is_real;
+  int64_t signed_value;
+  uint64_t unsigned_value;
+  double real_value;
+} filter_predicate;
+
+/*
+ * Selection of the events worth decoding, compiled from an expression of
+ * whitespace-separated terms:
+ *
+ *     name:GLOB      the event name matches the fnmatch(3) pattern GLOB
+ *     trace:GLOB     the trace name matches GLOB
+ *     stream:ID      the stream ID is ID
+ *     FIELD OP VALUE the field compares to VALUE, OP being one of
+ *                    ==, =, !=, <, <=, > and >=
+ *
+ * Terms of the same kind among `name:`, `trace:` and `stream:` are
+ * alternatives; all the other terms must hold. FIELD is a dot-separated
+ * path, relative to the payload unless it starts with the name of
+ * another root. VALUE, which may be double-quoted, is compared as a
+ * number to numeric fields and as a string to string fields.
+ *
+ * Whatever only depends on the event class (names, and where the fields
+ * are) is decided once per class and cached in its event_decoder.
+ */
+typedef struct event_filter {
+  char* expression; /* As compiled */
+  char** names;
+  uint32_t name_count;
+  char** traces;
+  uint32_t trace_count;
+  uint64_t* streams;
+  uint32_t stream_count;
+  filter_predicate* predicates;
+  uint32_t predicate_count;
+
+  /* Tells apart the filters installed over time, see event_decoder */
+  uint64_t generation;
+
+  /*
+   * Result for the trace of the last event, traces being few. The trace
+   * is referenced: a new trace cannot take the address of a freed one.
+   */
+  const bt_trace* last_trace;
+  bool last_trace_selected;
+} event_filter;
+
+/*
+ * Releases the trace of the last event of `filter`, if any.
+ */
+static void forget_filter_trace(event_filter* const filter) {
+  if (filter->last_trace) {
+    bt_trace_put_ref(filter->last_trace);
+    filter->last_trace = NULL;
+  }
+}
+
+static void destroy_event_filter(event_filter* const filter) {
+  if (!filter) {
+    return;
+  }
+
+  forget_filter_trace(filter);
+
+  for (uint32_t i = 0; i < filter->name_count; i++) {
+    free(filter->names[i]);
+  }
+  free(filter->names);
+  for (uint32_t i = 0; i < filter->trace_count; i++) {
+    free(filter->traces[i]);
+  }
+  free(filter->traces);
+  free(filter->streams);
+  for (uint32_t i = 0; i < filter->predicate_count; i++) {
+    for (uint32_t j = 0; j < filter->predicates[i].path_len; j++) {
+      free(filter->predicates[i].path[j]);
+    }
+    free(filter->predicates[i].string);
+  }
+  free(filter->predicates);
+  free(filter->expression);
+  free(filter);
+}
+
+static void set_filter_error(char* const error, size_t const error_size, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(error, error_size, format, args);
+  va_end(args);
+}
+
+static char** push_filter_string(char** strings, uint32_t* const count, const char* const str) {
+  strings = (char**)realloc(strings, (*count + 1) * sizeof(char*));
+  FAIL_FAST_IF(!strings);
+  strings[*count] = strdup(str);
+  FAIL_FAST_IF(!strings[*count]);
+  (*count)++;
+  return strings;
+}
+
+/*
+ * Copies the next term of `*expression` into `term`, without the quotes,
+ * and advances `*expression` past it. Returns false at the end.
+ */
+static bool next_filter_term(const char** const expression, char* const term, size_t const size) {
+  const char* pos = *expression;
+  size_t len = 0;
+  bool quoted = false;
+
+  while (*pos == ' ' || *pos == '\t') {
+    pos++;
+  }
+  if (!*pos) {
+    return false;
+  }
+
+  for (; *pos && (quoted || (*pos != ' ' && *pos != '\t')); pos++) {
+    if (*pos == '"') {
+      quoted = !quoted;
+    } else if (len + 1 < size) {
+      term[len++] = *pos;
+    }
+  }
+  term[len] = '\0';
+  *expression = pos;
+  return true;
+}
+
+/*
+ * Names of the roots, by filter_root.
+ */
+static const char* const filter_root_names[] = {"payload", "packet_context",
+                                                "stream_event_context", "event_context"};
+
+/*
+ * Parses the dot-separated field path `path`, of which the first name
+ * may be the one of a root, into the root and path of `predicate`.
+ * `path` is modified. Safe to call from several threads at once.
+ */
+static bool parse_filter_path(filter_predicate* const predicate,
+                              char* const path,
+                              char* const error,
+                              size_t const error_size) {
+  bool root_allowed = true;
+  char* save = NULL;
+  predicate->root = FILTER_ROOT_PAYLOAD;
+  for (char* name = strtok_r(path, ".", &save); name; name = strtok_r(NULL, ".", &save)) {
+    bool is_root = false;
+    for (uint32_t i = 0;
+         root_allowed && i < sizeof(filter_root_names) / sizeof(filter_root_names[0]); i++) {
+      if (strcmp(name, filter_root_names[i]) == 0) {
+        predicate->root = (filter_root)i;
+        is_root = true;
+      }
+    }
+    root_allowed = false;
+    if (is_root) {
+      continue;
+    }
+
+    if (predicate->path_len == EVENT_FILTER_MAX_PATH) {
+      set_filter_error(error, error_size, "field path too long: %s", path);
+      return false;
+    }
+    predicate->path[predicate->path_len] = strdup(name);
+    FAIL_FAST_IF(!predicate->path[predicate->path_len]);
+    predicate->path_len++;
+  }
+  if (predicate->path_len == 0) {
+    set_filter_error(error, error_size, "missing field name in: %s", path);
+    return false;
+  }
+  return true;
+}
+
+static bool parse_filter_predicate(filter_predicate* const predicate,
+                                   char* const term,
+                                   char* const error,
+                                   size_t const error_size) {
+  static const struct {
+    const char* op;
+    filter_comparison comparison;
+  } operators[] = {
+      {"==", FILTER_COMPARISON_EQ}, {"!=", FILTER_COMPARISON_NE}, {"<=", FILTER_COMPARISON_LE},
+      {">=", FILTER_COMPARISON_GE}, {"=", FILTER_COMPARISON_EQ},  {"<", FILTER_COMPARISON_LT},
+      {">", FILTER_COMPARISON_GT},
+  };
+
+  char* op_start = strpbrk(term, "=!<>");
+  if (!op_start || op_start == term) {
+    set_filter_error(error, error_size, "invalid term: %s", term);
+    return false;
+  }
+
+  size_t op_len = 0;
+  for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++) {
+    if (strncmp(op_start, operators[i].op, strlen(operators[i].op)) == 0) {
+      predicate->comparison = operators[i].comparison;
+      op_len = strlen(operators[i].op);
+      break;
+    }
+  }
+  if (!op_len) {
+    set_filter_error(error, error_size, "invalid operator in: %s", term);
+    return false;
+  }
+
+  const char* const value = op_start + op_len;
+  *op_start = '\0';
+
+  if (!parse_filter_path(predicate, term, error, error_size)) {
+    return false;
+  }
+
+  /* Constant, as every type it can be compared as */
+  char* end;
+  predicate->string = strdup(value);
+  FAIL_FAST_IF(!predicate->string);
+
+  errno = 0;
+  predicate->signed_value = strtoll(value, &end, 0);
+  predicate->is_signed = *value && !*end && errno == 0;
+  errno = 0;
+  predicate->unsigned_value = strtoull(value, &end, 0);
+  predicate->is_unsigned = *value && *value != '-' && !*end && errno == 0;
+  errno = 0;
+  predicate->real_value = strtod(value, &end);
+  predicate->is_real = *value && !*end && errno == 0;
+  return true;
+}
+
+/*
+ * Compiles `expression` (see event_filter). Returns NULL, describing why
+ * in `error`, if it is invalid.
+ */
+static event_filter* create_event_filter(const char* expression,
+                                         char* const error,
+                                         size_t const error_size) {
+  event_filter* const filter = (event_filter*)calloc(1, sizeof(event_filter));
+  FAIL_FAST_IF(!filter);
+  filter->expression = strdup(expression);
+  FAIL_FAST_IF(!filter->expression);
+
+  char term[1024];
+  while (next_filter_term(&expression, term, sizeof(term))) {
+    if (strncmp(term, "name:", 5) == 0) {
+      filter->names = push_filter_string(filter->names, &filter->name_count, term + 5);
+    } else if (strncmp(term, "trace:", 6) == 0) {
+      filter->traces = push_filter_string(filter->traces, &filter->trace_count, term + 6);
+    } else if (strncmp(term, "stream:", 7) == 0) {
+      char* end;
+      errno = 0;
+      uint64_t const id = strtoull(term + 7, &end, 0);
+      if (!term[7] || *end || errno) {
+        set_filter_error(error, error_size, "invalid stream ID: %s", term + 7);
+        destroy_event_filter(filter);
+        return NULL;
+      }
+
+      filter->streams =
+          (uint64_t*)realloc(filter->streams, (filter->stream_count + 1) * sizeof(uint64_t));
+      FAIL_FAST_IF(!filter->streams);
+      filter->streams[filter->stream_count++] = id;
+    } else {
+      filter->predicates = (filter_predicate*)realloc(
+          filter->predicates, (filter->predicate_count + 1) * sizeof(filter_predicate));
+      FAIL_FAST_IF(!filter->predicates);
+      filter_predicate* const predicate = &filter->predicates[filter->predicate_count++];
+      memset(predicate, 0, sizeof(*predicate));
+
+      if (!parse_filter_predicate(predicate, term, error, error_size)) {
+        destroy_event_filter(filter);
+        return NULL;
+      }
+    }
+  }
+
+  return filter;
+}
+
+static uint32_t filter_root_op(const event_decoder* const decoder, filter_root const root) {
+  switch (root) {
+    case FILTER_ROOT_PACKET_CONTEXT:
+      return decoder->packet_context;
+    case FILTER_ROOT_STREAM_EVENT_CONTEXT:
+      return decoder->common_context;
+    case FILTER_ROOT_EVENT_CONTEXT:
+      return decoder->specific_context;
+    case FILTER_ROOT_PAYLOAD:
+      break;
+  }
+  return decoder->payload;
+}
+
+/*
+ * Returns the op of the scalar field `predicate` is about within the
+ * layouts of `decoder`, or NO_FIELD_OP if there is no such field.
+ */
+static uint32_t resolve_filter_predicate(const event_decoder* const decoder,
+                                         const filter_predicate* const predicate) {
+  uint32_t op = filter_root_op(decoder, predicate->root);
+
+  for (uint32_t i = 0; i < predicate->path_len && op != NO_FIELD_OP; i++) {
+    uint32_t const parent = op;
+    op = NO_FIELD_OP;
+
+    if (decoder->ops[parent].type != BT_FIELD_CLASS_TYPE_STRUCTURE) {
+      break;
+    }
+    for (uint32_t member = parent + 1; member < decoder->ops[parent].end;
+         member = decoder->ops[member].end) {
+      if (strcmp(decoder->ops[member].name, predicate->path[i]) == 0) {
+        op = member;
+        break;
+      }
+    }
+  }
+
+  if (op != NO_FIELD_OP && (decoder->ops[op].type == BT_FIELD_CLASS_TYPE_STRUCTURE ||
+                            bt_field_class_type_is(decoder->ops[op].type,
+                                                   BT_FIELD_CLASS_TYPE_ARRAY))) {
+    return NO_FIELD_OP;
+  }
+  return op;
+}
+
+/*
+ * Decides what only depends on the event class of `decoder` for
+ * `filter`, unless it is already done.
+ */
+static void compile_event_filter(event_filter* const filter, event_decoder* const decoder) {
+  if (decoder->filter_generation == filter->generation) {
+    return;
+  }
+  decoder->filter_generation = filter->generation;
+  decoder->filter_rejects = filter->name_count > 0;
+
+  for (uint32_t i = 0; i < filter->name_count; i++) {
+    if (fnmatch(filter->names[i], decoder->name ? decoder->name : "", 0) == 0) {
+      decoder->filter_rejects = false;
+      break;
+    }
+  }
+
+  decoder->filter_leaves =
+      (uint32_t*)realloc(decoder->filter_leaves, (filter->predicate_count + 1) * sizeof(uint32_t));
+  FAIL_FAST_IF(!decoder->filter_leaves);
+
+  for (uint32_t i = 0; i < filter->predicate_count && !decoder->filter_rejects; i++) {
+    decoder->filter_leaves[i] = resolve_filter_predicate(decoder, &filter->predicates[i]);
+
+    /* Events without the field cannot satisfy the predicate */
+    decoder->filter_rejects = decoder->filter_leaves[i] == NO_FIELD_OP;
+  }
+}
+
+static const bt_field* borrow_filter_root(filter_root const root, const bt_event* const event) {
+  switch (root) {
+    case FILTER_ROOT_PACKET_CONTEXT: {
+      const bt_packet* const packet = bt_event_borrow_packet_const(event);
+      return packet ? bt_packet_borrow_context_field_const(packet) : NULL;
+    }
+    case FILTER_ROOT_STREAM_EVENT_CONTEXT:
+      return bt_event_borrow_common_context_field_const(event);
+    case FILTER_ROOT_EVENT_CONTEXT:
+      return bt_event_borrow_specific_context_field_const(event);
+    case FILTER_ROOT_PAYLOAD:
+      break;
+  }
+  return bt_event_borrow_payload_field_const(event);
+}
+
+/*
+ * Borrows the field of op `leaf` from `field`, the field of op `op`.
+ */
+static const bt_field* borrow_filter_field(const field_op* const ops,
+                                           uint32_t op,
+                                           uint32_t const leaf,
+                                           const bt_field* field) {
+  while (op != leaf && field) {
+    uint32_t member = op + 1;
+    while (!(member <= leaf && leaf < ops[member].end)) {
+      member = ops[member].end;
+    }
+    field = bt_field_structure_borrow_member_field_by_index_const(field, ops[member].index);
+    op = member;
+  }
+  return field;
+}
+
+static bool apply_filter_comparison(filter_comparison const comparison, int const order) {
+  switch (comparison) {
+    case FILTER_COMPARISON_EQ:
+      return order == 0;
+    case FILTER_COMPARISON_NE:
+      return order != 0;
+    case FILTER_COMPARISON_LT:
+      return order < 0;
+    case FILTER_COMPARISON_LE:
+      return order <= 0;
+    case FILTER_COMPARISON_GT:
+      return order > 0;
+    case FILTER_COMPARISON_GE:
+      return order >= 0;
+  }
+  return false;
+}
+
+#define FILTER_ORDER(a, b) ((a) < (b) ? -1 : (a) > (b) ? 1 : 0)
+
+static bool test_filter_predicate(const filter_predicate* const predicate,
+                                  bt_field_class_type const type,
+                                  const bt_field* const field) {
+  int order;
+
+  if (bt_field_class_type_is(type, BT_FIELD_CLASS_TYPE_UNSIGNED_INTEGER)) {
+    uint64_t const val = bt_field_integer_unsigned_get_value(field);
+    if (predicate->is_unsigned) {
+      order = FILTER_ORDER(val, predicate->unsigned_value);
+    } else if (predicate->is_signed) {
+      order = 1; /* Negative constant */
+    } else if (predicate->is_real) {
+      order = FILTER_ORDER((double)val, predicate->real_value);
+    } else {
+      return false;
+    }
+  } else if (bt_field_class_type_is(type, BT_FIELD_CLASS_TYPE_SIGNED_INTEGER)) {
+    int64_t const val = bt_field_integer_signed_get_value(field);
+    if (predicate->is_signed) {
+      order = FILTER_ORDER(val, predicate->signed_value);
+    } else if (predicate->is_unsigned) {
+      order = -1; /* Beyond INT64_MAX */
+    } else if (predicate->is_real) {
+      order = FILTER_ORDER((double)val, predicate->real_value);
+    } else {
+      return false;
+    }
+  } else if (bt_field_class_type_is(type, BT_FIELD_CLASS_TYPE_REAL)) {
+    if (!predicate->is_real) {
+      return false;
+    }
+    double const val = type == BT_FIELD_CLASS_TYPE_SINGLE_PRECISION_REAL
+                           ? bt_field_real_single_precision_get_value(field)
+                           : bt_field_real_double_precision_get_value(field);
+    order = FILTER_ORDER(val, predicate->real_value);
+  } else if (type == BT_FIELD_CLASS_TYPE_BOOL) {
+    int constant;
+    if (strcmp(predicate->string, "true") == 0) {
+      constant = 1;
+    } else if (strcmp(predicate->string, "false") == 0) {
+      constant = 0;
+    } else if (predicate->is_unsigned) {
+      constant = predicate->unsigned_value != 0;
+    } else {
+      return false;
+    }
+    order = FILTER_ORDER((int)bt_field_bool_get_value(field), constant);
+  } else if (type == BT_FIELD_CLASS_TYPE_STRING) {
+    order = strcmp(bt_field_string_get_value(field), predicate->string);
+  } else {
+    return false;
+  }
+
+  return apply_filter_comparison(predicate->comparison, order);
+}
+
+static bool filter_selects_trace(event_filter* const filter, const bt_trace* const trace) {
+  if (filter->trace_count == 0) {
+    return true;
+  }
+  if (trace == filter->last_trace) {
+    return filter->last_trace_selected;
+  }
+
+  const char* const name = bt_trace_get_name(trace);
+  forget_filter_trace(filter);
+  bt_trace_get_ref(trace);
+  filter->last_trace = trace;
+  filter->last_trace_selected = false;
+  for (uint32_t i = 0; i < filter->trace_count; i++) {
+    if (fnmatch(filter->traces[i], name ? name : "", 0) == 0) {
+      filter->last_trace_selected = true;
+      break;
+    }
+  }
+  return filter->last_trace_selected;
+}
+
+/*
+ * Returns whether `filter` selects `event`, of the class of `decoder`.
+ * Only the fields of the predicates are borrowed, and nothing is
+ * allocated once the class is compiled.
+ */
+static bool event_filter_accepts(event_filter* const filter,
+                                 event_decoder* const decoder,
+                                 const bt_event* const event) {
+  compile_event_filter(filter, decoder);
+  if (decoder->filter_rejects) {
+    return false;
+  }
+
+  if (filter->stream_count || filter->trace_count) {
+    const bt_stream* const stream = bt_event_borrow_stream_const(event);
+
+    bool selected = filter->stream_count == 0;
+    for (uint32_t i = 0; i < filter->stream_count && !selected; i++) {
+      selected = bt_stream_get_id(stream) == filter->streams[i];
+    }
+    if (!selected || !filter_selects_trace(filter, bt_stream_borrow_trace_const(stream))) {
+      return false;
+    }
+  }
+
+  for (uint32_t i = 0; i < filter->predicate_count; i++) {
+    const filter_predicate* const predicate = &filter->predicates[i];
+    uint32_t const leaf = decoder->filter_leaves[i];
+    const bt_field* const field =
+        borrow_filter_field(decoder->ops, filter_root_op(decoder, predicate->root), leaf,
+                            borrow_filter_root(predicate->root, event));
+
+    if (!field || !test_filter_predicate(predicate, decoder->ops[leaf].type, field)) {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "event_batch.h"
+#include "fail_fast_if.h"
+#include "ingest.h"
+
+/*
+ * Most vectors handed to a single writev() call, IOV_MAX being at least
+ * this on the platforms we run on.
+ */
+#define EVENT_OUTPUT_MAX_IOV 1024
+
+/*
+ * Headless destination of the rendered events: the standard output, a
+ * file or a Unix socket.
+ *
+ * OUTPUT_FORMAT_JSON records are written one per line (NDJSON), and
+ * OUTPUT_FORMAT_BINARY records as they are, each one being framed by its
+ * size already (see output_format). Every batch is written with as few
+ * writev() calls as possible, straight from its arena.
+ *
+ * Events only carry the id of their trace: the record of a trace (see
+ * write_trace_info()) is written once, before its first event.
+ *
+ * A file is rotated once it would grow past `rotate_bytes`, unless zero:
+ * it is renamed to `path.N`, N being one more than the last rotated
+ * file, and a new one is started at `path`.
+ */
+typedef struct event_output {
+  int fd;
+  output_format format;
+
+  char* path; /* NULL unless writing to a file */
+  uint64_t rotate_bytes;
+  uint64_t file_bytes;
+  uint64_t rotation; /* N of the last rotated file */
+
+  struct iovec* iov;
+  uint64_t iov_capacity;
+
+  /* Trace records written so far, and where they are rendered */
+  uint32_t trace_count;
+  byte_buffer trace_records;
+} event_output;
+
+static void set_output_error(char* const error, size_t const error_size, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(error, error_size, format, args);
+  va_end(args);
+}
+
+static int open_output_file(const char* const path) {
+  return open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+static int connect_output_socket(const char* const path) {
+  struct sockaddr_un address;
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  int const fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+    int const connect_errno = errno;
+    close(fd);
+    errno = connect_errno;
+    return -1;
+  }
+  return fd;
+}
+
+static void destroy_event_output(event_output* const output) {
+  if (!output) {
+    return;
+  }
+
+  if (output->fd > STDERR_FILENO) {
+    close(output->fd);
+  }
+  free(output->path);
+  free(output->iov);
+  byte_buffer_destroy(&output->trace_records);
+  free(output);
+}
+
+/*
+ * Opens `target`: "-" for the standard output, "unix:PATH" for the Unix
+ * stream socket at PATH, or the path of a file to append to, rotated
+ * every `rotate_bytes` if not zero. Returns NULL, describing why in
+ * `error`, if it cannot be opened.
+ */
+static event_output* create_event_output(const char* const target,
+                                         output_format const format,
+                                         uint64_t const rotate_bytes,
+                                         char* const error,
+                                         size_t const error_size) {
+  event_output* const output = (event_output*)calloc(1, sizeof(event_output));
+  FAIL_FAST_IF(!output);
+  output->format = format;
+
+  if (strcmp(target, "-") == 0) {
+    output->fd = STDOUT_FILENO;
+    return output;
+  }
+
+  if (strncmp(target, "unix:", 5) == 0) {
+    output->fd = connect_output_socket(target + 5);
+    if (output->fd < 0) {
+      set_output_error(error, error_size, "cannot connect to %s: %s", target + 5, strerror(errno));
+      destroy_event_output(output);
+      return NULL;
+    }
+    return output;
+  }
+
+  output->path = strdup(target);
+  FAIL_FAST_IF(!output->path);
+  output->rotate_bytes = rotate_bytes;
+
+  output->fd = open_output_file(target);
+  struct stat file_stat;
+  if (output->fd < 0 || fstat(output->fd, &file_stat) != 0) {
+    set_output_error(error, error_size, "cannot open %s: %s", target, strerror(errno));
+    destroy_event_output(output);
+    return NULL;
+  }
+  output->file_bytes = (uint64_t)file_stat.st_size;
+
+  /* Do not overwrite the files rotated by a previous run */
+  char rotated[PATH_MAX];
+  for (;;) {
+    snprintf(rotated, sizeof(rotated), "%s.%" PRIu64, target, output->rotation + 1);
+    if (access(rotated, F_OK) != 0) {
+      break;
+    }
+    output->rotation++;
+  }
+  return output;
+}
+
+/*
+ * Renames the current file to the next `path.N` and starts a new one.
+ */
+static bool rotate_event_output(event_output* const output) {
+  char rotated[PATH_MAX];
+  snprintf(rotated, sizeof(rotated), "%s.%" PRIu64, output->path, output->rotation + 1);
+
+  close(output->fd);
+  output->fd = -1;
+  if (rename(output->path, rotated) != 0) {
+    return false;
+  }
+  output->rotation++;
+
+  output->fd = open_output_file(output->path);
+  output->file_bytes = 0;
+  /* Make each file readable on its own */
+  output->trace_count = 0;
+  return output->fd >= 0;
+}
+
+/*
+ * Writes all of the `count` vectors of `iov`, which it consumes, resuming
+ * after partial writes.
+ */
+static bool write_all_iov(int const fd, struct iovec* iov, uint64_t count) {
+  while (count > 0) {
+    int const chunk = count < EVENT_OUTPUT_MAX_IOV ? (int)count : EVENT_OUTPUT_MAX_IOV;
+    ssize_t written = writev(fd, iov, chunk);
+
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+
+    while (count > 0 && (size_t)written >= iov->iov_len) {
+      written -= (ssize_t)iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + written;
+      iov->iov_len -= (size_t)written;
+    }
+  }
+  return true;
+}
+
+/*
+ * Writes the records of the traces of `registry` not written yet.
+ * Returns false if the output failed.
+ */
+static bool write_new_traces(event_output* const output, trace_registry* const registry) {
+  uint32_t const count = trace_registry_count(registry);
+  if (output->trace_count == count) {
+    return true;
+  }
+
+  event_writer writer;
+  output->trace_records.size = 0;
+  event_writer_init(&writer, &output->trace_records, output->format);
+  for (uint32_t id = output->trace_count; id < count; id++) {
+    write_trace_info(&writer, trace_registry_get(registry, id));
+    if (output->format == OUTPUT_FORMAT_JSON) {
+      byte_buffer_append_char(&output->trace_records, '\n');
+    }
+  }
+
+  struct iovec records = {output->trace_records.data, output->trace_records.size};
+  if (!write_all_iov(output->fd, &records, 1)) {
+    return false;
+  }
+  output->file_bytes += output->trace_records.size;
+  output->trace_count = count;
+  return true;
+}
+
+/*
+ * Writes the records of `batch`, preceded by the records of the traces
+ * of `registry` not written yet. Returns false if the output failed.
+ */
+static bool write_event_batch(event_output* const output,
+                              trace_registry* const registry,
+                              const event_batch* const batch) {
+  static char newline = '\n';
+  uint64_t const bytes =
+      batch->arena.size + (output->format == OUTPUT_FORMAT_JSON ? batch->count : 0);
+
+  if (output->path && output->rotate_bytes && output->file_bytes > 0 &&
+      output->file_bytes + bytes > output->rotate_bytes && !rotate_event_output(output)) {
+    return false;
+  }
+  if (!write_new_traces(output, registry)) {
+    return false;
+  }
+
+  uint64_t iov_count = 0;
+  if (output->format == OUTPUT_FORMAT_BINARY) {
+    /* The records are back to back in the arena, each one framed by its size */
+    struct iovec whole = {batch->arena.data, batch->arena.size};
+    if (!write_all_iov(output->fd, &whole, 1)) {
+      return false;
+    }
+  } else {
+    if (output->iov_capacity < batch->count * 2) {
+      output->iov_capacity = batch->count * 2;
+      output->iov =
+          (struct iovec*)realloc(output->iov, output->iov_capacity * sizeof(struct iovec));
+      FAIL_FAST_IF(!output->iov);
+    }
+
+    for (uint64_t i = 0; i < batch->count; i++) {
+      const event_record* const record = &batch->records[i];
+
+      output->iov[iov_count].iov_base = batch->arena.data + record->offset;
+      output->iov[iov_count++].iov_len = record->length;
+      output->iov[iov_count].iov_base = &newline;
+      output->iov[iov_count++].iov_len = 1;
+    }
+    if (!write_all_iov(output->fd, output->iov, iov_count)) {
+      return false;
+    }
+  }
+
+  output->file_bytes += bytes;
+  return true;
+}
+
+/*
+ * Writes every batch `ingest` publishes to `output` until the ingestion
+ * ends. Returns false if the output failed.
+ */
+static bool run_event_output(ingest* const ingest, event_output* const output) {
+  while (ingest_wait(ingest)) {
+    for (event_batch* batch = ingest_pop(ingest); batch; batch = ingest_pop(ingest)) {
+      bool const written = write_event_batch(output, &ingest->traces, batch);
+      release_batch(batch);
+      if (!written) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,557 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <babeltrace2/babeltrace.h>
+
+#include "decoder_cache.h"
+#include "event_filter.h"
+#include "fail_fast_if.h"
+#include "pipeline_metrics.h"
+
+/*
+ * Most rows (event name, trace and stream) and histograms (event name
+ * and field) of an event_stats: past them, events are only counted in
+ * `other_events` and values are not recorded. The memory of the stats
+ * is bounded whatever the trace.
+ */
+#define EVENT_STATS_MAX_ROWS 1024
+#define EVENT_STATS_MAX_HISTOGRAMS 256
+
+/*
+ * Most fields to keep histograms of.
+ */
+#define EVENT_STATS_MAX_FIELDS 8
+
+/*
+ * Seconds of events counted per row, one slot per second, which bounds
+ * the longest rate window.
+ */
+#define EVENT_STATS_SECONDS 64
+
+/*
+ * Number of windows the rates are computed over: the last 1, 10 and 60
+ * seconds of the trace (see event_stats_windows).
+ */
+#define EVENT_STATS_WINDOW_COUNT 3
+
+static const int64_t event_stats_windows[EVENT_STATS_WINDOW_COUNT] = {1, 10, 60};
+
+/*
+ * Number of buckets of a value_histogram: the values below
+ * 2 * VALUE_HISTOGRAM_SUB_BUCKETS have a bucket each, and each larger
+ * power of two range is split into VALUE_HISTOGRAM_SUB_BUCKETS buckets.
+ */
+#define VALUE_HISTOGRAM_SUB_BITS 3
+#define VALUE_HISTOGRAM_SUB_BUCKETS (1 << VALUE_HISTOGRAM_SUB_BITS)
+#define VALUE_HISTOGRAM_BUCKETS ((64 - VALUE_HISTOGRAM_SUB_BITS + 1) * VALUE_HISTOGRAM_SUB_BUCKETS)
+
+/*
+ * Histogram of 64-bit values in the manner of HdrHistogram: the bucket
+ * of a value is within 1 / VALUE_HISTOGRAM_SUB_BUCKETS of it, whatever
+ * its magnitude, in a fixed amount of memory.
+ *
+ * Like a metrics_histogram, it is written by a single thread and read by
+ * any other, and histograms merge by adding their buckets.
+ */
+typedef struct value_histogram {
+  uint64_t buckets[VALUE_HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+} value_histogram;
+
+static uint32_t value_histogram_bucket(uint64_t const value) {
+  if (value < 2 * VALUE_HISTOGRAM_SUB_BUCKETS) {
+    return (uint32_t)value;
+  }
+
+  uint32_t const exponent = 63 - (uint32_t)__builtin_clzll(value);
+  uint32_t const sub = (uint32_t)(value >> (exponent - VALUE_HISTOGRAM_SUB_BITS)) &
+                       (VALUE_HISTOGRAM_SUB_BUCKETS - 1);
+  return (exponent - VALUE_HISTOGRAM_SUB_BITS + 1) * VALUE_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+/*
+ * Returns the largest value of the bucket `bucket`.
+ */
+static uint64_t value_histogram_bucket_max(uint32_t const bucket) {
+  if (bucket < 2 * VALUE_HISTOGRAM_SUB_BUCKETS) {
+    return bucket;
+  }
+
+  uint32_t const exponent = bucket / VALUE_HISTOGRAM_SUB_BUCKETS + VALUE_HISTOGRAM_SUB_BITS - 1;
+  uint64_t const width = UINT64_C(1) << (exponent - VALUE_HISTOGRAM_SUB_BITS);
+  /* Wraps around to UINT64_MAX for the last bucket */
+  return (VALUE_HISTOGRAM_SUB_BUCKETS + bucket % VALUE_HISTOGRAM_SUB_BUCKETS) * width + width - 1;
+}
+
+/*
+ * Records `value`. Single writer only.
+ */
+static void value_histogram_record(value_histogram* const histogram, uint64_t const value) {
+  metrics_add(&histogram->buckets[value_histogram_bucket(value)], 1);
+  metrics_add(&histogram->count, 1);
+  metrics_add(&histogram->sum, value);
+  if (value > __atomic_load_n(&histogram->max, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&histogram->max, value, __ATOMIC_RELAXED);
+  }
+}
+
+/*
+ * Adds what `from`, written by another thread, recorded so far to `to`.
+ */
+static void value_histogram_merge(value_histogram* const to, const value_histogram* const from) {
+  for (uint32_t i = 0; i < VALUE_HISTOGRAM_BUCKETS; i++) {
+    to->buckets[i] += __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+  }
+  to->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+  to->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+
+  uint64_t const max = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+  if (max > to->max) {
+    to->max = max;
+  }
+}
+
+/*
+ * Returns the upper bound of the bucket of the quantile `q`, at most the
+ * largest value recorded.
+ */
+static uint64_t value_histogram_quantile(const value_histogram* const histogram, double const q) {
+  uint64_t const rank = (uint64_t)(q * (double)histogram->count);
+  uint64_t seen = 0;
+
+  for (uint32_t i = 0; i < VALUE_HISTOGRAM_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen > rank) {
+      uint64_t const bound = value_histogram_bucket_max(i);
+      return bound < histogram->max ? bound : histogram->max;
+    }
+  }
+  return histogram->max;
+}
+
+/*
+ * The events of one name in one stream of one trace.
+ *
+ * `seconds` counts the events of the last EVENT_STATS_SECONDS seconds
+ * up to `last_second`, the slot of second S being S modulo
+ * EVENT_STATS_SECONDS. The slots of the seconds skipped without events
+ * are cleared when `last_second` moves past them.
+ */
+typedef struct event_stats_row {
+  const char* name; /* Interned by the decoder cache */
+  uint32_t trace_id;
+  uint64_t stream_id;
+  int64_t cpu_id; /* -1 if the packets have no `cpu_id` */
+  uint64_t count;
+  int64_t last_second;
+  uint32_t seconds[EVENT_STATS_SECONDS];
+} event_stats_row;
+
+typedef struct event_stats_histogram {
+  const char* name; /* Interned by the decoder cache */
+  uint32_t field;   /* Index within the fields of the stats */
+  value_histogram values;
+} event_stats_histogram;
+
+/*
+ * Counters of the events a trace processing graph reads, kept while
+ * handling the messages, before any rendering or filtering: the number
+ * of events of each name per stream, their rate over the last seconds
+ * of the trace, and histograms of the integer `fields` of the events.
+ *
+ * Time is the one of the trace, from the timestamps of the events, so
+ * that the rates of a trace directory read as fast as possible are the
+ * ones it was recorded at.
+ *
+ * Written by the thread running the graph only, and read by any other:
+ * rows and histograms are only ever appended, each one being complete
+ * before `row_count` (or `histogram_count`) covers it. Their storage is
+ * allocated with the first event, at its maximum size.
+ */
+typedef struct event_stats {
+  /* Fields to keep histograms of, as parsed and as written */
+  filter_predicate fields[EVENT_STATS_MAX_FIELDS];
+  char* field_paths[EVENT_STATS_MAX_FIELDS];
+  uint32_t field_count;
+
+  /* Whether the events are only counted, not rendered, read by the writer */
+  bool count_only;
+
+  event_stats_row* rows;
+  uint32_t row_count;
+  uint32_t* row_slots; /* Open addressing, UINT32_MAX when free, writer only */
+  uint64_t other_events;
+
+  event_stats_histogram* histograms;
+  uint32_t histogram_count;
+
+  /* Seconds of the first and latest events */
+  int64_t first_second;
+  int64_t now_second;
+} event_stats;
+
+/*
+ * The counters of a row of an event_stats at the latest second of the
+ * trace, as returned to the UI.
+ */
+typedef struct event_stats_sample {
+  const char* name;
+  uint32_t trace_id;
+  uint64_t stream_id;
+  int64_t cpu_id;
+  uint64_t count;
+  double rates[EVENT_STATS_WINDOW_COUNT]; /* Events per second, see event_stats_windows */
+} event_stats_sample;
+
+/*
+ * The histogram of a field of the events of a name, as returned to the
+ * UI.
+ */
+typedef struct event_stats_field_sample {
+  const char* name;
+  const char* field; /* As written */
+  uint64_t count;
+  uint64_t sum;
+  uint64_t max;
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+} event_stats_field_sample;
+
+static void destroy_event_stats(event_stats* const stats) {
+  for (uint32_t i = 0; i < stats->field_count; i++) {
+    for (uint32_t j = 0; j < stats->fields[i].path_len; j++) {
+      free(stats->fields[i].path[j]);
+    }
+    free(stats->field_paths[i]);
+  }
+  free(stats->rows);
+  free(stats->row_slots);
+  free(stats->histograms);
+  memset(stats, 0, sizeof(*stats));
+}
+
+/*
+ * Keeps histograms of the fields of `paths`, separated by commas or
+ * whitespace, each one being a field path as in an event filter (e.g.
+ * `len` or `packet_context.cpu_id`). Returns false, describing why in
+ * `error`, if `paths` is invalid. Must be called before the first event.
+ */
+static bool set_event_stats_fields(event_stats* const stats,
+                                   const char* const paths,
+                                   char* const error,
+                                   size_t const error_size) {
+  char* const copy = strdup(paths);
+  FAIL_FAST_IF(!copy);
+  char* save = NULL;
+  bool valid = true;
+
+  for (char* path = strtok_r(copy, ", \t", &save); path && valid;
+       path = strtok_r(NULL, ", \t", &save)) {
+    if (stats->field_count == EVENT_STATS_MAX_FIELDS) {
+      set_filter_error(error, error_size, "more than %d fields", EVENT_STATS_MAX_FIELDS);
+      valid = false;
+      break;
+    }
+
+    uint32_t const field = stats->field_count++;
+    stats->field_paths[field] = strdup(path);
+    FAIL_FAST_IF(!stats->field_paths[field]);
+
+    /* parse_filter_path() tokenizes the path in place: give it its own copy */
+    char* const tokens = strdup(path);
+    FAIL_FAST_IF(!tokens);
+    valid = parse_filter_path(&stats->fields[field], tokens, error, error_size);
+    free(tokens);
+  }
+
+  free(copy);
+  return valid;
+}
+
+static int64_t floor_second(int64_t const ns) {
+  int64_t const second = ns / 1000000000;
+  return ns % 1000000000 < 0 ? second - 1 : second;
+}
+
+static void alloc_event_stats(event_stats* const stats) {
+  stats->rows = (event_stats_row*)calloc(EVENT_STATS_MAX_ROWS, sizeof(event_stats_row));
+  FAIL_FAST_IF(!stats->rows);
+  stats->row_slots = (uint32_t*)malloc(2 * EVENT_STATS_MAX_ROWS * sizeof(uint32_t));
+  FAIL_FAST_IF(!stats->row_slots);
+  memset(stats->row_slots, 0xff, 2 * EVENT_STATS_MAX_ROWS * sizeof(uint32_t));
+
+  if (stats->field_count > 0) {
+    stats->histograms = (event_stats_histogram*)calloc(EVENT_STATS_MAX_HISTOGRAMS,
+                                                       sizeof(event_stats_histogram));
+    FAIL_FAST_IF(!stats->histograms);
+  }
+}
+
+/*
+ * Returns the CPU of the packets of `event`, or -1 if they have none.
+ */
+static int64_t event_stats_cpu_id(const event_decoder* const decoder, const bt_event* const event) {
+  filter_predicate cpu_id;
+  memset(&cpu_id, 0, sizeof(cpu_id));
+  cpu_id.root = FILTER_ROOT_PACKET_CONTEXT;
+  cpu_id.path[0] = (char*)"cpu_id";
+  cpu_id.path_len = 1;
+
+  uint32_t const leaf = resolve_filter_predicate(decoder, &cpu_id);
+  if (leaf == NO_FIELD_OP ||
+      !bt_field_class_type_is(decoder->ops[leaf].type, BT_FIELD_CLASS_TYPE_UNSIGNED_INTEGER)) {
+    return -1;
+  }
+
+  const bt_field* const field =
+      borrow_filter_field(decoder->ops, decoder->packet_context, leaf,
+                          borrow_filter_root(FILTER_ROOT_PACKET_CONTEXT, event));
+  return field ? (int64_t)bt_field_integer_unsigned_get_value(field) : -1;
+}
+
+/*
+ * Returns the row of the events named `decoder->name` of the stream
+ * `stream_id` of the trace `trace_id`, adding it if needed, or NULL if
+ * there is no room left.
+ */
+static event_stats_row* event_stats_row_of(event_stats* const stats,
+                                           const event_decoder* const decoder,
+                                           const bt_event* const event,
+                                           uint32_t const trace_id,
+                                           uint64_t const stream_id,
+                                           int64_t const second) {
+  uint64_t const mask = 2 * EVENT_STATS_MAX_ROWS - 1;
+  uint64_t slot = (hash_pointer(decoder->name) ^ (trace_id * UINT64_C(0xff51afd7ed558ccd)) ^
+                   (stream_id * UINT64_C(0xc4ceb9fe1a85ec53))) &
+                  mask;
+
+  for (; stats->row_slots[slot] != UINT32_MAX; slot = (slot + 1) & mask) {
+    event_stats_row* const row = &stats->rows[stats->row_slots[slot]];
+    if (row->name == decoder->name && row->trace_id == trace_id && row->stream_id == stream_id) {
+      return row;
+    }
+  }
+
+  if (stats->row_count == EVENT_STATS_MAX_ROWS) {
+    return NULL;
+  }
+
+  event_stats_row* const row = &stats->rows[stats->row_count];
+  row->name = decoder->name;
+  row->trace_id = trace_id;
+  row->stream_id = stream_id;
+  row->cpu_id = event_stats_cpu_id(decoder, event);
+  row->last_second = second;
+  stats->row_slots[slot] = stats->row_count;
+  __atomic_store_n(&stats->row_count, stats->row_count + 1, __ATOMIC_RELEASE);
+  return row;
+}
+
+/*
+ * Returns the histogram of the field `field` of the events named `name`,
+ * adding it if needed, or UINT32_MAX if there is no room left.
+ */
+static uint32_t event_stats_histogram_of(event_stats* const stats,
+                                         const char* const name,
+                                         uint32_t const field) {
+  for (uint32_t i = 0; i < stats->histogram_count; i++) {
+    if (stats->histograms[i].name == name && stats->histograms[i].field == field) {
+      return i;
+    }
+  }
+
+  if (stats->histogram_count == EVENT_STATS_MAX_HISTOGRAMS) {
+    return UINT32_MAX;
+  }
+  stats->histograms[stats->histogram_count].name = name;
+  stats->histograms[stats->histogram_count].field = field;
+  __atomic_store_n(&stats->histogram_count, stats->histogram_count + 1, __ATOMIC_RELEASE);
+  return stats->histogram_count - 1;
+}
+
+/*
+ * Finds, once per event class, the integer fields of `stats` within the
+ * layouts of `decoder` and their histograms.
+ */
+static void compile_event_stats(event_stats* const stats, event_decoder* const decoder) {
+  decoder->stats_compiled = true;
+  if (stats->field_count == 0) {
+    return;
+  }
+
+  decoder->stats_leaves = (uint32_t*)malloc(2 * stats->field_count * sizeof(uint32_t));
+  FAIL_FAST_IF(!decoder->stats_leaves);
+
+  for (uint32_t i = 0; i < stats->field_count; i++) {
+    uint32_t leaf = resolve_filter_predicate(decoder, &stats->fields[i]);
+    if (leaf != NO_FIELD_OP &&
+        !bt_field_class_type_is(decoder->ops[leaf].type, BT_FIELD_CLASS_TYPE_INTEGER)) {
+      leaf = NO_FIELD_OP;
+    }
+
+    decoder->stats_leaves[i] = leaf;
+    decoder->stats_leaves[stats->field_count + i] =
+        leaf == NO_FIELD_OP ? UINT32_MAX : event_stats_histogram_of(stats, decoder->name, i);
+  }
+}
+
+/*
+ * Counts `event`, of the class of `decoder`, timestamped `timestamp_ns`,
+ * in the stream `stream_id` of the trace `trace_id`, and records the
+ * values of its histogram fields. Negative values are recorded as 0.
+ */
+static void event_stats_count(event_stats* const stats,
+                              event_decoder* const decoder,
+                              const bt_event* const event,
+                              uint32_t const trace_id,
+                              uint64_t const stream_id,
+                              int64_t const timestamp_ns) {
+  int64_t const second = floor_second(timestamp_ns);
+
+  if (!stats->rows) {
+    alloc_event_stats(stats);
+    stats->first_second = second;
+    stats->now_second = second;
+  }
+  if (second > stats->now_second) {
+    __atomic_store_n(&stats->now_second, second, __ATOMIC_RELAXED);
+  }
+
+  event_stats_row* const row =
+      event_stats_row_of(stats, decoder, event, trace_id, stream_id, second);
+  if (!row) {
+    metrics_add(&stats->other_events, 1);
+  } else {
+    if (second > row->last_second) {
+      /* Clear the slots of the seconds without events, at most all of them */
+      int64_t const first_cleared = second - row->last_second > EVENT_STATS_SECONDS
+                                        ? second - EVENT_STATS_SECONDS + 1
+                                        : row->last_second + 1;
+      for (int64_t s = first_cleared; s <= second; s++) {
+        __atomic_store_n(&row->seconds[(uint64_t)s % EVENT_STATS_SECONDS], 0, __ATOMIC_RELAXED);
+      }
+      __atomic_store_n(&row->last_second, second, __ATOMIC_RELAXED);
+    }
+    if (second > row->last_second - EVENT_STATS_SECONDS) {
+      uint32_t* const slot = &row->seconds[(uint64_t)second % EVENT_STATS_SECONDS];
+      __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    }
+    metrics_add(&row->count, 1);
+  }
+
+  if (stats->field_count == 0) {
+    return;
+  }
+  if (!decoder->stats_compiled) {
+    compile_event_stats(stats, decoder);
+  }
+
+  for (uint32_t i = 0; i < stats->field_count; i++) {
+    uint32_t const leaf = decoder->stats_leaves[i];
+    uint32_t const histogram = decoder->stats_leaves[stats->field_count + i];
+    if (leaf == NO_FIELD_OP || histogram == UINT32_MAX) {
+      continue;
+    }
+
+    filter_root const root = stats->fields[i].root;
+    const bt_field* const field = borrow_filter_field(
+        decoder->ops, filter_root_op(decoder, root), leaf, borrow_filter_root(root, event));
+    if (!field) {
+      continue;
+    }
+
+    uint64_t value;
+    if (bt_field_class_type_is(decoder->ops[leaf].type, BT_FIELD_CLASS_TYPE_UNSIGNED_INTEGER)) {
+      value = bt_field_integer_unsigned_get_value(field);
+    } else {
+      int64_t const signed_value = bt_field_integer_signed_get_value(field);
+      value = signed_value < 0 ? 0 : (uint64_t)signed_value;
+    }
+    value_histogram_record(&stats->histograms[histogram].values, value);
+  }
+}
+
+/*
+ * Writes the samples of the rows of `stats`, written by another thread,
+ * to `samples`, up to `capacity` of them, and returns the number of
+ * rows, which may be more.
+ *
+ * The rates are over the last complete seconds, up to the second of the
+ * latest event of `stats`, and over fewer seconds than their window
+ * while the trace is not that long yet.
+ */
+static uint64_t sample_event_stats(const event_stats* const stats,
+                                   event_stats_sample* const samples,
+                                   uint64_t const capacity) {
+  uint32_t const row_count = __atomic_load_n(&stats->row_count, __ATOMIC_ACQUIRE);
+  int64_t const now = __atomic_load_n(&stats->now_second, __ATOMIC_RELAXED);
+
+  for (uint32_t i = 0; i < row_count && i < capacity; i++) {
+    const event_stats_row* const row = &stats->rows[i];
+    event_stats_sample* const sample = &samples[i];
+    int64_t const last = __atomic_load_n(&row->last_second, __ATOMIC_RELAXED);
+
+    sample->name = row->name;
+    sample->trace_id = row->trace_id;
+    sample->stream_id = row->stream_id;
+    sample->cpu_id = row->cpu_id;
+    sample->count = __atomic_load_n(&row->count, __ATOMIC_RELAXED);
+
+    for (uint32_t w = 0; w < EVENT_STATS_WINDOW_COUNT; w++) {
+      int64_t seconds = event_stats_windows[w];
+      if (seconds > now - stats->first_second) {
+        seconds = now - stats->first_second;
+      }
+
+      uint64_t events = 0;
+      for (int64_t s = now - seconds; s < now; s++) {
+        if (s <= last && s > last - EVENT_STATS_SECONDS) {
+          events += __atomic_load_n(&row->seconds[(uint64_t)s % EVENT_STATS_SECONDS],
+                                    __ATOMIC_RELAXED);
+        }
+      }
+      sample->rates[w] = seconds > 0 ? (double)events / (double)seconds : 0;
+    }
+  }
+  return row_count;
+}
+
+/*
+ * Adds the histograms of `stats`, written by another thread, to the
+ * `*count` histograms of `merged`, matching them by event name and field
+ * and adding the ones missing while there are fewer than `capacity`.
+ */
+static void merge_event_stats_histograms(const event_stats* const stats,
+                                         event_stats_histogram* const merged,
+                                         uint64_t* const count,
+                                         uint64_t const capacity) {
+  uint32_t const histogram_count = __atomic_load_n(&stats->histogram_count, __ATOMIC_ACQUIRE);
+
+  for (uint32_t i = 0; i < histogram_count; i++) {
+    const event_stats_histogram* const histogram = &stats->histograms[i];
+
+    /* Names are interned by each graph: the same name may be another copy */
+    uint64_t j = 0;
+    while (j < *count && (merged[j].field != histogram->field ||
+                          strcmp(merged[j].name, histogram->name) != 0)) {
+      j++;
+    }
+    if (j == *count) {
+      if (*count == capacity) {
+        continue;
+      }
+      memset(&merged[j], 0, sizeof(merged[j]));
+      merged[j].name = histogram->name;
+      merged[j].field = histogram->field;
+      (*count)++;
+    }
+    value_histogram_merge(&merged[j].values, &histogram->values);
+  }
+}
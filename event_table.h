@@ -0,0 +1,1387 @@
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <babeltrace2/babeltrace.h>
+
+#include "decoder_cache.h"
+#include "event_filter.h"
+#include "event_writer.h"
+#include "fail_fast_if.h"
+#include "trace_registry.h"
+
+/*
+ * Most columns of an event class, and most fields projected by an
+ * export: past them, fields are left out.
+ */
+#define EVENT_TABLE_MAX_COLUMNS 64
+#define EVENT_TABLE_MAX_EXPORT_FIELDS 64
+
+/*
+ * Most bytes of distinct strings an event_table keeps: past them, the
+ * strings no retained event refers to anymore are dropped, and new
+ * strings are kept as EVENT_TABLE_NO_STRING, exported as empty, if that
+ * is not enough (see event_table_intern()).
+ */
+#define EVENT_TABLE_MAX_STRING_BYTES (64 << 20)
+#define EVENT_TABLE_NO_STRING UINT32_MAX
+
+/*
+ * Bytes buffered before being written to an export file.
+ */
+#define EVENT_TABLE_EXPORT_BUFFER_SIZE (1 << 20)
+
+/*
+ * Type of the values of a column, as written to binary exports too.
+ */
+typedef enum table_column_type {
+  TABLE_COLUMN_SIGNED = 0,   /* Signed integers, enumerations and booleans */
+  TABLE_COLUMN_UNSIGNED = 1, /* Unsigned integers, enumerations and bit arrays */
+  TABLE_COLUMN_REAL = 2,
+  TABLE_COLUMN_STRING = 3,
+} table_column_type;
+
+typedef enum table_export_format {
+  TABLE_EXPORT_CSV = 0,
+  TABLE_EXPORT_BINARY = 1,
+} table_export_format;
+
+/*
+ * The values of one field of the events of an event class, one per row.
+ */
+typedef struct table_column {
+  char* path; /* From the root, as in an event filter: e.g. `payload.prev_tid` */
+  table_column_type type;
+  union {
+    int64_t* ints; /* SIGNED, and UNSIGNED as their bits */
+    double* reals;
+    uint32_t* strings; /* Ids within the strings of the table */
+  } values;
+} table_column;
+
+/*
+ * The fields of the retained events of one event class: its rows are
+ * the ones of its events in the shared columns, in the same order.
+ *
+ * Rows are appended at `head + count` and evicted at `head`: once the
+ * columns are full, the retained rows are moved back to the start of
+ * the columns if at least half of them is evicted, and the columns are
+ * grown otherwise.
+ */
+typedef struct table_class {
+  const char* name; /* Interned by the decoder cache */
+  table_column* columns;
+  uint32_t column_count;
+  uint64_t head;
+  uint64_t count;
+  uint64_t capacity;
+} table_class;
+
+/*
+ * The most recent events a trace processing graph reads, stored by
+ * column instead of rendered: a few bytes per field instead of the
+ * rendering of the whole event, and fields which can be projected and
+ * exported as they are.
+ *
+ * The shared columns hold the time, stream, trace and class of the last
+ * `max_events` events, as a ring. The scalar fields of the contexts and
+ * payload of each event class, reached through structures only, get a
+ * typed column each (see table_class), and strings are interned in the
+ * table. Packet contexts are left out: their fields are the same for
+ * all the events of a packet.
+ *
+ * Written by the thread running the graph, which holds `lock` while
+ * handling a batch, and copied out by any other thread holding it to be
+ * exported (see export_event_tables()).
+ */
+typedef struct event_table {
+  uint64_t max_events; /* 0: the events are not stored */
+  pthread_mutex_t lock;
+
+  int64_t* timestamps;
+  uint64_t* stream_ids;
+  uint32_t* trace_ids;
+  uint32_t* classes;
+  uint64_t start; /* Row of the oldest event */
+  uint64_t count;
+
+  table_class* class_list;
+  uint32_t class_count;
+  uint32_t class_capacity;
+
+  /* Distinct strings, NUL-terminated within `string_data` at their offset */
+  char* string_data;
+  uint64_t string_bytes;
+  uint64_t string_capacity;
+  uint64_t* string_offsets;
+  uint32_t string_count;
+  uint32_t offset_capacity;
+  uint32_t* string_slots; /* Open addressing, ids or EVENT_TABLE_NO_STRING */
+  uint64_t slot_capacity;
+  uint64_t rows_since_compaction; /* Events appended since the strings were compacted */
+  uint64_t dropped_strings;       /* Kept as EVENT_TABLE_NO_STRING for lack of room */
+} event_table;
+
+static void init_event_table(event_table* const table) {
+  pthread_mutex_init(&table->lock, NULL);
+}
+
+static void destroy_event_table(event_table* const table) {
+  for (uint32_t i = 0; i < table->class_count; i++) {
+    table_class* const class = &table->class_list[i];
+    for (uint32_t j = 0; j < class->column_count; j++) {
+      free(class->columns[j].path);
+      free(class->columns[j].values.ints);
+    }
+    free(class->columns);
+  }
+  free(table->class_list);
+  free(table->timestamps);
+  free(table->stream_ids);
+  free(table->trace_ids);
+  free(table->classes);
+  free(table->string_data);
+  free(table->string_offsets);
+  free(table->string_slots);
+  pthread_mutex_destroy(&table->lock);
+  memset(table, 0, sizeof(*table));
+}
+
+/*
+ * Keeps the last `max_events` events in `table`, none if 0. Must be
+ * called before the first event.
+ */
+static void set_event_table_size(event_table* const table, uint64_t const max_events) {
+  table->max_events = max_events;
+}
+
+static void lock_event_table(event_table* const table) {
+  if (table->max_events > 0) {
+    pthread_mutex_lock(&table->lock);
+  }
+}
+
+static void unlock_event_table(event_table* const table) {
+  if (table->max_events > 0) {
+    pthread_mutex_unlock(&table->lock);
+  }
+}
+
+static void alloc_event_table(event_table* const table) {
+  table->timestamps = (int64_t*)malloc(table->max_events * sizeof(int64_t));
+  table->stream_ids = (uint64_t*)malloc(table->max_events * sizeof(uint64_t));
+  table->trace_ids = (uint32_t*)malloc(table->max_events * sizeof(uint32_t));
+  table->classes = (uint32_t*)malloc(table->max_events * sizeof(uint32_t));
+  FAIL_FAST_IF(!table->timestamps || !table->stream_ids || !table->trace_ids || !table->classes);
+}
+
+/*
+ * Puts the string of id `id` in a free slot of `table`.
+ */
+static void place_event_table_string(event_table* const table, uint32_t const id) {
+  uint64_t slot =
+      hash_string(table->string_data + table->string_offsets[id]) & (table->slot_capacity - 1);
+  while (table->string_slots[slot] != EVENT_TABLE_NO_STRING) {
+    slot = (slot + 1) & (table->slot_capacity - 1);
+  }
+  table->string_slots[slot] = id;
+}
+
+/*
+ * Keeps only the strings the retained events refer to, renumbered in
+ * the order they are first referred to.
+ */
+static void compact_event_table_strings(event_table* const table) {
+  uint32_t* const ids = (uint32_t*)malloc(((uint64_t)table->string_count + 1) * sizeof(uint32_t));
+  char* const data = (char*)malloc(table->string_capacity);
+  uint64_t* const offsets =
+      (uint64_t*)malloc(((uint64_t)table->offset_capacity + 1) * sizeof(uint64_t));
+  FAIL_FAST_IF(!ids || !data || !offsets);
+  memset(ids, 0xff, ((uint64_t)table->string_count + 1) * sizeof(uint32_t));
+
+  uint32_t count = 0;
+  uint64_t bytes = 0;
+  for (uint32_t c = 0; c < table->class_count; c++) {
+    const table_class* const class = &table->class_list[c];
+    for (uint32_t i = 0; i < class->column_count; i++) {
+      if (class->columns[i].type != TABLE_COLUMN_STRING) {
+        continue;
+      }
+      uint32_t* const strings = class->columns[i].values.strings;
+      for (uint64_t row = class->head; row < class->head + class->count; row++) {
+        if (strings[row] == EVENT_TABLE_NO_STRING) {
+          continue;
+        }
+        if (ids[strings[row]] == EVENT_TABLE_NO_STRING) {
+          const char* const str = table->string_data + table->string_offsets[strings[row]];
+          size_t const size = strlen(str) + 1;
+          memcpy(data + bytes, str, size);
+          offsets[count] = bytes;
+          bytes += size;
+          ids[strings[row]] = count++;
+        }
+        strings[row] = ids[strings[row]];
+      }
+    }
+  }
+
+  free(ids);
+  free(table->string_data);
+  free(table->string_offsets);
+  table->string_data = data;
+  table->string_offsets = offsets;
+  table->string_bytes = bytes;
+  table->string_count = count;
+
+  memset(table->string_slots, 0xff, table->slot_capacity * sizeof(uint32_t));
+  for (uint32_t id = 0; id < count; id++) {
+    place_event_table_string(table, id);
+  }
+  table->rows_since_compaction = 0;
+}
+
+/*
+ * Returns the id of `str` in `table`, interning it if needed, or
+ * EVENT_TABLE_NO_STRING, counted in `dropped_strings`, if there is no
+ * room left.
+ *
+ * Once out of room, the strings are compacted (see
+ * compact_event_table_strings()), but at most once per `max_events`
+ * events: by then, the events which referred to the strings kept by the
+ * previous compaction are evicted, and compacting costs a pass over the
+ * retained events only every so often.
+ */
+static uint32_t event_table_intern(event_table* const table, const char* const str) {
+  uint64_t const hash = hash_string(str);
+  uint64_t const len = strlen(str);
+
+  if (table->slot_capacity > 0) {
+    for (uint64_t slot = hash & (table->slot_capacity - 1);
+         table->string_slots[slot] != EVENT_TABLE_NO_STRING;
+         slot = (slot + 1) & (table->slot_capacity - 1)) {
+      const char* const interned =
+          table->string_data + table->string_offsets[table->string_slots[slot]];
+      if (strcmp(interned, str) == 0) {
+        return table->string_slots[slot];
+      }
+    }
+  }
+
+  if (table->string_bytes + len + 1 > EVENT_TABLE_MAX_STRING_BYTES &&
+      table->rows_since_compaction >= table->max_events) {
+    compact_event_table_strings(table);
+  }
+  if (table->string_bytes + len + 1 > EVENT_TABLE_MAX_STRING_BYTES) {
+    table->dropped_strings++;
+    return EVENT_TABLE_NO_STRING;
+  }
+
+  /* Keep the slots at most half full */
+  if (2 * ((uint64_t)table->string_count + 1) > table->slot_capacity) {
+    uint64_t const capacity = table->slot_capacity ? table->slot_capacity * 2 : 1024;
+    uint32_t* const slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    FAIL_FAST_IF(!slots);
+    memset(slots, 0xff, capacity * sizeof(uint32_t));
+    for (uint64_t i = 0; i < table->slot_capacity; i++) {
+      uint32_t const id = table->string_slots[i];
+      if (id == EVENT_TABLE_NO_STRING) {
+        continue;
+      }
+      uint64_t slot = hash_string(table->string_data + table->string_offsets[id]) & (capacity - 1);
+      while (slots[slot] != EVENT_TABLE_NO_STRING) {
+        slot = (slot + 1) & (capacity - 1);
+      }
+      slots[slot] = id;
+    }
+    free(table->string_slots);
+    table->string_slots = slots;
+    table->slot_capacity = capacity;
+  }
+
+  if (table->string_bytes + len + 1 > table->string_capacity) {
+    uint64_t capacity = table->string_capacity ? table->string_capacity * 2 : 4096;
+    while (capacity < table->string_bytes + len + 1) {
+      capacity *= 2;
+    }
+    table->string_data = (char*)realloc(table->string_data, capacity);
+    FAIL_FAST_IF(!table->string_data);
+    table->string_capacity = capacity;
+  }
+  if (table->string_count == table->offset_capacity) {
+    table->offset_capacity = table->offset_capacity ? table->offset_capacity * 2 : 256;
+    table->string_offsets =
+        (uint64_t*)realloc(table->string_offsets, table->offset_capacity * sizeof(uint64_t));
+    FAIL_FAST_IF(!table->string_offsets);
+  }
+
+  uint32_t const id = table->string_count++;
+  table->string_offsets[id] = table->string_bytes;
+  memcpy(table->string_data + table->string_bytes, str, len);
+  table->string_data[table->string_bytes + len] = '\0';
+  table->string_bytes += len + 1;
+  place_event_table_string(table, id);
+  return id;
+}
+
+/*
+ * Returns the column type of the scalar fields of class type `type`, or
+ * false if they are not scalars.
+ */
+static bool table_column_type_of(bt_field_class_type const type, table_column_type* const column) {
+  if (type == BT_FIELD_CLASS_TYPE_BOOL ||
+      bt_field_class_type_is(type, BT_FIELD_CLASS_TYPE_SIGNED_INTEGER)) {
+    *column = TABLE_COLUMN_SIGNED;
+  } else if (type == BT_FIELD_CLASS_TYPE_BIT_ARRAY ||
+             bt_field_class_type_is(type, BT_FIELD_CLASS_TYPE_UNSIGNED_INTEGER)) {
+    *column = TABLE_COLUMN_UNSIGNED;
+  } else if (type == BT_FIELD_CLASS_TYPE_SINGLE_PRECISION_REAL ||
+             type == BT_FIELD_CLASS_TYPE_DOUBLE_PRECISION_REAL) {
+    *column = TABLE_COLUMN_REAL;
+  } else if (type == BT_FIELD_CLASS_TYPE_STRING) {
+    *column = TABLE_COLUMN_STRING;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Appends the columns of the scalar fields under op `op` of `ops`, `path`
+ * being the path of its parent, to the `*count` columns of `columns`.
+ * Fields past EVENT_TABLE_MAX_COLUMNS are counted but left out, as
+ * fill_table_columns() does.
+ */
+static void collect_table_columns(const field_op* const ops,
+                                  uint32_t const op,
+                                  const char* const path,
+                                  table_column* const columns,
+                                  uint32_t* const count,
+                                  uint32_t* const seen) {
+  char* const op_path = (char*)malloc(strlen(path) + ops[op].name_len + 2);
+  FAIL_FAST_IF(!op_path);
+  if (*path) {
+    sprintf(op_path, "%s.%s", path, ops[op].name);
+  } else {
+    strcpy(op_path, ops[op].name);
+  }
+
+  table_column_type type;
+  if (ops[op].type == BT_FIELD_CLASS_TYPE_STRUCTURE) {
+    for (uint32_t member = op + 1; member < ops[op].end; member = ops[member].end) {
+      collect_table_columns(ops, member, op_path, columns, count, seen);
+    }
+  } else if (table_column_type_of(ops[op].type, &type)) {
+    if ((*seen)++ < EVENT_TABLE_MAX_COLUMNS) {
+      columns[*count].path = op_path;
+      columns[*count].type = type;
+      columns[*count].values.ints = NULL;
+      (*count)++;
+      return;
+    }
+  }
+  free(op_path);
+}
+
+/*
+ * Stores the values of the scalar fields under op `op` of `ops`, of
+ * which `field` is the field, at `row` of the columns of `class` from
+ * `*column` on, in the order of collect_table_columns().
+ */
+static void fill_table_columns(event_table* const table,
+                               table_class* const class,
+                               uint64_t const row,
+                               const field_op* const ops,
+                               uint32_t const op,
+                               const bt_field* const field,
+                               uint32_t* const column) {
+  bt_field_class_type const type = ops[op].type;
+
+  if (type == BT_FIELD_CLASS_TYPE_STRUCTURE) {
+    for (uint32_t member = op + 1; member < ops[op].end; member = ops[member].end) {
+      fill_table_columns(
+          table, class, row, ops, member,
+          bt_field_structure_borrow_member_field_by_index_const(field, ops[member].index), column);
+    }
+    return;
+  }
+
+  table_column_type column_type;
+  if (!table_column_type_of(type, &column_type)) {
+    return;
+  }
+  if (*column >= class->column_count) {
+    (*column)++;
+    return;
+  }
+
+  table_column* const values = &class->columns[(*column)++];
+  if (type == BT_FIELD_CLASS_TYPE_BOOL) {
+    values->values.ints[row] = bt_field_bool_get_value(field) == BT_TRUE;
+  } else if (type == BT_FIELD_CLASS_TYPE_BIT_ARRAY) {
+    values->values.ints[row] = (int64_t)bt_field_bit_array_get_value_as_integer(field);
+  } else if (column_type == TABLE_COLUMN_SIGNED) {
+    values->values.ints[row] = bt_field_integer_signed_get_value(field);
+  } else if (column_type == TABLE_COLUMN_UNSIGNED) {
+    values->values.ints[row] = (int64_t)bt_field_integer_unsigned_get_value(field);
+  } else if (type == BT_FIELD_CLASS_TYPE_SINGLE_PRECISION_REAL) {
+    values->values.reals[row] = bt_field_real_single_precision_get_value(field);
+  } else if (type == BT_FIELD_CLASS_TYPE_DOUBLE_PRECISION_REAL) {
+    values->values.reals[row] = bt_field_real_double_precision_get_value(field);
+  } else {
+    values->values.strings[row] = event_table_intern(table, bt_field_string_get_value(field));
+  }
+}
+
+/*
+ * Finds, once per event class, the class of the table of the events of
+ * `decoder`: the one of the same name and columns, or a new one.
+ */
+static void compile_event_table(event_table* const table, event_decoder* const decoder) {
+  table_column columns[EVENT_TABLE_MAX_COLUMNS];
+  uint32_t count = 0;
+  uint32_t seen = 0;
+  uint32_t const roots[] = {decoder->common_context, decoder->specific_context, decoder->payload};
+
+  for (uint32_t i = 0; i < sizeof(roots) / sizeof(roots[0]); i++) {
+    if (roots[i] != NO_FIELD_OP) {
+      collect_table_columns(decoder->ops, roots[i], "", columns, &count, &seen);
+    }
+  }
+  decoder->table_compiled = true;
+
+  for (uint32_t i = 0; i < table->class_count; i++) {
+    table_class* const class = &table->class_list[i];
+    bool same = class->name == decoder->name && class->column_count == count;
+    for (uint32_t j = 0; same && j < count; j++) {
+      same = class->columns[j].type == columns[j].type &&
+             strcmp(class->columns[j].path, columns[j].path) == 0;
+    }
+    if (same) {
+      for (uint32_t j = 0; j < count; j++) {
+        free(columns[j].path);
+      }
+      decoder->table_class = i;
+      return;
+    }
+  }
+
+  if (table->class_count == table->class_capacity) {
+    table->class_capacity = table->class_capacity ? table->class_capacity * 2 : 16;
+    table->class_list =
+        (table_class*)realloc(table->class_list, table->class_capacity * sizeof(table_class));
+    FAIL_FAST_IF(!table->class_list);
+  }
+  table_class* const class = &table->class_list[table->class_count];
+  memset(class, 0, sizeof(*class));
+  class->name = decoder->name;
+  class->column_count = count;
+  if (count > 0) {
+    class->columns = (table_column*)malloc(count * sizeof(table_column));
+    FAIL_FAST_IF(!class->columns);
+    memcpy(class->columns, columns, count * sizeof(table_column));
+  }
+  decoder->table_class = table->class_count++;
+}
+
+/*
+ * Returns the index, within the columns of `class`, of a new row after
+ * its last one.
+ */
+static uint64_t push_table_row(table_class* const class) {
+  if (class->head + class->count == class->capacity) {
+    if (class->head > 0 && class->head >= class->capacity / 2) {
+      for (uint32_t i = 0; i < class->column_count; i++) {
+        size_t const size = class->columns[i].type == TABLE_COLUMN_STRING ? sizeof(uint32_t)
+                                                                           : sizeof(int64_t);
+        char* const values = (char*)class->columns[i].values.ints;
+        memmove(values, values + class->head * size, class->count * size);
+      }
+      class->head = 0;
+    } else {
+      class->capacity = class->capacity ? class->capacity * 2 : 64;
+      for (uint32_t i = 0; i < class->column_count; i++) {
+        size_t const size = class->columns[i].type == TABLE_COLUMN_STRING ? sizeof(uint32_t)
+                                                                           : sizeof(int64_t);
+        class->columns[i].values.ints =
+            (int64_t*)realloc(class->columns[i].values.ints, class->capacity * size);
+        FAIL_FAST_IF(!class->columns[i].values.ints);
+      }
+    }
+  }
+  return class->head + class->count++;
+}
+
+/*
+ * Stores `event`, of the class of `decoder`, timestamped `timestamp_ns`,
+ * in the stream `stream_id` of the trace `trace_id`, evicting the oldest
+ * event once `table` is full. The caller holds the lock of `table`.
+ */
+static void event_table_append(event_table* const table,
+                               event_decoder* const decoder,
+                               const bt_event* const event,
+                               uint32_t const trace_id,
+                               uint64_t const stream_id,
+                               int64_t const timestamp_ns) {
+  if (table->max_events == 0) {
+    return;
+  }
+  if (!table->timestamps) {
+    alloc_event_table(table);
+  }
+  if (!decoder->table_compiled) {
+    compile_event_table(table, decoder);
+  }
+
+  if (table->count == table->max_events) {
+    table_class* const oldest = &table->class_list[table->classes[table->start]];
+    oldest->head++;
+    oldest->count--;
+    table->start = table->start + 1 == table->max_events ? 0 : table->start + 1;
+    table->count--;
+  }
+
+  uint64_t row = table->start + table->count;
+  if (row >= table->max_events) {
+    row -= table->max_events;
+  }
+  table->timestamps[row] = timestamp_ns;
+  table->stream_ids[row] = stream_id;
+  table->trace_ids[row] = trace_id;
+  table->classes[row] = decoder->table_class;
+  table->count++;
+  table->rows_since_compaction++;
+
+  /* Fields the event lacks are left as 0 or EVENT_TABLE_NO_STRING */
+  table_class* const class = &table->class_list[decoder->table_class];
+  uint64_t const class_row = push_table_row(class);
+  for (uint32_t i = 0; i < class->column_count; i++) {
+    if (class->columns[i].type == TABLE_COLUMN_STRING) {
+      class->columns[i].values.strings[class_row] = EVENT_TABLE_NO_STRING;
+    } else {
+      class->columns[i].values.ints[class_row] = 0;
+    }
+  }
+  uint32_t column = 0;
+  const bt_field* const roots[] = {bt_event_borrow_common_context_field_const(event),
+                                   bt_event_borrow_specific_context_field_const(event),
+                                   bt_event_borrow_payload_field_const(event)};
+  uint32_t const root_ops[] = {decoder->common_context, decoder->specific_context,
+                               decoder->payload};
+
+  for (uint32_t i = 0; i < sizeof(roots) / sizeof(roots[0]); i++) {
+    if (root_ops[i] != NO_FIELD_OP && roots[i]) {
+      fill_table_columns(table, class, class_row, decoder->ops, root_ops[i], roots[i], &column);
+    }
+  }
+}
+
+/*
+ * An exported event, copied out of its table along with its fields (see
+ * table_export_field) while the tables are locked. `row` and `class_row`
+ * only locate it in the columns until then.
+ */
+typedef struct table_export_row {
+  uint32_t table;
+  uint32_t class;
+  uint64_t row;
+  uint64_t class_row;
+  int64_t timestamp_ns;
+  uint64_t stream_id;
+  uint32_t trace_id;
+  const char* name; /* Interned by the decoder cache */
+} table_export_row;
+
+/*
+ * Type of the value of an exported field of an event without one.
+ */
+#define TABLE_EXPORT_NO_VALUE 0xff
+
+/*
+ * An exported field: its path, its type, its column in each class of
+ * each table, -1 where the class has no such column, and its values.
+ */
+typedef struct table_export_field {
+  char* path;
+  table_column_type type;
+  int32_t** columns; /* By table, then by class */
+  uint8_t* kinds;    /* By event: table_column_type of its value, or TABLE_EXPORT_NO_VALUE */
+  int64_t* values;   /* By event: integer, bits of a real or id in the strings of the export */
+} table_export_field;
+
+/*
+ * What an export of event tables is made of, and where it is written.
+ *
+ * The tables are only read while locked, to copy the selected events
+ * out: the events are then written without holding the threads running
+ * the graphs back.
+ */
+typedef struct table_export {
+  event_table* const* tables;
+  uint32_t table_count;
+  uint32_t* class_counts; /* By table, once copied out */
+  trace_registry* traces;
+
+  table_export_field fields[EVENT_TABLE_MAX_EXPORT_FIELDS];
+  uint32_t field_count;
+
+  table_export_row* rows;
+  uint64_t row_count;
+  uint64_t row_capacity;
+
+  /* Strings of the values of the events, NUL-terminated at their offset */
+  byte_buffer strings;
+  uint64_t* string_offsets;
+  uint32_t string_count;
+  uint32_t offset_capacity;
+
+  int fd;
+  byte_buffer buffer;
+  bool failed;
+} table_export;
+
+static void destroy_table_export(table_export* const export) {
+  for (uint32_t i = 0; i < export->field_count; i++) {
+    free(export->fields[i].path);
+    for (uint32_t t = 0; t < export->table_count; t++) {
+      free(export->fields[i].columns[t]);
+    }
+    free(export->fields[i].columns);
+    free(export->fields[i].kinds);
+    free(export->fields[i].values);
+  }
+  free(export->class_counts);
+  free(export->rows);
+  byte_buffer_destroy(&export->strings);
+  free(export->string_offsets);
+  byte_buffer_destroy(&export->buffer);
+  if (export->fd >= 0) {
+    close(export->fd);
+  }
+}
+
+/*
+ * Writes out what `export` buffered once it holds at least `threshold`
+ * bytes.
+ */
+static void flush_table_export(table_export* const export, size_t const threshold) {
+  if (export->buffer.size < threshold || export->failed) {
+    return;
+  }
+
+  for (size_t written = 0; written < export->buffer.size;) {
+    ssize_t const n =
+        write(export->fd, export->buffer.data + written, export->buffer.size - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      export->failed = true;
+      break;
+    }
+    written += (size_t)n;
+  }
+  export->buffer.size = 0;
+}
+
+/*
+ * Adds the field of path `path` to the fields of `export`, resolving its
+ * column in every class of every table. Its type is the one of its first
+ * column. Returns false if no class has such a field.
+ */
+static bool add_table_export_field(table_export* const export, const char* const path) {
+  table_export_field* const field = &export->fields[export->field_count];
+  bool found = false;
+
+  field->path = strdup(path);
+  FAIL_FAST_IF(!field->path);
+  field->columns = (int32_t**)calloc(export->table_count, sizeof(int32_t*));
+  FAIL_FAST_IF(!field->columns);
+  field->kinds = NULL;
+  field->values = NULL;
+  export->field_count++;
+
+  for (uint32_t t = 0; t < export->table_count; t++) {
+    const event_table* const table = export->tables[t];
+    field->columns[t] = (int32_t*)malloc((table->class_count + 1) * sizeof(int32_t));
+    FAIL_FAST_IF(!field->columns[t]);
+
+    for (uint32_t c = 0; c < table->class_count; c++) {
+      const table_class* const class = &table->class_list[c];
+      field->columns[t][c] = -1;
+      for (uint32_t i = 0; i < class->column_count; i++) {
+        if (strcmp(class->columns[i].path, path) == 0) {
+          if (!found) {
+            field->type = class->columns[i].type;
+            found = true;
+          }
+          field->columns[t][c] = (int32_t)i;
+          break;
+        }
+      }
+    }
+  }
+  return found;
+}
+
+/*
+ * Projects the fields of `fields`, separated by commas or whitespace,
+ * each one being a field path as in an event filter, or all the fields
+ * of all the classes if `fields` is empty.
+ */
+static bool project_table_export(table_export* const export,
+                                 const char* const fields,
+                                 char* const error,
+                                 size_t const error_size) {
+  if (!*fields) {
+    for (uint32_t t = 0; t < export->table_count; t++) {
+      const event_table* const table = export->tables[t];
+      for (uint32_t c = 0; c < table->class_count; c++) {
+        const table_class* const class = &table->class_list[c];
+        for (uint32_t i = 0; i < class->column_count; i++) {
+          bool known = false;
+          for (uint32_t f = 0; f < export->field_count && !known; f++) {
+            known = strcmp(export->fields[f].path, class->columns[i].path) == 0;
+          }
+          if (!known && export->field_count < EVENT_TABLE_MAX_EXPORT_FIELDS) {
+            add_table_export_field(export, class->columns[i].path);
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  char* const copy = strdup(fields);
+  FAIL_FAST_IF(!copy);
+  char* save = NULL;
+  bool valid = true;
+
+  for (char* path = strtok_r(copy, ", \t", &save); path && valid;
+       path = strtok_r(NULL, ", \t", &save)) {
+    if (export->field_count == EVENT_TABLE_MAX_EXPORT_FIELDS) {
+      set_filter_error(error, error_size, "more than %d fields", EVENT_TABLE_MAX_EXPORT_FIELDS);
+      valid = false;
+      break;
+    }
+
+    /* Spell the path from its root, as the columns are */
+    filter_predicate predicate;
+    memset(&predicate, 0, sizeof(predicate));
+    char* const tokens = strdup(path);
+    FAIL_FAST_IF(!tokens);
+    valid = parse_filter_path(&predicate, tokens, error, error_size);
+    free(tokens);
+
+    if (valid) {
+      char full_path[512];
+      size_t len = (size_t)snprintf(full_path, sizeof(full_path), "%s",
+                                    filter_root_names[predicate.root]);
+      for (uint32_t i = 0; i < predicate.path_len && len < sizeof(full_path); i++) {
+        len += (size_t)snprintf(full_path + len, sizeof(full_path) - len, ".%s", predicate.path[i]);
+      }
+      if (!add_table_export_field(export, full_path)) {
+        set_filter_error(error, error_size, "no events have the field %s", path);
+        valid = false;
+      }
+    }
+    for (uint32_t i = 0; i < predicate.path_len; i++) {
+      free(predicate.path[i]);
+    }
+  }
+
+  free(copy);
+  return valid;
+}
+
+/*
+ * Selects the events of the tables of `export` timestamped within
+ * [`from_ns`, `to_ns`], interleaving the ones of the tables by
+ * timestamp, the events of each table being in the order of the graph.
+ */
+static void select_table_export_rows(table_export* const export,
+                                     int64_t const from_ns,
+                                     int64_t const to_ns) {
+  /* Cursors: position within the events of each table, and next row of each class */
+  uint64_t* const positions = (uint64_t*)calloc(export->table_count, sizeof(uint64_t));
+  uint64_t** const class_rows = (uint64_t**)calloc(export->table_count, sizeof(uint64_t*));
+  FAIL_FAST_IF(!positions || !class_rows);
+  for (uint32_t t = 0; t < export->table_count; t++) {
+    const event_table* const table = export->tables[t];
+    class_rows[t] = (uint64_t*)malloc((table->class_count + 1) * sizeof(uint64_t));
+    FAIL_FAST_IF(!class_rows[t]);
+    for (uint32_t c = 0; c < table->class_count; c++) {
+      class_rows[t][c] = table->class_list[c].head;
+    }
+  }
+
+  for (;;) {
+    /* The table of the earliest next event, tables being few */
+    uint32_t next = UINT32_MAX;
+    int64_t next_ns = 0;
+    for (uint32_t t = 0; t < export->table_count; t++) {
+      const event_table* const table = export->tables[t];
+      if (positions[t] == table->count) {
+        continue;
+      }
+      int64_t const ns = table->timestamps[(table->start + positions[t]) % table->max_events];
+      if (next == UINT32_MAX || ns < next_ns) {
+        next = t;
+        next_ns = ns;
+      }
+    }
+    if (next == UINT32_MAX) {
+      break;
+    }
+
+    const event_table* const table = export->tables[next];
+    uint64_t const row = (table->start + positions[next]++) % table->max_events;
+    uint32_t const class = table->classes[row];
+    uint64_t const class_row = class_rows[next][class]++;
+    if (next_ns < from_ns || next_ns > to_ns) {
+      continue;
+    }
+
+    if (export->row_count == export->row_capacity) {
+      export->row_capacity = export->row_capacity ? export->row_capacity * 2 : 4096;
+      export->rows = (table_export_row*)realloc(export->rows,
+                                                export->row_capacity * sizeof(table_export_row));
+      FAIL_FAST_IF(!export->rows);
+    }
+    table_export_row* const selected = &export->rows[export->row_count++];
+    selected->table = next;
+    selected->class = class;
+    selected->row = row;
+    selected->class_row = class_row;
+    selected->timestamp_ns = next_ns;
+    selected->stream_id = table->stream_ids[row];
+    selected->trace_id = table->trace_ids[row];
+    selected->name = table->class_list[class].name;
+  }
+
+  for (uint32_t t = 0; t < export->table_count; t++) {
+    free(class_rows[t]);
+  }
+  free(class_rows);
+  free(positions);
+}
+
+/*
+ * Returns the column of field `field` of the event of `row`, or NULL if
+ * its class has none. The tables must be locked.
+ */
+static const table_column* table_export_column(const table_export* const export,
+                                               uint32_t const field,
+                                               const table_export_row* const row) {
+  int32_t const column = export->fields[field].columns[row->table][row->class];
+  if (column < 0) {
+    return NULL;
+  }
+  return &export->tables[row->table]->class_list[row->class].columns[column];
+}
+
+/*
+ * Returns the id in `export` of a copy of the string of id `id` of table
+ * `t`, copying it on first use, `ids` being the ids in `export` of the
+ * strings of each table copied so far.
+ */
+static uint32_t copy_table_export_string(table_export* const export,
+                                         uint32_t** const ids,
+                                         uint32_t const t,
+                                         uint32_t const id) {
+  const event_table* const table = export->tables[t];
+  if (!ids[t]) {
+    ids[t] = (uint32_t*)malloc(((uint64_t)table->string_count + 1) * sizeof(uint32_t));
+    FAIL_FAST_IF(!ids[t]);
+    memset(ids[t], 0xff, ((uint64_t)table->string_count + 1) * sizeof(uint32_t));
+  }
+  if (ids[t][id] != UINT32_MAX) {
+    return ids[t][id];
+  }
+
+  if (export->string_count == export->offset_capacity) {
+    export->offset_capacity = export->offset_capacity ? export->offset_capacity * 2 : 256;
+    export->string_offsets = (uint64_t*)realloc(export->string_offsets,
+                                                export->offset_capacity * sizeof(uint64_t));
+    FAIL_FAST_IF(!export->string_offsets);
+  }
+  const char* const str = table->string_data + table->string_offsets[id];
+  export->string_offsets[export->string_count] = export->strings.size;
+  byte_buffer_append(&export->strings, str, strlen(str) + 1);
+  ids[t][id] = export->string_count++;
+  return ids[t][id];
+}
+
+/*
+ * Copies the values of the projected fields of the selected events out
+ * of the locked tables of `export`.
+ */
+static void copy_table_export_values(table_export* const export) {
+  uint32_t** const ids = (uint32_t**)calloc(export->table_count, sizeof(uint32_t*));
+  export->class_counts = (uint32_t*)malloc((export->table_count + 1) * sizeof(uint32_t));
+  FAIL_FAST_IF(!ids || !export->class_counts);
+  for (uint32_t t = 0; t < export->table_count; t++) {
+    export->class_counts[t] = export->tables[t]->class_count;
+  }
+
+  for (uint32_t f = 0; f < export->field_count; f++) {
+    table_export_field* const field = &export->fields[f];
+    field->kinds = (uint8_t*)malloc(export->row_count + 1);
+    field->values = (int64_t*)malloc((export->row_count + 1) * sizeof(int64_t));
+    FAIL_FAST_IF(!field->kinds || !field->values);
+
+    for (uint64_t i = 0; i < export->row_count; i++) {
+      const table_export_row* const row = &export->rows[i];
+      const table_column* const column = table_export_column(export, f, row);
+      field->kinds[i] = column ? (uint8_t)column->type : TABLE_EXPORT_NO_VALUE;
+      field->values[i] = 0;
+      if (!column) {
+        continue;
+      }
+
+      if (column->type == TABLE_COLUMN_STRING) {
+        uint32_t const id = column->values.strings[row->class_row];
+        if (id == EVENT_TABLE_NO_STRING) {
+          field->kinds[i] = TABLE_EXPORT_NO_VALUE;
+        } else {
+          field->values[i] = copy_table_export_string(export, ids, row->table, id);
+        }
+      } else if (column->type == TABLE_COLUMN_REAL) {
+        memcpy(&field->values[i], &column->values.reals[row->class_row], sizeof(double));
+      } else {
+        field->values[i] = column->values.ints[row->class_row];
+      }
+    }
+  }
+
+  for (uint32_t t = 0; t < export->table_count; t++) {
+    free(ids[t]);
+  }
+  free(ids);
+}
+
+/*
+ * Returns the string of id `id` of `export`.
+ */
+static const char* table_export_string(const table_export* const export, int64_t const id) {
+  return export->strings.data + export->string_offsets[id];
+}
+
+/*
+ * Returns value `i` of `field` as a real.
+ */
+static double table_export_real(const table_export_field* const field, uint64_t const i) {
+  double value;
+  memcpy(&value, &field->values[i], sizeof(value));
+  return value;
+}
+
+/*
+ * Appends `str` as a CSV value, quoted only if needed.
+ */
+static void append_csv_string(byte_buffer* const buffer, const char* const str) {
+  if (!str) {
+    return;
+  }
+  if (!strpbrk(str, ",\"\r\n")) {
+    byte_buffer_append(buffer, str, strlen(str));
+    return;
+  }
+
+  byte_buffer_append_char(buffer, '"');
+  for (const char* c = str; *c; c++) {
+    if (*c == '"') {
+      byte_buffer_append_char(buffer, '"');
+    }
+    byte_buffer_append_char(buffer, *c);
+  }
+  byte_buffer_append_char(buffer, '"');
+}
+
+/*
+ * Writes the selected events of `export` as CSV: a header line, then a
+ * line per event with its timestamp in nanoseconds, session, stream and
+ * name, then its projected fields, empty where its class has none.
+ */
+static void write_table_export_csv(table_export* const export) {
+  event_writer writer;
+  event_writer_init(&writer, &export->buffer, OUTPUT_FORMAT_JSON);
+
+  byte_buffer_append(&export->buffer, "timestamp,session,stream,event", 30);
+  for (uint32_t f = 0; f < export->field_count; f++) {
+    byte_buffer_append_char(&export->buffer, ',');
+    append_csv_string(&export->buffer, export->fields[f].path);
+  }
+  byte_buffer_append_char(&export->buffer, '\n');
+
+  for (uint64_t i = 0; i < export->row_count && !export->failed; i++) {
+    const table_export_row* const row = &export->rows[i];
+    const trace_info* const trace = trace_registry_get(export->traces, row->trace_id);
+
+    writer_int64(&writer, NULL, 0, row->timestamp_ns);
+    byte_buffer_append_char(&export->buffer, ',');
+    append_csv_string(&export->buffer, trace ? trace->session : NULL);
+    byte_buffer_append_char(&export->buffer, ',');
+    append_decimal(&export->buffer, row->stream_id);
+    byte_buffer_append_char(&export->buffer, ',');
+    append_csv_string(&export->buffer, row->name);
+
+    for (uint32_t f = 0; f < export->field_count; f++) {
+      const table_export_field* const field = &export->fields[f];
+      byte_buffer_append_char(&export->buffer, ',');
+      switch (field->kinds[i]) {
+        case TABLE_COLUMN_SIGNED:
+          writer_int64(&writer, NULL, 0, field->values[i]);
+          break;
+        case TABLE_COLUMN_UNSIGNED:
+          append_decimal(&export->buffer, (uint64_t)field->values[i]);
+          break;
+        case TABLE_COLUMN_REAL:
+          writer_double(&writer, NULL, 0, table_export_real(field, i));
+          break;
+        case TABLE_COLUMN_STRING:
+          append_csv_string(&export->buffer, table_export_string(export, field->values[i]));
+          break;
+      }
+    }
+    byte_buffer_append_char(&export->buffer, '\n');
+    flush_table_export(export, EVENT_TABLE_EXPORT_BUFFER_SIZE);
+  }
+}
+
+/*
+ * Dictionary of the strings of a string column of a binary export.
+ */
+typedef struct table_export_dictionary {
+  const char** strings;
+  uint32_t count;
+  uint32_t capacity;
+} table_export_dictionary;
+
+/*
+ * Appends `str` to `dictionary`, and returns its id there.
+ */
+static uint32_t add_table_export_dictionary(table_export_dictionary* const dictionary,
+                                            const char* const str) {
+  if (dictionary->count == dictionary->capacity) {
+    dictionary->capacity = dictionary->capacity ? dictionary->capacity * 2 : 256;
+    dictionary->strings =
+        (const char**)realloc(dictionary->strings, dictionary->capacity * sizeof(const char*));
+    FAIL_FAST_IF(!dictionary->strings);
+  }
+  dictionary->strings[dictionary->count] = str;
+  return dictionary->count++;
+}
+
+/*
+ * Writes the header of a column of a binary export.
+ */
+static void write_table_export_header(table_export* const export,
+                                      const char* const name,
+                                      table_column_type const type) {
+  uint32_t const header[2] = {(uint32_t)type, (uint32_t)strlen(name)};
+  byte_buffer_append(&export->buffer, header, sizeof(header));
+  byte_buffer_append(&export->buffer, name, header[1]);
+}
+
+/*
+ * Writes the validity bitmap of a column of which every value is valid.
+ */
+static void write_table_export_full_bitmap(table_export* const export) {
+  for (uint64_t i = 0; i < (export->row_count + 7) / 8; i++) {
+    byte_buffer_append_char(&export->buffer, (char)0xff);
+    flush_table_export(export, EVENT_TABLE_EXPORT_BUFFER_SIZE);
+  }
+}
+
+/*
+ * Writes the `count` strings of the dictionary of a string column of a
+ * binary export: their count, then each one prefixed by its length.
+ */
+static void write_table_export_dictionary(table_export* const export,
+                                          const char* const* const strings,
+                                          uint32_t const count) {
+  byte_buffer_append(&export->buffer, &count, sizeof(count));
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t const len = (uint32_t)strlen(strings[i]);
+    byte_buffer_append(&export->buffer, &len, sizeof(len));
+    byte_buffer_append(&export->buffer, strings[i], len);
+    flush_table_export(export, EVENT_TABLE_EXPORT_BUFFER_SIZE);
+  }
+}
+
+/*
+ * Writes the session (or, if `names`, the name) of the selected events
+ * of `export` as a string column of a binary export. Sessions and names
+ * being few, each one is looked up once per table in the dictionary.
+ */
+static void write_table_export_labels(table_export* const export, bool const names) {
+  table_export_dictionary dictionary;
+  memset(&dictionary, 0, sizeof(dictionary));
+  uint32_t** const ids = (uint32_t**)calloc(export->table_count, sizeof(uint32_t*));
+  FAIL_FAST_IF(!ids);
+  uint32_t const trace_count = trace_registry_count(export->traces);
+
+  write_table_export_full_bitmap(export);
+
+  for (uint64_t i = 0; i < export->row_count && !export->failed; i++) {
+    const table_export_row* const row = &export->rows[i];
+    uint32_t const key = names ? row->class : row->trace_id;
+
+    if (!ids[row->table]) {
+      uint32_t const keys = names ? export->class_counts[row->table] : trace_count;
+      ids[row->table] = (uint32_t*)malloc((keys + 1) * sizeof(uint32_t));
+      FAIL_FAST_IF(!ids[row->table]);
+      memset(ids[row->table], 0xff, (keys + 1) * sizeof(uint32_t));
+    }
+
+    if (ids[row->table][key] == UINT32_MAX) {
+      const char* label;
+      if (names) {
+        label = row->name;
+      } else {
+        const trace_info* const trace = trace_registry_get(export->traces, key);
+        label = trace ? trace->session : NULL;
+      }
+      label = label ? label : "";
+
+      /* Tables intern their names on their own: compare the strings */
+      uint32_t id = 0;
+      while (id < dictionary.count && strcmp(dictionary.strings[id], label) != 0) {
+        id++;
+      }
+      if (id == dictionary.count) {
+        add_table_export_dictionary(&dictionary, label);
+      }
+      ids[row->table][key] = id;
+    }
+
+    byte_buffer_append(&export->buffer, &ids[row->table][key], sizeof(uint32_t));
+    flush_table_export(export, EVENT_TABLE_EXPORT_BUFFER_SIZE);
+  }
+  write_table_export_dictionary(export, dictionary.strings, dictionary.count);
+
+  for (uint32_t t = 0; t < export->table_count; t++) {
+    free(ids[t]);
+  }
+  free(ids);
+  free(dictionary.strings);
+}
+
+/*
+ * Returns whether event `i` has a value for `field`, of the type of the
+ * field or convertible to it.
+ */
+static bool table_export_has_value(const table_export_field* const field, uint64_t const i) {
+  if (field->kinds[i] == TABLE_EXPORT_NO_VALUE) {
+    return false;
+  }
+  return (field->type == TABLE_COLUMN_STRING) == (field->kinds[i] == TABLE_COLUMN_STRING);
+}
+
+/*
+ * Writes field `field` of the selected events of `export` as a column of
+ * a binary export: its validity bitmap, then its values, 0 if invalid,
+ * then the dictionary of a string column.
+ */
+static void write_table_export_column(table_export* const export, uint32_t const field) {
+  const table_export_field* const exported = &export->fields[field];
+  table_column_type const type = exported->type;
+  table_export_dictionary dictionary;
+  memset(&dictionary, 0, sizeof(dictionary));
+
+  /* Id in the dictionary of each string of the export, UINT32_MAX until added */
+  uint32_t* ids = NULL;
+  if (type == TABLE_COLUMN_STRING) {
+    ids = (uint32_t*)malloc(((uint64_t)export->string_count + 1) * sizeof(uint32_t));
+    FAIL_FAST_IF(!ids);
+    memset(ids, 0xff, ((uint64_t)export->string_count + 1) * sizeof(uint32_t));
+  }
+
+  /* Bit i % 8 of byte i / 8 is set if event i has a value */
+  for (uint64_t i = 0; i < export->row_count; i += 8) {
+    uint8_t bits = 0;
+    for (uint64_t j = i; j < i + 8 && j < export->row_count; j++) {
+      bits |= (uint8_t)(table_export_has_value(exported, j) << (j - i));
+    }
+    byte_buffer_append_char(&export->buffer, (char)bits);
+    flush_table_export(export, EVENT_TABLE_EXPORT_BUFFER_SIZE);
+  }
+
+  for (uint64_t i = 0; i < export->row_count && !export->failed; i++) {
+    bool const valid = table_export_has_value(exported, i);
+    uint8_t const kind = exported->kinds[i];
+
+    if (type == TABLE_COLUMN_STRING) {
+      uint32_t id = 0;
+      if (valid) {
+        uint32_t const string = (uint32_t)exported->values[i];
+        if (ids[string] == UINT32_MAX) {
+          ids[string] =
+              add_table_export_dictionary(&dictionary, table_export_string(export, string));
+        }
+        id = ids[string];
+      }
+      byte_buffer_append(&export->buffer, &id, sizeof(id));
+    } else {
+      /* Numbers of another type than the one of the field are converted */
+      int64_t bits = 0;
+      if (valid) {
+        int64_t const int_value = exported->values[i];
+        double const real_value = table_export_real(exported, i);
+        if (type != TABLE_COLUMN_REAL) {
+          bits = kind == TABLE_COLUMN_REAL ? (int64_t)real_value : int_value;
+        } else {
+          double const value = kind == TABLE_COLUMN_REAL     ? real_value
+                               : kind == TABLE_COLUMN_SIGNED ? (double)int_value
+                                                             : (double)(uint64_t)int_value;
+          memcpy(&bits, &value, sizeof(bits));
+        }
+      }
+      byte_buffer_append(&export->buffer, &bits, sizeof(bits));
+    }
+    flush_table_export(export, EVENT_TABLE_EXPORT_BUFFER_SIZE);
+  }
+
+  if (type == TABLE_COLUMN_STRING) {
+    write_table_export_dictionary(export, dictionary.strings, dictionary.count);
+  }
+
+  free(ids);
+  free(dictionary.strings);
+}
+
+/*
+ * Writes the selected events of `export` by column, in native byte order:
+ *
+ *     "LTTNGTBL", uint32 version (1), uint32 column count, uint64 event count
+ *     per column: uint32 type (see table_column_type), uint32 name length, name
+ *     per column: validity bitmap of (event count + 7) / 8 bytes, then the values
+ *
+ * The first columns are `timestamp` (SIGNED, nanoseconds), `session`
+ * (STRING), `stream` (UNSIGNED) and `event` (STRING), then come the
+ * projected fields, each one with the type of its first column and the
+ * numbers of other types converted. Values are 8 bytes each. Strings are
+ * 4-byte ids into the dictionary following the values of their column:
+ * a uint32 count, then each string as a uint32 length and its bytes.
+ */
+static void write_table_export_binary(table_export* const export) {
+  struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t column_count;
+    uint64_t row_count;
+  } const header = {{'L', 'T', 'T', 'N', 'G', 'T', 'B', 'L'}, 1, 4 + export->field_count,
+                    export->row_count};
+  byte_buffer_append(&export->buffer, &header, sizeof(header));
+
+  write_table_export_header(export, "timestamp", TABLE_COLUMN_SIGNED);
+  write_table_export_header(export, "session", TABLE_COLUMN_STRING);
+  write_table_export_header(export, "stream", TABLE_COLUMN_UNSIGNED);
+  write_table_export_header(export, "event", TABLE_COLUMN_STRING);
+  for (uint32_t f = 0; f < export->field_count; f++) {
+    write_table_export_header(export, export->fields[f].path, export->fields[f].type);
+  }
+
+  write_table_export_full_bitmap(export);
+  for (uint64_t i = 0; i < export->row_count; i++) {
+    byte_buffer_append(&export->buffer, &export->rows[i].timestamp_ns, sizeof(int64_t));
+    flush_table_export(export, EVENT_TABLE_EXPORT_BUFFER_SIZE);
+  }
+
+  write_table_export_labels(export, false);
+
+  write_table_export_full_bitmap(export);
+  for (uint64_t i = 0; i < export->row_count; i++) {
+    byte_buffer_append(&export->buffer, &export->rows[i].stream_id, sizeof(uint64_t));
+    flush_table_export(export, EVENT_TABLE_EXPORT_BUFFER_SIZE);
+  }
+
+  write_table_export_labels(export, true);
+
+  for (uint32_t f = 0; f < export->field_count && !export->failed; f++) {
+    write_table_export_column(export, f);
+  }
+}
+
+/*
+ * Writes the events of the `table_count` tables of `tables`, of which the
+ * traces are registered in `traces`, timestamped within [`from_ns`,
+ * `to_ns`], to a new file at `path` in `format`, projecting the fields
+ * of `fields` (see project_table_export()).
+ *
+ * The tables are only locked while the selected events are copied out,
+ * the threads running their graphs waiting meanwhile, and not while the
+ * file is written. `*dropped_strings` is the number of strings the
+ * tables could not keep so far (see event_table_intern()). Returns the
+ * number of events written, or -1, describing why in `error`, if none
+ * could be.
+ */
+static int64_t export_event_tables(event_table* const* const tables,
+                                   uint32_t const table_count,
+                                   trace_registry* const traces,
+                                   int64_t const from_ns,
+                                   int64_t const to_ns,
+                                   const char* const fields,
+                                   table_export_format const format,
+                                   const char* const path,
+                                   uint64_t* const dropped_strings,
+                                   char* const error,
+                                   size_t const error_size) {
+  table_export export;
+  memset(&export, 0, sizeof(export));
+  export.tables = tables;
+  export.table_count = table_count;
+  export.traces = traces;
+  export.fd = -1;
+  *dropped_strings = 0;
+
+  for (uint32_t t = 0; t < table_count; t++) {
+    if (tables[t]->max_events == 0) {
+      set_filter_error(error, error_size, "the events are not kept in a table");
+      return -1;
+    }
+  }
+
+  for (uint32_t t = 0; t < table_count; t++) {
+    pthread_mutex_lock(&tables[t]->lock);
+  }
+  bool const valid = project_table_export(&export, fields, error, error_size);
+  if (valid) {
+    select_table_export_rows(&export, from_ns, to_ns);
+    copy_table_export_values(&export);
+  }
+  for (uint32_t t = 0; t < table_count; t++) {
+    *dropped_strings += tables[t]->dropped_strings;
+    pthread_mutex_unlock(&tables[t]->lock);
+  }
+
+  int64_t written = -1;
+  if (valid) {
+    export.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (export.fd < 0) {
+      set_filter_error(error, error_size, "cannot open %s: %s", path, strerror(errno));
+    } else {
+      if (format == TABLE_EXPORT_CSV) {
+        write_table_export_csv(&export);
+      } else {
+        write_table_export_binary(&export);
+      }
+      flush_table_export(&export, 1);
+      if (export.failed) {
+        set_filter_error(error, error_size, "cannot write %s: %s", path, strerror(errno));
+      } else {
+        written = (int64_t)export.row_count;
+      }
+    }
+  }
+
+  destroy_table_export(&export);
+  return written;
+}
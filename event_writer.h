@@ -0,0 +1,578 @@
+#pragma once
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fail_fast_if.h"
+
+/*
+ * Encoding of the records produced by an event_writer.
+ *
+ * OUTPUT_FORMAT_JSON is byte-identical to what json-c renders with
+ * `JSON_C_TO_STRING_SPACED | JSON_C_TO_STRING_NOSLASHESCAPE`.
+ *
+ * OUTPUT_FORMAT_BINARY records start with their body size as a native
+ * `uint32_t`. The body is a single tagged value:
+ *
+ *     'i' int64 | 'u' uint64 | 'd' double | 't' | 'f' | 'n' (null)
+ *     's' uint32 size, bytes
+ *     'o' uint32 size, members (uint16 key size, key bytes, value)...
+ *     'a' uint32 size, values...
+ *
+ * where the container sizes count the bytes of their contents.
+ */
+typedef enum output_format {
+  OUTPUT_FORMAT_JSON = 0,
+  OUTPUT_FORMAT_BINARY = 1,
+} output_format;
+
+/*
+ * Growable byte buffer, reused across batches so that the steady state
+ * does not allocate. A zero-initialized buffer is empty.
+ */
+typedef struct byte_buffer {
+  char* data;
+  size_t size;
+  size_t capacity;
+} byte_buffer;
+
+static void byte_buffer_reserve(byte_buffer* const buffer, size_t const extra) {
+  if (buffer->size + extra <= buffer->capacity) {
+    return;
+  }
+
+  size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+  while (capacity < buffer->size + extra) {
+    capacity *= 2;
+  }
+  buffer->data = (char*)realloc(buffer->data, capacity);
+  FAIL_FAST_IF(!buffer->data);
+  buffer->capacity = capacity;
+}
+
+static void byte_buffer_append(byte_buffer* const buffer,
+                               const void* const data,
+                               size_t const size) {
+  byte_buffer_reserve(buffer, size);
+  memcpy(buffer->data + buffer->size, data, size);
+  buffer->size += size;
+}
+
+static void byte_buffer_append_char(byte_buffer* const buffer, char const c) {
+  byte_buffer_reserve(buffer, 1);
+  buffer->data[buffer->size++] = c;
+}
+
+static void byte_buffer_destroy(byte_buffer* const buffer) {
+  free(buffer->data);
+  memset(buffer, 0, sizeof(*buffer));
+}
+
+/*
+ * How arrays of bytes (unsigned integers of at most 8 bits) are written.
+ *
+ * BYTE_ARRAY_ENCODING_LIST writes them like any other array. The others
+ * write a single string, ending with "..." when the array is longer than
+ * the limit of the writer and only its first bytes are written.
+ */
+typedef enum byte_array_encoding {
+  BYTE_ARRAY_ENCODING_LIST = 0,
+  BYTE_ARRAY_ENCODING_HEX = 1,
+  BYTE_ARRAY_ENCODING_BASE64 = 2,
+} byte_array_encoding;
+
+#define EVENT_WRITER_MAX_DEPTH 64
+
+/*
+ * Streams one record at a time into `buffer` while the event fields are
+ * walked, without building an intermediate object tree.
+ *
+ * Each value takes a `key` (of size `key_len`) when written inside an
+ * object and a NULL `key` when written inside an array or at the root.
+ */
+typedef struct event_writer {
+  byte_buffer* buffer;
+  output_format format;
+  byte_array_encoding bytes;
+  uint64_t bytes_max; /* Bytes of a byte array written as a string, 0 for all */
+  uint32_t depth;
+  uint64_t has_members;                          /* JSON: one bit per nesting level */
+  size_t container_start[EVENT_WRITER_MAX_DEPTH]; /* Binary: offsets of the size fields */
+  size_t record_start;
+} event_writer;
+
+static void event_writer_init(event_writer* const writer,
+                              byte_buffer* const buffer,
+                              output_format const format) {
+  memset(writer, 0, sizeof(*writer));
+  writer->buffer = buffer;
+  writer->format = format;
+}
+
+static void write_json_string(byte_buffer* const buffer, const char* const str, size_t const len) {
+  static const char hex_chars[] = "0123456789abcdef";
+  size_t start = 0;
+
+  byte_buffer_reserve(buffer, len + 2);
+  byte_buffer_append_char(buffer, '"');
+  for (size_t pos = 0; pos < len; pos++) {
+    unsigned char const c = (unsigned char)str[pos];
+    char escaped[6];
+    size_t escaped_len = 2;
+
+    if (c >= ' ' && c != '"' && c != '\\') {
+      continue;
+    }
+
+    escaped[0] = '\\';
+    switch (c) {
+      case '\b':
+        escaped[1] = 'b';
+        break;
+      case '\n':
+        escaped[1] = 'n';
+        break;
+      case '\r':
+        escaped[1] = 'r';
+        break;
+      case '\t':
+        escaped[1] = 't';
+        break;
+      case '\f':
+        escaped[1] = 'f';
+        break;
+      case '"':
+      case '\\':
+        escaped[1] = (char)c;
+        break;
+      default:
+        memcpy(escaped + 1, "u00", 3);
+        escaped[4] = hex_chars[c >> 4];
+        escaped[5] = hex_chars[c & 0xf];
+        escaped_len = 6;
+        break;
+    }
+
+    byte_buffer_append(buffer, str + start, pos - start);
+    byte_buffer_append(buffer, escaped, escaped_len);
+    start = pos + 1;
+  }
+  byte_buffer_append(buffer, str + start, len - start);
+  byte_buffer_append_char(buffer, '"');
+}
+
+/*
+ * Writes the separator and the key preceding a value.
+ */
+static void write_key(event_writer* const writer, const char* const key, size_t const key_len) {
+  byte_buffer* const buffer = writer->buffer;
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    if (key) {
+      uint16_t const size = (uint16_t)key_len;
+      byte_buffer_append(buffer, &size, sizeof(size));
+      byte_buffer_append(buffer, key, size);
+    }
+    return;
+  }
+
+  if (writer->depth == 0) {
+    return;
+  }
+
+  uint64_t const level_bit = UINT64_C(1) << writer->depth;
+  if (writer->has_members & level_bit) {
+    byte_buffer_append(buffer, ", ", 2);
+  } else {
+    byte_buffer_append_char(buffer, ' ');
+    writer->has_members |= level_bit;
+  }
+
+  if (key) {
+    write_json_string(buffer, key, key_len);
+    byte_buffer_append(buffer, ": ", 2);
+  }
+}
+
+/*
+ * Returns the offset of the container value within the buffer.
+ */
+static size_t begin_container(event_writer* const writer,
+                              const char* const key,
+                              size_t const key_len,
+                              char const open) {
+  write_key(writer, key, key_len);
+  size_t const value_start = writer->buffer->size;
+  FAIL_FAST_IF(writer->depth + 1 >= EVENT_WRITER_MAX_DEPTH);
+  writer->depth++;
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    uint32_t const size = 0;
+    byte_buffer_append_char(writer->buffer, open == '{' ? 'o' : 'a');
+    writer->container_start[writer->depth] = writer->buffer->size;
+    byte_buffer_append(writer->buffer, &size, sizeof(size));
+  } else {
+    writer->has_members &= ~(UINT64_C(1) << writer->depth);
+    byte_buffer_append_char(writer->buffer, open);
+  }
+  return value_start;
+}
+
+static void end_container(event_writer* const writer, const char* const close) {
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    size_t const start = writer->container_start[writer->depth];
+    uint32_t const size = (uint32_t)(writer->buffer->size - start - sizeof(uint32_t));
+    memcpy(writer->buffer->data + start, &size, sizeof(size));
+  } else {
+    byte_buffer_append(writer->buffer, close, 2);
+  }
+  writer->depth--;
+}
+
+static void writer_begin_record(event_writer* const writer) {
+  writer->depth = 0;
+  writer->has_members = 0;
+  writer->record_start = writer->buffer->size;
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    uint32_t const size = 0;
+    byte_buffer_append(writer->buffer, &size, sizeof(size));
+  }
+}
+
+/*
+ * Completes the current record and returns its offset in the buffer.
+ */
+static size_t writer_end_record(event_writer* const writer) {
+  FAIL_FAST_IF(writer->depth != 0);
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    uint32_t const size =
+        (uint32_t)(writer->buffer->size - writer->record_start - sizeof(uint32_t));
+    memcpy(writer->buffer->data + writer->record_start, &size, sizeof(size));
+  }
+  return writer->record_start;
+}
+
+static size_t writer_begin_object(event_writer* const writer,
+                                  const char* const key,
+                                  size_t const key_len) {
+  return begin_container(writer, key, key_len, '{');
+}
+
+static void writer_end_object(event_writer* const writer) {
+  end_container(writer, " }");
+}
+
+static size_t writer_begin_array(event_writer* const writer,
+                                 const char* const key,
+                                 size_t const key_len) {
+  return begin_container(writer, key, key_len, '[');
+}
+
+static void writer_end_array(event_writer* const writer) {
+  end_container(writer, " ]");
+}
+
+/*
+ * Writes the decimal digits of `val`, two at a time, to `out`, which has
+ * room for 20 bytes, and returns their count: integers are most of what
+ * the events are made of.
+ */
+static size_t format_decimal(char* const out, uint64_t val) {
+  static const char pairs[201] =
+      "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+      "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+      "8081828384858687888990919293949596979899";
+  char digits[20];
+  char* start = digits + sizeof(digits);
+
+  while (val >= 100) {
+    unsigned const pair = (unsigned)(val % 100) * 2;
+    val /= 100;
+    start -= 2;
+    start[0] = pairs[pair];
+    start[1] = pairs[pair + 1];
+  }
+  if (val >= 10) {
+    start -= 2;
+    start[0] = pairs[val * 2];
+    start[1] = pairs[val * 2 + 1];
+  } else {
+    *--start = (char)('0' + val);
+  }
+  size_t const len = (size_t)(digits + sizeof(digits) - start);
+  memcpy(out, start, len);
+  return len;
+}
+
+static void append_decimal(byte_buffer* const buffer, uint64_t const val) {
+  byte_buffer_reserve(buffer, 20);
+  buffer->size += format_decimal(buffer->data + buffer->size, val);
+}
+
+static void writer_int64(event_writer* const writer,
+                         const char* const key,
+                         size_t const key_len,
+                         int64_t const val) {
+  write_key(writer, key, key_len);
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    byte_buffer_append_char(writer->buffer, 'i');
+    byte_buffer_append(writer->buffer, &val, sizeof(val));
+    return;
+  }
+
+  if (val < 0) {
+    byte_buffer_append_char(writer->buffer, '-');
+    append_decimal(writer->buffer, (uint64_t)0 - (uint64_t)val);
+  } else {
+    append_decimal(writer->buffer, (uint64_t)val);
+  }
+}
+
+static void writer_uint64(event_writer* const writer,
+                          const char* const key,
+                          size_t const key_len,
+                          uint64_t const val) {
+  write_key(writer, key, key_len);
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    byte_buffer_append_char(writer->buffer, 'u');
+    byte_buffer_append(writer->buffer, &val, sizeof(val));
+    return;
+  }
+
+  append_decimal(writer->buffer, val);
+}
+
+/*
+ * Writes the `count` values of `vals` as elements of the current array,
+ * as many writer_uint64() calls would, making room for all of them at
+ * once.
+ */
+static void writer_uint64_values(event_writer* const writer,
+                                 const uint64_t* const vals,
+                                 size_t const count) {
+  byte_buffer* const buffer = writer->buffer;
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    byte_buffer_reserve(buffer, count * (1 + sizeof(uint64_t)));
+    for (size_t i = 0; i < count; i++) {
+      buffer->data[buffer->size] = 'u';
+      memcpy(buffer->data + buffer->size + 1, &vals[i], sizeof(uint64_t));
+      buffer->size += 1 + sizeof(uint64_t);
+    }
+    return;
+  }
+
+  /* ", " and 20 digits per value */
+  byte_buffer_reserve(buffer, count * 22);
+  uint64_t const level_bit = UINT64_C(1) << writer->depth;
+  for (size_t i = 0; i < count; i++) {
+    if (writer->has_members & level_bit) {
+      memcpy(buffer->data + buffer->size, ", ", 2);
+      buffer->size += 2;
+    } else {
+      buffer->data[buffer->size++] = ' ';
+      writer->has_members |= level_bit;
+    }
+    buffer->size += format_decimal(buffer->data + buffer->size, vals[i]);
+  }
+}
+
+/*
+ * Signed counterpart of writer_uint64_values().
+ */
+static void writer_int64_values(event_writer* const writer,
+                                const int64_t* const vals,
+                                size_t const count) {
+  byte_buffer* const buffer = writer->buffer;
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    byte_buffer_reserve(buffer, count * (1 + sizeof(int64_t)));
+    for (size_t i = 0; i < count; i++) {
+      buffer->data[buffer->size] = 'i';
+      memcpy(buffer->data + buffer->size + 1, &vals[i], sizeof(int64_t));
+      buffer->size += 1 + sizeof(int64_t);
+    }
+    return;
+  }
+
+  /* ", ", the sign and 20 digits per value */
+  byte_buffer_reserve(buffer, count * 23);
+  uint64_t const level_bit = UINT64_C(1) << writer->depth;
+  for (size_t i = 0; i < count; i++) {
+    if (writer->has_members & level_bit) {
+      memcpy(buffer->data + buffer->size, ", ", 2);
+      buffer->size += 2;
+    } else {
+      buffer->data[buffer->size++] = ' ';
+      writer->has_members |= level_bit;
+    }
+    uint64_t magnitude = (uint64_t)vals[i];
+    if (vals[i] < 0) {
+      buffer->data[buffer->size++] = '-';
+      magnitude = (uint64_t)0 - magnitude;
+    }
+    buffer->size += format_decimal(buffer->data + buffer->size, magnitude);
+  }
+}
+
+static void writer_double(event_writer* const writer,
+                          const char* const key,
+                          size_t const key_len,
+                          double const val) {
+  write_key(writer, key, key_len);
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    byte_buffer_append_char(writer->buffer, 'd');
+    byte_buffer_append(writer->buffer, &val, sizeof(val));
+    return;
+  }
+
+  char digits[128];
+  int len;
+  if (isnan(val)) {
+    len = snprintf(digits, sizeof(digits), "NaN");
+  } else if (isinf(val)) {
+    len = snprintf(digits, sizeof(digits), val > 0 ? "Infinity" : "-Infinity");
+  } else {
+    len = snprintf(digits, sizeof(digits), "%.17g", val);
+
+    // Same as json-c: use a '.' decimal separator and keep a fraction
+    char* const comma = strchr(digits, ',');
+    if (comma) {
+      *comma = '.';
+    } else if (!strchr(digits, '.') && !strchr(digits, 'e')) {
+      memcpy(digits + len, ".0", 3);
+      len += 2;
+    }
+  }
+  byte_buffer_append(writer->buffer, digits, (size_t)len);
+}
+
+static void writer_bool(event_writer* const writer,
+                        const char* const key,
+                        size_t const key_len,
+                        bool const val) {
+  write_key(writer, key, key_len);
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    byte_buffer_append_char(writer->buffer, val ? 't' : 'f');
+  } else if (val) {
+    byte_buffer_append(writer->buffer, "true", 4);
+  } else {
+    byte_buffer_append(writer->buffer, "false", 5);
+  }
+}
+
+static void writer_null(event_writer* const writer, const char* const key, size_t const key_len) {
+  write_key(writer, key, key_len);
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    byte_buffer_append_char(writer->buffer, 'n');
+  } else {
+    byte_buffer_append(writer->buffer, "null", 4);
+  }
+}
+
+static void writer_string(event_writer* const writer,
+                          const char* const key,
+                          size_t const key_len,
+                          const char* const val,
+                          size_t const val_len) {
+  write_key(writer, key, key_len);
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    uint32_t const size = (uint32_t)val_len;
+    byte_buffer_append_char(writer->buffer, 's');
+    byte_buffer_append(writer->buffer, &size, sizeof(size));
+    byte_buffer_append(writer->buffer, val, val_len);
+  } else {
+    write_json_string(writer->buffer, val, val_len);
+  }
+}
+
+/*
+ * Writes a string value of `size` bytes, which the caller then stores at
+ * the returned address before writing anything else. The bytes must not
+ * need escaping in JSON.
+ */
+static char* writer_string_in_place(event_writer* const writer,
+                                    const char* const key,
+                                    size_t const key_len,
+                                    size_t const size) {
+  write_key(writer, key, key_len);
+  byte_buffer* const buffer = writer->buffer;
+
+  if (writer->format == OUTPUT_FORMAT_BINARY) {
+    uint32_t const size32 = (uint32_t)size;
+    byte_buffer_append_char(buffer, 's');
+    byte_buffer_append(buffer, &size32, sizeof(size32));
+    byte_buffer_reserve(buffer, size);
+    buffer->size += size;
+    return buffer->data + buffer->size - size;
+  }
+
+  byte_buffer_reserve(buffer, size + 2);
+  buffer->data[buffer->size] = '"';
+  buffer->data[buffer->size + size + 1] = '"';
+  buffer->size += size + 2;
+  return buffer->data + buffer->size - size - 1;
+}
+
+/*
+ * Returns the size of `count` bytes encoded in `encoding`, which is not
+ * BYTE_ARRAY_ENCODING_LIST.
+ */
+static size_t encoded_bytes_size(byte_array_encoding const encoding, uint64_t const count) {
+  return encoding == BYTE_ARRAY_ENCODING_HEX ? count * 2 : (count + 2) / 3 * 4;
+}
+
+/*
+ * Encodes the `count` bytes of `in` in `encoding` to `out`, and returns
+ * the size written. Base64 only pads the last bytes, when `count` is not
+ * a multiple of 3: the bytes of an array can be encoded in several calls
+ * as long as all of them but the last encode a multiple of 3.
+ */
+static size_t encode_bytes(byte_array_encoding const encoding,
+                           const uint8_t* const in,
+                           size_t const count,
+                           char* const out) {
+  static const char hex_chars[] = "0123456789abcdef";
+  static const char base64_chars[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  if (encoding == BYTE_ARRAY_ENCODING_HEX) {
+    for (size_t i = 0; i < count; i++) {
+      out[2 * i] = hex_chars[in[i] >> 4];
+      out[2 * i + 1] = hex_chars[in[i] & 0xf];
+    }
+    return count * 2;
+  }
+
+  size_t i = 0;
+  char* o = out;
+  for (; i + 3 <= count; i += 3, o += 4) {
+    uint32_t const group = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+    o[0] = base64_chars[group >> 18];
+    o[1] = base64_chars[(group >> 12) & 0x3f];
+    o[2] = base64_chars[(group >> 6) & 0x3f];
+    o[3] = base64_chars[group & 0x3f];
+  }
+  if (i < count) {
+    uint32_t const group = (uint32_t)in[i] << 16 | (i + 1 < count ? (uint32_t)in[i + 1] << 8 : 0);
+    o[0] = base64_chars[group >> 18];
+    o[1] = base64_chars[(group >> 12) & 0x3f];
+    o[2] = i + 1 < count ? base64_chars[(group >> 6) & 0x3f] : '=';
+    o[3] = '=';
+    o += 4;
+  }
+  return (size_t)(o - out);
+}
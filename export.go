@@ -0,0 +1,100 @@
+package main
+
+/*
+   #include <stdlib.h>
+   #include <ingest.h>
+*/
+import "C"
+
+import (
+	"fmt"
+	"math"
+	"strings"
+	"unsafe"
+
+	tea "github.com/charmbracelet/bubbletea"
+)
+
+// exportRequest is what to export from the event tables (see event_table.h).
+type exportRequest struct {
+	path     string
+	format   C.table_export_format
+	from, to int64  // Nanoseconds, inclusive
+	fields   string // Comma-separated field paths, all the fields if empty
+}
+
+// parseExportRequest parses `s`, `PATH [FROM..TO] [FIELD,...]`: the events are
+// written as CSV if PATH ends with `.csv`, else by column (see README.org). FROM
+// and TO are times as jumped to, `reference` giving the day of times of day, and
+// either side of the range may be left out.
+func parseExportRequest(s string, reference int64) (exportRequest, error) {
+	words := strings.Fields(s)
+	if len(words) == 0 {
+		return exportRequest{}, fmt.Errorf("missing file")
+	}
+
+	request := exportRequest{
+		path:   words[0],
+		format: C.TABLE_EXPORT_BINARY,
+		from:   math.MinInt64,
+		to:     math.MaxInt64,
+	}
+	if strings.HasSuffix(strings.ToLower(request.path), ".csv") {
+		request.format = C.TABLE_EXPORT_CSV
+	}
+
+	words = words[1:]
+	if len(words) > 0 {
+		if i := strings.Index(words[0], ".."); i >= 0 {
+			from, to := words[0][:i], words[0][i+2:]
+			var err error
+			if from != "" {
+				if request.from, err = parseJumpTime(from, reference); err != nil {
+					return exportRequest{}, err
+				}
+			}
+			if to != "" {
+				if request.to, err = parseJumpTime(to, reference); err != nil {
+					return exportRequest{}, err
+				}
+			}
+			words = words[1:]
+		}
+	}
+	request.fields = strings.Join(words, ",")
+	return request, nil
+}
+
+// exportDoneMsg indicates that an export is over, `status` telling how it went.
+type exportDoneMsg struct {
+	status string
+}
+
+// exportTable returns a command which writes the events `request` selects. The
+// ingestion threads wait until they are copied out.
+func exportTable(ingest *C.ingest, request exportRequest) tea.Cmd {
+	return func() tea.Msg {
+		if !ingestWaiters.Enter() {
+			return exportDoneMsg{"Cannot export: the ingestion is over"}
+		}
+		defer ingestWaiters.Leave()
+
+		path := C.CString(request.path)
+		defer C.free(unsafe.Pointer(path))
+		fields := C.CString(request.fields)
+		defer C.free(unsafe.Pointer(fields))
+
+		var cError [256]C.char
+		var dropped C.uint64_t
+		written := C.export_ingest_table(ingest, C.int64_t(request.from), C.int64_t(request.to),
+			fields, request.format, path, &dropped, &cError[0], C.size_t(len(cError)))
+		if written < 0 {
+			return exportDoneMsg{"Cannot export: " + C.GoString(&cError[0])}
+		}
+		status := fmt.Sprintf("Exported %d events to %s", int64(written), request.path)
+		if dropped > 0 {
+			status += fmt.Sprintf(" (%d strings dropped for lack of room)", uint64(dropped))
+		}
+		return exportDoneMsg{status}
+	}
+}
@@ -0,0 +1,88 @@
+package main
+
+import (
+	"sort"
+	"strings"
+
+	"github.com/charmbracelet/bubbles/list"
+)
+
+// eventFilter keeps the retained events whose name or payload contains a
+// query, ignoring the case of ASCII letters.
+//
+// The matches are kept up to date as events are appended and evicted, so
+// that the query is only resolved again when it changes.
+type eventFilter struct {
+	state list.FilterState // Whether the query is being edited or applied
+	query string           // Lowercase, empty when not filtering
+	items []list.Item      // Matching events, the oldest first
+}
+
+func matchesQuery(it item, query string) bool {
+	return indexFold([]byte(it.name), query) >= 0 || indexFold(it.payload, query) >= 0
+}
+
+// Active returns whether there is a query.
+func (f *eventFilter) Active() bool {
+	return f.query != ""
+}
+
+// SetQuery resolves `query` against the events of `store`, indexed by `index`.
+func (f *eventFilter) SetQuery(query string, store *eventStore, index *eventIndex) {
+	query = toLowerASCII(query)
+	previous := f.query
+	f.query = query
+
+	switch {
+	case query == "":
+		f.items = nil
+	case previous != "" && strings.Contains(query, previous):
+		// The query was extended: only the previous matches may still match
+		matches := f.items[:0:0]
+		for _, it := range f.items {
+			if matchesQuery(it.(item), query) {
+				matches = append(matches, it)
+			}
+		}
+		f.items = matches
+	default:
+		seqs, ok := index.Search(query, func(seq uint64) bool {
+			it, _ := store.Get(seq)
+			return indexFold(it.payload, query) >= 0
+		})
+		f.items = nil
+		if ok {
+			for _, seq := range seqs {
+				if it, ok := store.Get(seq); ok {
+					f.items = append(f.items, it)
+				}
+			}
+			return
+		}
+
+		// Too short for the index
+		for _, it := range store.Items() {
+			if matchesQuery(it.(item), query) {
+				f.items = append(f.items, it)
+			}
+		}
+	}
+}
+
+// Append adds `it`, the newest event, to the matches if it matches.
+func (f *eventFilter) Append(it item) {
+	if f.Active() && matchesQuery(it, f.query) {
+		f.items = append(f.items, it)
+	}
+}
+
+// Evict drops the matches older than `oldest`.
+func (f *eventFilter) Evict(oldest uint64) {
+	first := sort.Search(len(f.items), func(i int) bool { return f.items[i].(item).seq >= oldest })
+	f.items = f.items[first:]
+
+	// Let the memory of the evicted matches go once it dominates
+	if first > 0 && cap(f.items) > 2*len(f.items)+1024 {
+		f.items = append([]list.Item(nil), f.items...)
+	}
+}
@@ -6,7 +6,6 @@ require (
 	github.com/charmbracelet/bubbles v0.9.0
 	github.com/charmbracelet/bubbletea v0.19.2
 	github.com/charmbracelet/lipgloss v0.4.0
-	github.com/goccy/go-json v0.8.1
 	github.com/muesli/reflow v0.3.0
 )
 
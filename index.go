@@ -0,0 +1,208 @@
+package main
+
+import "sort"
+
+// eventIndex finds the retained events whose name or payload contains some
+// text without going through all of them. It is maintained as the events are
+// appended and evicted.
+//
+// Events are referred to by sequence number. Each posting list holds the
+// sequence numbers of its events in ascending order, so that appending is
+// cheap and evicted events are a prefix, trimmed once enough of them piled up.
+type eventIndex struct {
+	names    map[string][]uint64 // Events of each event name
+	trigrams map[uint32][]uint64 // Events whose lowercase payload contains each trigram
+
+	oldest  uint64 // Sequence number of the oldest retained event
+	newest  uint64 // Sequence number of the newest indexed event, plus one
+	evicted uint64 // Evicted since the last compaction
+}
+
+func newEventIndex() *eventIndex {
+	return &eventIndex{
+		names:    make(map[string][]uint64),
+		trigrams: make(map[uint32][]uint64),
+	}
+}
+
+func trigramAt(text []byte, i int) uint32 {
+	return uint32(lowerASCII(text[i]))<<16 | uint32(lowerASCII(text[i+1]))<<8 |
+		uint32(lowerASCII(text[i+2]))
+}
+
+// Add indexes `it`, whose sequence number must be greater than the ones of
+// all the events indexed so far. It returns the bytes of the postings added,
+// up to 8 per byte of payload, which stay until the event is evicted.
+func (x *eventIndex) Add(it item) uint32 {
+	x.names[it.name] = append(x.names[it.name], it.seq)
+	postings := uint32(1)
+
+	for i := 0; i+3 <= len(it.payload); i++ {
+		trigram := trigramAt(it.payload, i)
+		seqs := x.trigrams[trigram]
+		// Index each trigram of an event once
+		if len(seqs) == 0 || seqs[len(seqs)-1] != it.seq {
+			x.trigrams[trigram] = append(seqs, it.seq)
+			postings++
+		}
+	}
+	x.newest = it.seq + 1
+	return postings * 8
+}
+
+// Evict drops the events older than `oldest` from the index.
+func (x *eventIndex) Evict(oldest uint64) {
+	if oldest <= x.oldest {
+		return
+	}
+	x.evicted += oldest - x.oldest
+	x.oldest = oldest
+
+	// Compact once the evicted events outnumber the retained ones, which
+	// keeps the cost of compacting constant per event
+	if x.evicted >= x.newest-x.oldest {
+		x.compactNames()
+		x.compactTrigrams()
+		x.evicted = 0
+	}
+}
+
+func (x *eventIndex) trim(seqs []uint64) []uint64 {
+	first := sort.Search(len(seqs), func(i int) bool { return seqs[i] >= x.oldest })
+	if first == 0 {
+		return seqs
+	}
+	if first == len(seqs) {
+		return nil
+	}
+	// Copy to let the memory of the evicted prefix go
+	return append([]uint64(nil), seqs[first:]...)
+}
+
+func (x *eventIndex) compactNames() {
+	for name, seqs := range x.names {
+		if seqs = x.trim(seqs); seqs == nil {
+			delete(x.names, name)
+		} else {
+			x.names[name] = seqs
+		}
+	}
+}
+
+func (x *eventIndex) compactTrigrams() {
+	for trigram, seqs := range x.trigrams {
+		if seqs = x.trim(seqs); seqs == nil {
+			delete(x.trigrams, trigram)
+		} else {
+			x.trigrams[trigram] = seqs
+		}
+	}
+}
+
+// Search returns, in ascending order, the sequence numbers of the retained
+// events whose name contains the lowercase `query`, along with the candidates
+// whose payload may contain it, which `matchPayload` confirms or not.
+//
+// It returns false if `query` is too short to use the index.
+func (x *eventIndex) Search(query string, matchPayload func(seq uint64) bool) ([]uint64, bool) {
+	if len(query) < 3 {
+		return nil, false
+	}
+
+	var byName [][]uint64
+	for name, seqs := range x.names {
+		if indexFold([]byte(name), query) >= 0 {
+			byName = append(byName, seqs)
+		}
+	}
+
+	// Intersect the posting lists of all the trigrams of the query, the
+	// shortest first
+	var lists [][]uint64
+	for i := 0; i+3 <= len(query); i++ {
+		seqs, ok := x.trigrams[trigramAt([]byte(query), i)]
+		if !ok {
+			lists = nil
+			break
+		}
+		lists = append(lists, seqs)
+	}
+	sort.Slice(lists, func(i, j int) bool { return len(lists[i]) < len(lists[j]) })
+
+	var byPayload []uint64
+	if len(lists) > 0 {
+		for _, seq := range lists[0] {
+			if seq >= x.oldest && containsAll(lists[1:], seq) && matchPayload(seq) {
+				byPayload = append(byPayload, seq)
+			}
+		}
+	}
+
+	return x.union(append(byName, byPayload)), true
+}
+
+func containsAll(lists [][]uint64, seq uint64) bool {
+	for _, seqs := range lists {
+		i := sort.Search(len(seqs), func(i int) bool { return seqs[i] >= seq })
+		if i == len(seqs) || seqs[i] != seq {
+			return false
+		}
+	}
+	return true
+}
+
+// union merges the retained events of the ascending `lists`.
+func (x *eventIndex) union(lists [][]uint64) []uint64 {
+	var seqs []uint64
+	for _, list := range lists {
+		for _, seq := range list {
+			if seq >= x.oldest {
+				seqs = append(seqs, seq)
+			}
+		}
+	}
+	if len(lists) <= 1 {
+		return seqs
+	}
+
+	sort.Slice(seqs, func(i, j int) bool { return seqs[i] < seqs[j] })
+	unique := seqs[:0]
+	for _, seq := range seqs {
+		if len(unique) == 0 || seq != unique[len(unique)-1] {
+			unique = append(unique, seq)
+		}
+	}
+	return unique
+}
+
+// toLowerASCII returns `s` with its ASCII letters in lowercase, which is the
+// case the index and the matching functions ignore.
+func toLowerASCII(s string) string {
+	lower := []byte(s)
+	for i, c := range lower {
+		lower[i] = lowerASCII(c)
+	}
+	return string(lower)
+}
+
+func lowerASCII(c byte) byte {
+	if 'A' <= c && c <= 'Z' {
+		return c + 'a' - 'A'
+	}
+	return c
+}
+
+// indexFold returns the index of the first occurrence of the lowercase
+// `needle` in `haystack`, ignoring the case of ASCII letters, or -1.
+func indexFold(haystack []byte, needle string) int {
+	for i := 0; i+len(needle) <= len(haystack); i++ {
+		j := 0
+		for j < len(needle) && lowerASCII(haystack[i+j]) == needle[j] {
+			j++
+		}
+		if j == len(needle) {
+			return i
+		}
+	}
+	return -1
+}
@@ -0,0 +1,165 @@
+package main
+
+import (
+	"fmt"
+	"reflect"
+	"testing"
+
+	"github.com/charmbracelet/bubbles/list"
+)
+
+// testItem returns the event `seq` named `name`, whose payload renders as
+// `payload` within its record.
+func testItem(seq uint64, name, payload string) item {
+	prefix := `{ "name": "` + name + `", "payload": `
+	record := []byte(prefix + payload + " }")
+	return item{
+		seq:           seq,
+		name:          name,
+		timestamp:     int64(seq) * 1000,
+		record:        record,
+		payload:       record[len(prefix) : len(prefix)+len(payload)],
+		payloadOffset: uint32(len(prefix)),
+	}
+}
+
+// testModel holds the events the way the model does.
+type testModel struct {
+	store  *eventStore
+	index  *eventIndex
+	filter *eventFilter
+}
+
+func newTestModel(r retention) *testModel {
+	return &testModel{newEventStore(r), newEventIndex(), &eventFilter{}}
+}
+
+// append adds `its` as a batch, as model.appendBatch() does.
+func (m *testModel) append(its ...item) {
+	for _, it := range its {
+		it.indexBytes = m.index.Add(it)
+		m.store.Append(it)
+		m.filter.Append(it)
+	}
+	oldest := m.store.OldestSeq()
+	m.index.Evict(oldest)
+	m.filter.Evict(oldest)
+}
+
+func seqsOf(items []list.Item) []uint64 {
+	var seqs []uint64
+	for _, it := range items {
+		seqs = append(seqs, it.(item).seq)
+	}
+	return seqs
+}
+
+// scanSeqs returns the retained events matching `query` by going through all
+// of them, which is what the index must agree with.
+func scanSeqs(store *eventStore, query string) []uint64 {
+	var seqs []uint64
+	for _, it := range store.Items() {
+		if matchesQuery(it.(item), toLowerASCII(query)) {
+			seqs = append(seqs, it.(item).seq)
+		}
+	}
+	return seqs
+}
+
+func workerItem(seq uint64) item {
+	name := "sched_switch"
+	if seq%3 == 0 {
+		name = "irq_handler_entry"
+	}
+	return testItem(seq, name, fmt.Sprintf(`{ "comm": "Worker-%d" }`, seq))
+}
+
+func TestIndexSearchAfterEvictions(t *testing.T) {
+	const retained = 10
+	m := newTestModel(retention{count: retained})
+	for seq := uint64(0); seq < 1000; seq++ {
+		m.append(workerItem(seq))
+	}
+
+	queries := []string{"worker-99", "worker-1", "WORKER-995", "switch", "irq", "comm", "nothing"}
+	for _, query := range queries {
+		lower := toLowerASCII(query)
+		seqs, ok := m.index.Search(lower, func(seq uint64) bool {
+			it, _ := m.store.Get(seq)
+			return indexFold(it.payload, lower) >= 0
+		})
+		if !ok {
+			t.Fatalf("Search(%q) did not use the index", query)
+		}
+		if want := scanSeqs(m.store, query); !reflect.DeepEqual(seqs, want) {
+			t.Errorf("Search(%q) = %v, want %v", query, seqs, want)
+		}
+	}
+}
+
+func TestIndexCompaction(t *testing.T) {
+	const retained = 10
+	m := newTestModel(retention{count: retained})
+	for seq := uint64(0); seq < 1000; seq++ {
+		m.append(workerItem(seq))
+
+		// Compacting once the evicted events outnumber the retained ones
+		// leaves fewer evicted postings than retained events
+		postings := 0
+		for _, seqs := range m.index.names {
+			postings += len(seqs)
+		}
+		if postings >= 2*retained {
+			t.Fatalf("after event %d: %d name postings for %d retained events", seq, postings,
+				m.store.Len())
+		}
+	}
+
+	oldest := m.store.OldestSeq()
+	for trigram, seqs := range m.index.trigrams {
+		if len(seqs) > 0 && seqs[len(seqs)-1] < oldest-retained {
+			t.Errorf("trigram %06x only has evicted events: %v", trigram, seqs)
+		}
+	}
+}
+
+func TestFilterQuery(t *testing.T) {
+	m := newTestModel(retention{count: 100})
+	for seq := uint64(0); seq < 300; seq++ {
+		m.append(workerItem(seq))
+	}
+
+	// Extending the query only goes through the previous matches, then a
+	// shorter query goes through the index again, then one too short for it
+	queries := []string{"worker-2", "worker-25", "Worker-251", "worker-2", "wo", "Kernel"}
+	for _, query := range queries {
+		m.filter.SetQuery(query, m.store, m.index)
+		seqs, want := seqsOf(m.filter.items), scanSeqs(m.store, query)
+		if !reflect.DeepEqual(seqs, want) {
+			t.Errorf("SetQuery(%q) matches %v, want %v", query, seqs, want)
+		}
+	}
+}
+
+func TestFilterAppendAndEvict(t *testing.T) {
+	m := newTestModel(retention{count: 50})
+	for seq := uint64(0); seq < 100; seq++ {
+		m.append(workerItem(seq))
+	}
+	m.filter.SetQuery("worker-1", m.store, m.index)
+	m.filter.SetQuery("worker-12", m.store, m.index)
+
+	// The matches of an applied query follow the events appended and evicted
+	for seq := uint64(100); seq < 200; seq += 10 {
+		batch := make([]item, 10)
+		for i := range batch {
+			batch[i] = workerItem(seq + uint64(i))
+		}
+		m.append(batch...)
+
+		seqs, want := seqsOf(m.filter.items), scanSeqs(m.store, "worker-12")
+		if !reflect.DeepEqual(seqs, want) {
+			t.Fatalf("after event %d: matches %v, want %v", seq+9, seqs, want)
+		}
+	}
+}
@@ -0,0 +1,1291 @@
+#pragma once
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <babeltrace2/babeltrace.h>
+
+#include "event_batch.h"
+#include "fail_fast_if.h"
+#include "read_live_stream.h"
+
+/*
+ * Bounds of the pause between two bt_graph_run_once() calls while the
+ * source has nothing new, doubled on every consecutive empty run.
+ */
+#define INGEST_IDLE_SLEEP_MIN_NS 1000000LL   /* 1 ms */
+#define INGEST_IDLE_SLEEP_MAX_NS 100000000LL /* 100 ms */
+
+/*
+ * Bounds of the pause before rebuilding the graph of live sessions once
+ * it failed, doubled on every consecutive failure.
+ */
+#define INGEST_RECONNECT_MIN_NS 250000000LL   /* 250 ms */
+#define INGEST_RECONNECT_MAX_NS 30000000000LL /* 30 s */
+
+/*
+ * Batches each offline worker may decode ahead of the merge, and records
+ * per merged batch.
+ */
+#define INGEST_WORKER_RING_CAPACITY 4
+#define INGEST_MERGE_BATCH_RECORDS 4096
+
+/*
+ * Bounded single-producer ring of batches.
+ *
+ * `tail` is only written by the producer. `head` is advanced with a
+ * compare-and-swap so that, besides the consumer, the producer can pop
+ * the oldest batch to make room (OVERFLOW_POLICY_DROP_OLDEST). Pushing
+ * and popping never take a lock.
+ */
+typedef struct batch_ring {
+  event_batch** slots;
+  uint64_t capacity; /* Power of two */
+  uint64_t head;     /* Next slot to pop */
+  uint64_t tail;     /* Next slot to push */
+} batch_ring;
+
+static void init_batch_ring(batch_ring* const ring, uint64_t const min_capacity) {
+  ring->capacity = 1;
+  while (ring->capacity < min_capacity) {
+    ring->capacity *= 2;
+  }
+  ring->slots = (event_batch**)calloc(ring->capacity, sizeof(event_batch*));
+  FAIL_FAST_IF(!ring->slots);
+  ring->head = 0;
+  ring->tail = 0;
+}
+
+static bool batch_ring_is_empty(batch_ring* const ring) {
+  return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ==
+         __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+static bool batch_ring_is_full(batch_ring* const ring) {
+  return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) -
+             __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) ==
+         ring->capacity;
+}
+
+/*
+ * Producer side: returns false, leaving `batch` to the caller, if the
+ * ring is full.
+ */
+static bool batch_ring_push(batch_ring* const ring, event_batch* const batch) {
+  uint64_t const tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+  if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->capacity) {
+    return false;
+  }
+
+  ring->slots[tail & (ring->capacity - 1)] = batch;
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/*
+ * Returns the oldest batch, or NULL if the ring is empty.
+ */
+static event_batch* batch_ring_pop(batch_ring* const ring) {
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+  for (;;) {
+    if (head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) {
+      return NULL;
+    }
+
+    /*
+     * The slot cannot be reused before `head` moves past it, so the batch
+     * read here is the right one if the compare-and-swap succeeds.
+     */
+    event_batch* const batch = ring->slots[head & (ring->capacity - 1)];
+    if (__atomic_compare_exchange_n(&ring->head, &head, head + 1, false, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+      return batch;
+    }
+  }
+}
+
+/*
+ * What the ingestion thread does with a new batch while the ring is full.
+ */
+typedef enum overflow_policy {
+  OVERFLOW_POLICY_BLOCK = 0,       /* Wait for a free slot, holding the graph back */
+  OVERFLOW_POLICY_DROP_OLDEST = 1, /* Drop the oldest published batch */
+  OVERFLOW_POLICY_DROP_NEWEST = 2, /* Drop the new batch */
+  OVERFLOW_POLICY_SAMPLE = 3,      /* Keep one event out of N, then wait for a free slot */
+} overflow_policy;
+
+#define OVERFLOW_POLICY_COUNT 4
+
+/*
+ * What was not delivered because of the overflow policy, by the policy
+ * which dropped it, and how long the graph was held back waiting for a
+ * free slot (OVERFLOW_POLICY_BLOCK and OVERFLOW_POLICY_SAMPLE).
+ */
+typedef struct ingest_loss {
+  uint64_t events[OVERFLOW_POLICY_COUNT];
+  uint64_t bytes[OVERFLOW_POLICY_COUNT]; /* Size of the dropped renderings */
+  uint64_t blocked_batches;              /* Published only once a slot was freed */
+  uint64_t blocked_ns;
+} ingest_loss;
+
+/*
+ * Boxes a filter, which may be NULL, so that handing it over is a single
+ * pointer exchange.
+ */
+typedef struct filter_update {
+  event_filter* filter;
+} filter_update;
+
+static void destroy_filter_update(filter_update* const update) {
+  if (update) {
+    destroy_event_filter(update->filter);
+    free(update);
+  }
+}
+
+typedef enum ingest_state {
+  INGEST_STATE_RUNNING = 0,
+  INGEST_STATE_ENDED = 1,  /* The source has no more messages */
+  INGEST_STATE_FAILED = 2, /* The graph returned an error */
+} ingest_state;
+
+typedef enum ingest_connection_state {
+  INGEST_CONNECTION_CONNECTING = 0, /* The graph is being built or has no messages yet */
+  INGEST_CONNECTION_CONNECTED = 1,
+  INGEST_CONNECTION_WAITING = 2, /* The graph failed: waiting to build it again */
+} ingest_connection_state;
+
+/*
+ * Where the graph of live sessions is in connecting to the relay daemon.
+ * A trace directory is always connected.
+ */
+typedef struct ingest_connection {
+  ingest_connection_state state;
+  uint32_t failures;   /* Consecutive failed graphs */
+  int64_t retry_ns;    /* Pause before the next graph, when waiting */
+  uint64_t generation; /* Incremented on every change */
+} ingest_connection;
+
+struct ingest;
+
+/*
+ * A trace processing graph run on its own thread.
+ *
+ * The worker loops on run_graph_once() and publishes every non-empty
+ * batch into `ring`: the ring of its ingest when reading live sessions,
+ * or its own ring, which the merging thread drains, when reading a trace
+ * directory.
+ *
+ * The graph of live sessions is built by the worker itself, and built
+ * again whenever it fails (see worker_thread()).
+ */
+typedef struct ingest_worker {
+  struct ingest* ingest;
+  struct relay_data relay_data;
+  bt_graph* graph;
+  bt_interrupter* interrupter; /* Added to every graph of the worker */
+  batch_ring* ring;
+  batch_ring own_ring;
+
+  /* Filter handed over by ingest_set_filter(), not installed yet */
+  filter_update* filter_update;
+
+  pthread_t thread;
+  bool started;
+  ingest_state state; /* Guarded by the lock of `ingest` */
+} ingest_worker;
+
+/*
+ * Runs the trace processing graphs on their own threads.
+ *
+ * Batches are published into `ring`, applying the overflow policy while
+ * it is full. The consumer pulls the batches at its own pace with
+ * ingest_pop(), and can sleep in ingest_wait() until there is something
+ * to pull.
+ *
+ * Live sessions are read by a single worker. A trace directory is read
+ * by several workers decoding disjoint groups of data streams in
+ * parallel, and a merging thread interleaves their records by timestamp
+ * into `ring` (see merge_thread()).
+ *
+ * `lock` and `cond` are only used to sleep and wake up: `cond` is
+ * broadcast whenever a batch is pushed or popped and when a state
+ * changes.
+ */
+typedef struct ingest {
+  ingest_worker* workers;
+  uint32_t worker_count;
+  batch_ring ring;
+
+  /* Traces of the events of all the workers */
+  trace_registry traces;
+
+  overflow_policy overflow_policy;
+  uint64_t sample_interval; /* N of OVERFLOW_POLICY_SAMPLE */
+  uint64_t sample_sequence;
+  ingest_loss loss; /* Updated atomically: read with get_ingest_loss() */
+
+  /* Offline only: merging thread and storage of the merged batches */
+  pthread_t merge_thread;
+  bool merge_started;
+  batch_pool merged_batches;
+  timestamp_formatter merged_timestamps; /* DELTA and ELAPSED, relative to the merged order */
+
+  /* Histograms of the workers merged by get_ingest_field_stats(), allocated on first use */
+  event_stats_histogram* merged_histograms;
+
+  /* Live only: URLs of the sessions the worker builds its graphs from */
+  char** urls;
+  uint64_t url_count;
+
+  bool stop;
+  ingest_state state;
+  ingest_connection connection;
+  char error[256]; /* Why the graph of a worker cannot be built, if so (see get_ingest_error()) */
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} ingest;
+
+static void notify_ingest(ingest* const ingest) {
+  pthread_mutex_lock(&ingest->lock);
+  pthread_cond_broadcast(&ingest->cond);
+  pthread_mutex_unlock(&ingest->lock);
+}
+
+static void set_ingest_state(ingest* const ingest, ingest_state const state) {
+  pthread_mutex_lock(&ingest->lock);
+  ingest->state = state;
+  pthread_cond_broadcast(&ingest->cond);
+  pthread_mutex_unlock(&ingest->lock);
+}
+
+/*
+ * Records `error` as the reason why the ingestion fails.
+ */
+static void set_ingest_error(ingest* const ingest, const char* const error) {
+  pthread_mutex_lock(&ingest->lock);
+  snprintf(ingest->error, sizeof(ingest->error), "%s", error);
+  pthread_mutex_unlock(&ingest->lock);
+}
+
+/*
+ * Copies why the ingestion failed, if it is known, into `error`, which
+ * is left empty otherwise.
+ */
+static void get_ingest_error(ingest* const ingest, char* const error, size_t const error_size) {
+  pthread_mutex_lock(&ingest->lock);
+  snprintf(error, error_size, "%s", ingest->error);
+  pthread_mutex_unlock(&ingest->lock);
+}
+
+/*
+ * Moves the connection of `ingest` to `state`, pausing `retry_ns` before
+ * the next graph if waiting.
+ */
+static void set_ingest_connection(ingest* const ingest,
+                                  ingest_connection_state const state,
+                                  int64_t const retry_ns) {
+  pthread_mutex_lock(&ingest->lock);
+  if (state == INGEST_CONNECTION_CONNECTED) {
+    ingest->connection.failures = 0;
+  } else if (state == INGEST_CONNECTION_WAITING) {
+    ingest->connection.failures++;
+  }
+  ingest->connection.state = state;
+  ingest->connection.retry_ns = retry_ns;
+  ingest->connection.generation++;
+  pthread_cond_broadcast(&ingest->cond);
+  pthread_mutex_unlock(&ingest->lock);
+}
+
+static void set_worker_state(ingest_worker* const worker, ingest_state const state) {
+  pthread_mutex_lock(&worker->ingest->lock);
+  worker->state = state;
+  pthread_cond_broadcast(&worker->ingest->cond);
+  pthread_mutex_unlock(&worker->ingest->lock);
+}
+
+static ingest_state get_worker_state(ingest_worker* const worker) {
+  pthread_mutex_lock(&worker->ingest->lock);
+  ingest_state const state = worker->state;
+  pthread_mutex_unlock(&worker->ingest->lock);
+  return state;
+}
+
+static bool ingest_should_stop(ingest* const ingest) {
+  return __atomic_load_n(&ingest->stop, __ATOMIC_ACQUIRE);
+}
+
+static void add_ingest_loss(ingest* const ingest, uint64_t const events, uint64_t const bytes) {
+  overflow_policy const policy = ingest->overflow_policy;
+  __atomic_fetch_add(&ingest->loss.events[policy], events, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&ingest->loss.bytes[policy], bytes, __ATOMIC_RELAXED);
+}
+
+/*
+ * Drops `batch` as a whole, accounting for its events.
+ */
+static void drop_batch(ingest* const ingest, event_batch* const batch) {
+  add_ingest_loss(ingest, batch->count, batch->arena.size);
+  release_batch(batch);
+}
+
+/*
+ * Pushes `batch` into `ring`, waiting for a free slot. Returns false,
+ * having released `batch`, if the ingestion was stopped meanwhile.
+ */
+static bool push_batch_or_wait(ingest* const ingest,
+                               batch_ring* const ring,
+                               event_batch* const batch) {
+  while (!batch_ring_push(ring, batch)) {
+    pthread_mutex_lock(&ingest->lock);
+    while (batch_ring_is_full(ring) && !ingest_should_stop(ingest)) {
+      pthread_cond_wait(&ingest->cond, &ingest->lock);
+    }
+    pthread_mutex_unlock(&ingest->lock);
+
+    if (ingest_should_stop(ingest)) {
+      release_batch(batch);
+      return false;
+    }
+  }
+
+  notify_ingest(ingest);
+  return true;
+}
+
+/*
+ * Publishes `batch` into the ring of `ingest`, applying its overflow
+ * policy while the ring is full. Returns false, having released `batch`,
+ * if the ingestion was stopped meanwhile.
+ */
+static bool publish_batch(ingest* const ingest, event_batch* const batch) {
+  switch (ingest->overflow_policy) {
+    case OVERFLOW_POLICY_DROP_OLDEST:
+      while (!batch_ring_push(&ingest->ring, batch)) {
+        event_batch* const oldest = batch_ring_pop(&ingest->ring);
+        if (oldest) {
+          drop_batch(ingest, oldest);
+        }
+      }
+      notify_ingest(ingest);
+      return true;
+    case OVERFLOW_POLICY_DROP_NEWEST:
+      if (batch_ring_push(&ingest->ring, batch)) {
+        notify_ingest(ingest);
+      } else {
+        drop_batch(ingest, batch);
+      }
+      return true;
+    case OVERFLOW_POLICY_SAMPLE:
+      if (batch_ring_is_full(&ingest->ring)) {
+        uint64_t const count = batch->count;
+        uint64_t const bytes =
+            sample_batch(batch, ingest->sample_interval, &ingest->sample_sequence);
+        add_ingest_loss(ingest, count - batch->count, bytes);
+
+        if (batch->count == 0) {
+          release_batch(batch);
+          return true;
+        }
+      }
+      break;
+    case OVERFLOW_POLICY_BLOCK:
+      break;
+  }
+
+  if (!batch_ring_is_full(&ingest->ring)) {
+    return push_batch_or_wait(ingest, &ingest->ring, batch);
+  }
+
+  int64_t const wait_start_ns = monotonic_ns();
+  bool const published = push_batch_or_wait(ingest, &ingest->ring, batch);
+  __atomic_fetch_add(&ingest->loss.blocked_batches, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&ingest->loss.blocked_ns, (uint64_t)(monotonic_ns() - wait_start_ns),
+                     __ATOMIC_RELAXED);
+  return published;
+}
+
+static void sleep_ns(long long const ns) {
+  struct timespec const duration = {(time_t)(ns / 1000000000LL), (long)(ns % 1000000000LL)};
+  nanosleep(&duration, NULL);
+}
+
+/*
+ * Sleeps for `ns` nanoseconds, or until the ingestion is stopped.
+ */
+static void sleep_unless_stopped(ingest* const ingest, long long const ns) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += (time_t)(ns / 1000000000LL);
+  deadline.tv_nsec += (long)(ns % 1000000000LL);
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&ingest->lock);
+  while (!ingest_should_stop(ingest) &&
+         pthread_cond_timedwait(&ingest->cond, &ingest->lock, &deadline) != ETIMEDOUT) {
+  }
+  pthread_mutex_unlock(&ingest->lock);
+}
+
+/*
+ * Builds the graph of the live sessions of `worker`. Returns false, the
+ * reason being recorded (see get_ingest_error()), if it cannot be built,
+ * which retrying would not change.
+ */
+static bool build_worker_graph(ingest_worker* const worker) {
+  ingest* const ingest = worker->ingest;
+  char error[256] = "";
+
+  worker->graph = create_graph((const char* const*)ingest->urls, ingest->url_count,
+                               &worker->relay_data, error, sizeof(error));
+  if (worker->graph &&
+      bt_graph_add_interrupter(worker->graph, worker->interrupter) !=
+          BT_GRAPH_ADD_INTERRUPTER_STATUS_OK) {
+    snprintf(error, sizeof(error), "Failed to add the interrupter.");
+    BT_GRAPH_PUT_REF_AND_RESET(worker->graph);
+  }
+  if (!worker->graph) {
+    set_ingest_error(ingest, error);
+  }
+  return worker->graph != NULL;
+}
+
+/*
+ * Drops the failed graph of the live sessions of `worker` and waits
+ * before it is built again, longer after each consecutive failure. The
+ * counters of the events are kept, and so are, on the consumer side, the
+ * events published so far.
+ */
+static void drop_worker_graph(ingest_worker* const worker, long long* const reconnect_ns) {
+  ingest* const ingest = worker->ingest;
+
+  BT_GRAPH_PUT_REF_AND_RESET(worker->graph);
+  reset_relay_data(&worker->relay_data);
+  bt_current_thread_clear_error();
+
+  set_ingest_connection(ingest, INGEST_CONNECTION_WAITING, *reconnect_ns);
+  sleep_unless_stopped(ingest, *reconnect_ns);
+  *reconnect_ns = *reconnect_ns * 2 > INGEST_RECONNECT_MAX_NS ? INGEST_RECONNECT_MAX_NS
+                                                               : *reconnect_ns * 2;
+  if (!ingest_should_stop(ingest)) {
+    set_ingest_connection(ingest, INGEST_CONNECTION_CONNECTING, 0);
+  }
+}
+
+static void* worker_thread(void* const data) {
+  ingest_worker* const worker = (ingest_worker*)data;
+  ingest* const ingest = worker->ingest;
+  long long idle_sleep_ns = INGEST_IDLE_SLEEP_MIN_NS;
+  long long reconnect_ns = INGEST_RECONNECT_MIN_NS;
+  bool connected = worker->graph != NULL;
+
+  while (!ingest_should_stop(ingest)) {
+    if (!worker->graph && !build_worker_graph(worker)) {
+      set_ingest_state(ingest, INGEST_STATE_FAILED);
+      break;
+    }
+
+    filter_update* const update =
+        __atomic_exchange_n(&worker->filter_update, NULL, __ATOMIC_ACQ_REL);
+    if (update) {
+      set_relay_filter(&worker->relay_data, update->filter);
+      free(update);
+    }
+
+    event_batch* const batch = run_graph_once(worker->graph, &worker->relay_data);
+
+    bt_graph_run_once_status const status = worker->relay_data.status;
+    if (!connected && (status == BT_GRAPH_RUN_ONCE_STATUS_OK ||
+                       status == BT_GRAPH_RUN_ONCE_STATUS_AGAIN)) {
+      /* The live source reached the relay daemon */
+      connected = true;
+      reconnect_ns = INGEST_RECONNECT_MIN_NS;
+      set_ingest_connection(ingest, INGEST_CONNECTION_CONNECTED, 0);
+    }
+
+    if (!batch) {
+      if (ingest->urls && status == BT_GRAPH_RUN_ONCE_STATUS_ERROR &&
+          !ingest_should_stop(ingest)) {
+        /* Lost the relay daemon, or never reached it: build the graph again */
+        connected = false;
+        drop_worker_graph(worker, &reconnect_ns);
+        continue;
+      }
+
+      if (status == BT_GRAPH_RUN_ONCE_STATUS_AGAIN) {
+        /* Nothing new: back off instead of spinning */
+        sleep_ns(idle_sleep_ns);
+        idle_sleep_ns = idle_sleep_ns * 2 > INGEST_IDLE_SLEEP_MAX_NS ? INGEST_IDLE_SLEEP_MAX_NS
+                                                                     : idle_sleep_ns * 2;
+        continue;
+      }
+
+      ingest_state const state = status == BT_GRAPH_RUN_ONCE_STATUS_END
+                                     ? INGEST_STATE_ENDED
+                                     : INGEST_STATE_FAILED;
+      if (worker->ring == &ingest->ring) {
+        set_ingest_state(ingest, state);
+      } else {
+        set_worker_state(worker, state);
+      }
+      break;
+    }
+
+    idle_sleep_ns = INGEST_IDLE_SLEEP_MIN_NS;
+
+    if (batch->count == 0) {
+      release_batch(batch);
+    } else if (worker->ring == &ingest->ring) {
+      if (!publish_batch(ingest, batch)) {
+        break;
+      }
+    } else if (!push_batch_or_wait(ingest, worker->ring, batch)) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Where the merging thread is in the output of a worker.
+ */
+typedef struct merge_cursor {
+  event_batch* batch; /* NULL once the worker is done */
+  uint64_t next;      /* Next record of `batch` */
+} merge_cursor;
+
+/*
+ * Makes `cursor` point to the next record of `worker`, waiting for it if
+ * needed. Returns false if there is no next record, either because the
+ * worker is done or because the ingestion is stopped.
+ */
+static bool advance_merge_cursor(ingest* const ingest,
+                                 ingest_worker* const worker,
+                                 merge_cursor* const cursor) {
+  if (cursor->batch && cursor->next < cursor->batch->count) {
+    return true;
+  }
+  if (cursor->batch) {
+    release_batch(cursor->batch);
+    cursor->batch = NULL;
+  }
+
+  for (;;) {
+    /* Read the state first: the worker publishes all its batches before ending */
+    ingest_state const state = get_worker_state(worker);
+
+    cursor->batch = batch_ring_pop(worker->ring);
+    if (cursor->batch) {
+      /* A slot is free: wake the worker up if it waits for one */
+      notify_ingest(ingest);
+      cursor->next = 0;
+      return true;
+    }
+    if (state != INGEST_STATE_RUNNING || ingest_should_stop(ingest)) {
+      return false;
+    }
+
+    pthread_mutex_lock(&ingest->lock);
+    while (batch_ring_is_empty(worker->ring) && worker->state == INGEST_STATE_RUNNING &&
+           !ingest_should_stop(ingest)) {
+      pthread_cond_wait(&ingest->cond, &ingest->lock);
+    }
+    pthread_mutex_unlock(&ingest->lock);
+  }
+}
+
+/*
+ * Replaces `removed` bytes by `added` ones in the native `uint32_t` size
+ * at `at` of a binary rendering (see output_format).
+ */
+static void resize_binary_size(char* const at, uint32_t const removed, uint32_t const added) {
+  uint32_t size;
+  memcpy(&size, at, sizeof(size));
+  size = size - removed + added;
+  memcpy(at, &size, sizeof(size));
+}
+
+/*
+ * Appends a copy of `record`, rendered in `from` in `format`, to `to`.
+ *
+ * With `timestamps`, the time of the record, if rendered as a string, is
+ * rendered again by it: the merge is the first to see the records of all
+ * the workers in order, which DELTA and ELAPSED times are relative to.
+ */
+static void copy_batch_record(event_batch* const to,
+                              const event_batch* const from,
+                              const event_record* const record,
+                              timestamp_formatter* const timestamps,
+                              output_format const format) {
+  event_record* const copy = next_batch_record(to);
+
+  if (to->count == 0 || from->ingest_ns < to->ingest_ns) {
+    to->ingest_ns = from->ingest_ns;
+  }
+  *copy = *record;
+  copy->offset = to->arena.size;
+  copy->payload_offset = copy->offset + (record->payload_offset - record->offset);
+
+  const char* const data = from->arena.data + record->offset;
+  if (!timestamps || record->time_length == 0) {
+    byte_buffer_append(&to->arena, data, record->length);
+    push_batch_record(to);
+    return;
+  }
+
+  char time[48];
+  uint32_t const time_length = (uint32_t)format_timestamp(timestamps, record->timestamp_ns, time);
+  uint64_t const time_end = record->time_offset + record->time_length;
+  byte_buffer_append(&to->arena, data, record->time_offset);
+  byte_buffer_append(&to->arena, time, time_length);
+  byte_buffer_append(&to->arena, data + time_end, record->length - time_end);
+
+  /* What follows the time moves, and the sizes enclosing it change */
+  copy->length = record->length - record->time_length + time_length;
+  copy->payload_offset = copy->payload_offset - record->time_length + time_length;
+  copy->time_length = time_length;
+  if (format == OUTPUT_FORMAT_BINARY) {
+    char* const out = to->arena.data + copy->offset;
+    resize_binary_size(out, record->time_length, time_length);
+    /* The top-level object, after its tag */
+    resize_binary_size(out + sizeof(uint32_t) + 1, record->time_length, time_length);
+    /* The time string, after its tag */
+    resize_binary_size(out + copy->time_offset - sizeof(uint32_t), record->time_length,
+                       time_length);
+  }
+  push_batch_record(to);
+}
+
+/*
+ * Merges the records of the workers by timestamp into the ring of
+ * `ingest`.
+ *
+ * Each worker muxes its own data streams, so its records come in
+ * timestamp order: repeatedly taking the earliest of the next records of
+ * all the workers yields all of them in timestamp order. The merged
+ * batch is published whenever it is full and before waiting for a
+ * worker, so that a slow worker does not hold back what is ready.
+ */
+static void* merge_thread(void* const data) {
+  ingest* const ingest = (struct ingest*)data;
+  timestamp_format const time_format = ingest->merged_timestamps.format;
+  timestamp_formatter* const timestamps =
+      time_format == TIMESTAMP_FORMAT_DELTA || time_format == TIMESTAMP_FORMAT_ELAPSED
+          ? &ingest->merged_timestamps
+          : NULL;
+  output_format const format = ingest->workers[0].relay_data.format;
+  merge_cursor* const cursors = (merge_cursor*)calloc(ingest->worker_count, sizeof(merge_cursor));
+  FAIL_FAST_IF(!cursors);
+  event_batch* merged = acquire_batch(&ingest->merged_batches);
+  bool stopped = false;
+
+  while (!stopped) {
+    merge_cursor* earliest = NULL;
+
+    for (uint32_t i = 0; i < ingest->worker_count; i++) {
+      merge_cursor* const cursor = &cursors[i];
+      bool const ready = cursor->batch && cursor->next < cursor->batch->count;
+
+      if (!ready && merged->count > 0 && get_worker_state(&ingest->workers[i]) ==
+                                             INGEST_STATE_RUNNING &&
+          batch_ring_is_empty(ingest->workers[i].ring)) {
+        /* About to wait: publish what is merged so far */
+        stopped = !publish_batch(ingest, merged);
+        merged = acquire_batch(&ingest->merged_batches);
+      }
+      if (stopped || !advance_merge_cursor(ingest, &ingest->workers[i], cursor)) {
+        continue;
+      }
+
+      const event_record* const record = &cursor->batch->records[cursor->next];
+      if (!earliest ||
+          record->timestamp_ns < earliest->batch->records[earliest->next].timestamp_ns) {
+        earliest = cursor;
+      }
+    }
+
+    if (stopped || ingest_should_stop(ingest)) {
+      break;
+    }
+    if (!earliest) {
+      /* All the workers are done */
+      if (merged->count > 0) {
+        publish_batch(ingest, merged);
+        merged = NULL;
+      }
+      break;
+    }
+
+    copy_batch_record(merged, earliest->batch, &earliest->batch->records[earliest->next],
+                      timestamps, format);
+    earliest->next++;
+
+    if (merged->count == INGEST_MERGE_BATCH_RECORDS) {
+      stopped = !publish_batch(ingest, merged);
+      merged = acquire_batch(&ingest->merged_batches);
+    }
+  }
+
+  if (merged) {
+    release_batch(merged);
+  }
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    if (cursors[i].batch) {
+      release_batch(cursors[i].batch);
+    }
+  }
+  free(cursors);
+
+  if (!ingest_should_stop(ingest)) {
+    ingest_state state = INGEST_STATE_ENDED;
+    for (uint32_t i = 0; i < ingest->worker_count; i++) {
+      if (get_worker_state(&ingest->workers[i]) == INGEST_STATE_FAILED) {
+        state = INGEST_STATE_FAILED;
+      }
+    }
+    set_ingest_state(ingest, state);
+  }
+  return NULL;
+}
+
+/*
+ * Releases everything owned by `ingest`, which must not be running.
+ */
+static void free_ingest(ingest* const ingest) {
+  event_batch* batch;
+
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    ingest_worker* const worker = &ingest->workers[i];
+
+    if (worker->ring == &worker->own_ring) {
+      while ((batch = batch_ring_pop(&worker->own_ring))) {
+        release_batch(batch);
+      }
+      free(worker->own_ring.slots);
+    }
+    destroy_filter_update(worker->filter_update);
+  }
+
+  /* The published batches come from the pools of the workers when live */
+  while ((batch = batch_ring_pop(&ingest->ring))) {
+    release_batch(batch);
+  }
+  free(ingest->ring.slots);
+
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    ingest_worker* const worker = &ingest->workers[i];
+
+    if (worker->graph) {
+      BT_GRAPH_PUT_REF_AND_RESET(worker->graph);
+    }
+    bt_interrupter_put_ref(worker->interrupter);
+    destroy_relay_data(&worker->relay_data);
+  }
+  free(ingest->workers);
+  for (uint64_t i = 0; i < ingest->url_count; i++) {
+    free(ingest->urls[i]);
+  }
+  free(ingest->urls);
+  free(ingest->merged_histograms);
+  destroy_batch_pool(&ingest->merged_batches);
+  destroy_trace_registry(&ingest->traces);
+
+  pthread_cond_destroy(&ingest->cond);
+  pthread_mutex_destroy(&ingest->lock);
+  free(ingest);
+}
+
+/*
+ * Allocates an ingest of `worker_count` workers, without their graphs,
+ * and the ring of `ring_capacity` (rounded up to a power of two) batches
+ * it will publish to, applying `policy` while the ring is full.
+ * `sample_interval` is the N of OVERFLOW_POLICY_SAMPLE.
+ */
+static ingest* alloc_ingest(uint32_t const worker_count,
+                            uint64_t const ring_capacity,
+                            overflow_policy const policy,
+                            uint64_t const sample_interval) {
+  ingest* const ingest = (struct ingest*)calloc(1, sizeof(struct ingest));
+  FAIL_FAST_IF(!ingest);
+
+  ingest->overflow_policy = policy;
+  ingest->sample_interval = sample_interval ? sample_interval : 1;
+
+  pthread_mutex_init(&ingest->lock, NULL);
+  pthread_cond_init(&ingest->cond, NULL);
+  init_batch_ring(&ingest->ring, ring_capacity);
+  init_batch_pool(&ingest->merged_batches);
+  init_trace_registry(&ingest->traces);
+
+  ingest->workers = (ingest_worker*)calloc(worker_count, sizeof(ingest_worker));
+  FAIL_FAST_IF(!ingest->workers);
+  ingest->worker_count = worker_count;
+  for (uint32_t i = 0; i < worker_count; i++) {
+    ingest->workers[i].ingest = ingest;
+    ingest->workers[i].ring = &ingest->ring;
+    ingest->workers[i].interrupter = bt_interrupter_create();
+    FAIL_FAST_IF(!ingest->workers[i].interrupter);
+    init_relay_data(&ingest->workers[i].relay_data, &ingest->traces);
+  }
+  return ingest;
+}
+
+/*
+ * Prepares the reading of the live sessions at the `url_count` URLs of
+ * `urls`, and the ring of `ring_capacity` batches it will publish to
+ * (see alloc_ingest()).
+ *
+ * The trace processing graph is built by the worker once started, so
+ * that this returns right away: whether it can be built, and whether it
+ * reaches the relay daemon, shows in the state and the connection of
+ * the ingest (see get_ingest_connection()).
+ */
+static ingest* create_ingest(const char* const* const urls,
+                             uint64_t const url_count,
+                             uint64_t const ring_capacity,
+                             overflow_policy const policy,
+                             uint64_t const sample_interval) {
+  ingest* const ingest = alloc_ingest(1, ring_capacity, policy, sample_interval);
+
+  ingest->urls = (char**)calloc(url_count, sizeof(char*));
+  FAIL_FAST_IF(!ingest->urls);
+  for (uint64_t i = 0; i < url_count; i++) {
+    ingest->urls[i] = strdup(urls[i]);
+    FAIL_FAST_IF(!ingest->urls[i]);
+    ingest->url_count++;
+  }
+  return ingest;
+}
+
+/*
+ * Creates up to `max_workers` trace processing graphs reading the CTF
+ * trace of the directory `trace_dir`, each one decoding its own group of
+ * data streams, and the ring of `ring_capacity` batches their merged
+ * records will be published to (see alloc_ingest()).
+ *
+ * Returns NULL, describing why in `error`, if the graphs cannot be
+ * created.
+ */
+static ingest* create_offline_ingest(const char* const trace_dir,
+                                     uint32_t const max_workers,
+                                     uint64_t const ring_capacity,
+                                     overflow_policy const policy,
+                                     uint64_t const sample_interval,
+                                     char* const error,
+                                     size_t const error_size) {
+  struct relay_data probe_data = {0};
+  uint64_t stream_count = 0;
+
+  /* Count the data streams first: there is no use for more workers */
+  init_relay_data(&probe_data, NULL);
+  bt_graph* probe =
+      create_ctf_fs_graph(trace_dir, 0, 1, &probe_data, &stream_count, error, error_size);
+  bool const probed = probe != NULL;
+  if (probe) {
+    BT_GRAPH_PUT_REF_AND_RESET(probe);
+  }
+  destroy_relay_data(&probe_data);
+  if (stream_count == 0) {
+    if (probed) {
+      snprintf(error, error_size, "No data streams in '%s'.", trace_dir);
+    }
+    return NULL;
+  }
+
+  uint32_t const worker_count =
+      max_workers == 0 ? 1 : stream_count < max_workers ? (uint32_t)stream_count : max_workers;
+  ingest* const ingest = alloc_ingest(worker_count, ring_capacity, policy, sample_interval);
+
+  for (uint32_t i = 0; i < worker_count; i++) {
+    ingest_worker* const worker = &ingest->workers[i];
+
+    init_batch_ring(&worker->own_ring, INGEST_WORKER_RING_CAPACITY);
+    worker->ring = &worker->own_ring;
+    worker->graph = create_ctf_fs_graph(trace_dir, i, worker_count, &worker->relay_data,
+                                        &stream_count, error, error_size);
+    if (!worker->graph) {
+      free_ingest(ingest);
+      return NULL;
+    }
+    if (bt_graph_add_interrupter(worker->graph, worker->interrupter) !=
+        BT_GRAPH_ADD_INTERRUPTER_STATUS_OK) {
+      snprintf(error, error_size, "Failed to add the interrupter.");
+      free_ingest(ingest);
+      return NULL;
+    }
+  }
+
+  ingest->connection.state = INGEST_CONNECTION_CONNECTED;
+  return ingest;
+}
+
+/*
+ * Starts the threads of `ingest`.
+ */
+static bool start_ingest(ingest* const ingest) {
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    ingest_worker* const worker = &ingest->workers[i];
+
+    worker->started = pthread_create(&worker->thread, NULL, worker_thread, worker) == 0;
+    if (!worker->started) {
+      return false;
+    }
+  }
+
+  if (ingest->workers[0].ring != &ingest->ring) {
+    ingest->merge_started = pthread_create(&ingest->merge_thread, NULL, merge_thread, ingest) == 0;
+    return ingest->merge_started;
+  }
+  return true;
+}
+
+/*
+ * Returns the oldest published batch, or NULL if there is none. The
+ * caller owns the returned batch and must hand it back with
+ * release_batch().
+ */
+static event_batch* ingest_pop(ingest* const ingest) {
+  event_batch* const batch = batch_ring_pop(&ingest->ring);
+
+  if (batch) {
+    /* A slot is free: wake the ingestion thread up if it waits for one */
+    notify_ingest(ingest);
+  }
+  return batch;
+}
+
+/*
+ * Waits until a batch is published. Returns false, right away, if there
+ * is none and there won't be any anymore (see ingest_state()), or once
+ * `ingest` is stopping (see stop_ingest()).
+ */
+static bool ingest_wait(ingest* const ingest) {
+  pthread_mutex_lock(&ingest->lock);
+  while (batch_ring_is_empty(&ingest->ring) && ingest->state == INGEST_STATE_RUNNING &&
+         !ingest_should_stop(ingest)) {
+    pthread_cond_wait(&ingest->cond, &ingest->lock);
+  }
+  bool const ready = !batch_ring_is_empty(&ingest->ring) && !ingest_should_stop(ingest);
+  pthread_mutex_unlock(&ingest->lock);
+  return ready;
+}
+
+static ingest_state get_ingest_state(ingest* const ingest) {
+  pthread_mutex_lock(&ingest->lock);
+  ingest_state const state = ingest->state;
+  pthread_mutex_unlock(&ingest->lock);
+  return state;
+}
+
+static ingest_connection get_ingest_connection(ingest* const ingest) {
+  pthread_mutex_lock(&ingest->lock);
+  ingest_connection const connection = ingest->connection;
+  pthread_mutex_unlock(&ingest->lock);
+  return connection;
+}
+
+/*
+ * Waits until the connection of `ingest` changes from the one of
+ * `generation`, the ingestion is over or `ingest` is stopping (see
+ * stop_ingest()), and returns it.
+ */
+static ingest_connection ingest_wait_connection(ingest* const ingest, uint64_t const generation) {
+  pthread_mutex_lock(&ingest->lock);
+  while (ingest->connection.generation == generation && ingest->state == INGEST_STATE_RUNNING &&
+         !ingest_should_stop(ingest)) {
+    pthread_cond_wait(&ingest->cond, &ingest->lock);
+  }
+  ingest_connection const connection = ingest->connection;
+  pthread_mutex_unlock(&ingest->lock);
+  return connection;
+}
+
+/*
+ * Makes the workers render the events in `format`. Must be called before
+ * start_ingest().
+ */
+static void ingest_set_format(ingest* const ingest, output_format const format) {
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    ingest->workers[i].relay_data.format = format;
+  }
+}
+
+/*
+ * Makes the workers write the byte arrays in `encoding`, cut to their
+ * first `max` bytes (0 for no limit) unless written as lists. Must be
+ * called before start_ingest().
+ */
+static void ingest_set_byte_arrays(ingest* const ingest,
+                                   byte_array_encoding const encoding,
+                                   uint64_t const max) {
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    ingest->workers[i].relay_data.bytes = encoding;
+    ingest->workers[i].relay_data.bytes_max = max;
+  }
+}
+
+/*
+ * Makes each worker render its batches with `thread_count` more threads
+ * (see decode_pool.h), or on its own thread only if 0. Returns false if
+ * the threads cannot be started. Must be called before start_ingest().
+ */
+static bool ingest_set_decode_threads(ingest* const ingest, uint32_t const thread_count) {
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    if (!set_relay_decode_threads(&ingest->workers[i].relay_data, thread_count)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Makes the workers render the timestamps in `format`. Must be called
+ * before start_ingest().
+ *
+ * DELTA and ELAPSED times are relative to the previous and first events
+ * of all the workers: with several of them, they are rendered again once
+ * merged (see copy_batch_record()).
+ */
+static void ingest_set_timestamp_format(ingest* const ingest, timestamp_format const format) {
+  ingest->merged_timestamps.format = format;
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    ingest->workers[i].relay_data.timestamps.format = format;
+  }
+}
+
+/*
+ * Makes the workers keep histograms of the fields of `paths` (see
+ * set_event_stats_fields()). Returns false, describing why in `error`,
+ * if `paths` is invalid. Must be called before start_ingest().
+ */
+static bool ingest_set_stats_fields(ingest* const ingest,
+                                    const char* const paths,
+                                    char* const error,
+                                    size_t const error_size) {
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    if (!set_event_stats_fields(&ingest->workers[i].relay_data.stats, paths, error, error_size)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Makes each worker keep the last `max_events` events its filter
+ * selects in its event table (see event_table.h), none if 0. Must be
+ * called before start_ingest().
+ */
+static void ingest_set_table_size(ingest* const ingest, uint64_t const max_events) {
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    set_event_table_size(&ingest->workers[i].relay_data.table, max_events);
+  }
+}
+
+/*
+ * Makes the workers only count the events (see event_stats), rendering
+ * none of them, from now on, or render them again.
+ */
+static void ingest_set_count_only(ingest* const ingest, bool const count_only) {
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    __atomic_store_n(&ingest->workers[i].relay_data.stats.count_only, count_only,
+                     __ATOMIC_RELAXED);
+  }
+}
+
+/*
+ * Makes the workers only render the events `filter` selects, or all of
+ * them if `filter` is NULL, from their next graph run on. `ingest` takes
+ * ownership of `filter`.
+ */
+static void ingest_set_filter(ingest* const ingest, event_filter* const filter) {
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    filter_update* const update = (filter_update*)malloc(sizeof(filter_update));
+    FAIL_FAST_IF(!update);
+
+    /* Each worker caches its own per-class decisions: give each its own copy */
+    update->filter = filter && i > 0 ? create_event_filter(filter->expression, NULL, 0) : filter;
+
+    /* Replaces the previous update if the worker did not take it */
+    destroy_filter_update(
+        __atomic_exchange_n(&ingest->workers[i].filter_update, update, __ATOMIC_ACQ_REL));
+  }
+}
+
+/*
+ * Returns the trace of id `id`, which stays valid until destroy_ingest(),
+ * or NULL if there is none. The ids of the published records are all
+ * known.
+ */
+static const trace_info* ingest_trace_info(ingest* const ingest, uint32_t const id) {
+  return trace_registry_get(&ingest->traces, id);
+}
+
+/*
+ * Returns what the overflow policy dropped so far.
+ */
+static ingest_loss get_ingest_loss(ingest* const ingest) {
+  ingest_loss loss;
+  for (uint32_t i = 0; i < OVERFLOW_POLICY_COUNT; i++) {
+    loss.events[i] = __atomic_load_n(&ingest->loss.events[i], __ATOMIC_RELAXED);
+    loss.bytes[i] = __atomic_load_n(&ingest->loss.bytes[i], __ATOMIC_RELAXED);
+  }
+  loss.blocked_batches = __atomic_load_n(&ingest->loss.blocked_batches, __ATOMIC_RELAXED);
+  loss.blocked_ns = __atomic_load_n(&ingest->loss.blocked_ns, __ATOMIC_RELAXED);
+  return loss;
+}
+
+/*
+ * Returns what the workers recorded so far, all of them together.
+ */
+static pipeline_metrics get_ingest_metrics(ingest* const ingest) {
+  pipeline_metrics metrics;
+  memset(&metrics, 0, sizeof(metrics));
+
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    pipeline_metrics_merge(&metrics, &ingest->workers[i].relay_data.metrics);
+    metrics.unknown_field_classes += __atomic_load_n(
+        &ingest->workers[i].relay_data.decoders.unknown_field_classes, __ATOMIC_RELAXED);
+  }
+  return metrics;
+}
+
+/*
+ * Writes the counters of the events of each name per stream, of all the
+ * workers, to `samples`, up to `capacity` of them, and returns how many
+ * there are, which may be more. `*other_events` is the number of events
+ * left out of them for lack of room (see EVENT_STATS_MAX_ROWS).
+ */
+static uint64_t get_ingest_stats(ingest* const ingest,
+                                 event_stats_sample* const samples,
+                                 uint64_t const capacity,
+                                 uint64_t* const other_events) {
+  uint64_t count = 0;
+  *other_events = 0;
+
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    const event_stats* const stats = &ingest->workers[i].relay_data.stats;
+    count += sample_event_stats(stats, samples + (count < capacity ? count : capacity),
+                                count < capacity ? capacity - count : 0);
+    *other_events += __atomic_load_n(&stats->other_events, __ATOMIC_RELAXED);
+  }
+  return count;
+}
+
+/*
+ * Writes the histograms of the fields of the events of each name, those
+ * of all the workers being merged, to `samples`, up to `capacity` of
+ * them, and returns how many were written. Only one thread may call it
+ * at a time.
+ */
+static uint64_t get_ingest_field_stats(ingest* const ingest,
+                                       event_stats_field_sample* const samples,
+                                       uint64_t const capacity) {
+  if (!ingest->merged_histograms) {
+    ingest->merged_histograms = (event_stats_histogram*)malloc(EVENT_STATS_MAX_HISTOGRAMS *
+                                                               sizeof(event_stats_histogram));
+    FAIL_FAST_IF(!ingest->merged_histograms);
+  }
+
+  uint64_t count = 0;
+  uint64_t const max =
+      capacity < EVENT_STATS_MAX_HISTOGRAMS ? capacity : EVENT_STATS_MAX_HISTOGRAMS;
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    merge_event_stats_histograms(&ingest->workers[i].relay_data.stats, ingest->merged_histograms,
+                                 &count, max);
+  }
+
+  for (uint64_t i = 0; i < count; i++) {
+    const event_stats_histogram* const histogram = &ingest->merged_histograms[i];
+    event_stats_field_sample* const sample = &samples[i];
+
+    sample->name = histogram->name;
+    sample->field = ingest->workers[0].relay_data.stats.field_paths[histogram->field];
+    sample->count = histogram->values.count;
+    sample->sum = histogram->values.sum;
+    sample->max = histogram->values.max;
+    sample->p50 = value_histogram_quantile(&histogram->values, 0.50);
+    sample->p90 = value_histogram_quantile(&histogram->values, 0.90);
+    sample->p99 = value_histogram_quantile(&histogram->values, 0.99);
+  }
+  return count;
+}
+
+/*
+ * Writes the events the workers keep in their event tables, timestamped
+ * within [`from_ns`, `to_ns`], to a new file at `path` (see
+ * export_event_tables()). The workers only wait while the events are
+ * copied out. `*dropped_strings` is the number of strings the tables
+ * could not keep. Returns the number of events written, or -1,
+ * describing why in `error`.
+ */
+static int64_t export_ingest_table(ingest* const ingest,
+                                   int64_t const from_ns,
+                                   int64_t const to_ns,
+                                   const char* const fields,
+                                   table_export_format const format,
+                                   const char* const path,
+                                   uint64_t* const dropped_strings,
+                                   char* const error,
+                                   size_t const error_size) {
+  event_table** const tables = (event_table**)malloc(ingest->worker_count * sizeof(event_table*));
+  FAIL_FAST_IF(!tables);
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    tables[i] = &ingest->workers[i].relay_data.table;
+  }
+
+  int64_t const written = export_event_tables(tables, ingest->worker_count, &ingest->traces,
+                                              from_ns, to_ns, fields, format, path,
+                                              dropped_strings, error, error_size);
+  free(tables);
+  return written;
+}
+
+/*
+ * Asks the threads of `ingest` to stop, and wakes up the threads
+ * waiting in ingest_wait() or ingest_wait_connection() so that they
+ * return. Other threads may still call into `ingest` until it is
+ * destroyed: they find it stopping. May be called more than once.
+ */
+static void stop_ingest(ingest* const ingest) {
+  __atomic_store_n(&ingest->stop, true, __ATOMIC_RELEASE);
+
+  /* Make the running bt_graph_run_once() calls return as soon as possible */
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    bt_interrupter_set(ingest->workers[i].interrupter);
+  }
+  notify_ingest(ingest);
+}
+
+/*
+ * Stops the threads of `ingest`, if started, and destroys `ingest`. All
+ * the batches popped from `ingest` must have been released, and no other
+ * thread may be waiting in `ingest` anymore: call stop_ingest() first,
+ * then wait for them to return.
+ */
+static void destroy_ingest(ingest* const ingest) {
+  stop_ingest(ingest);
+
+  for (uint32_t i = 0; i < ingest->worker_count; i++) {
+    if (ingest->workers[i].started) {
+      pthread_join(ingest->workers[i].thread, NULL);
+    }
+  }
+  if (ingest->merge_started) {
+    pthread_join(ingest->merge_thread, NULL);
+  }
+
+  free_ingest(ingest);
+}
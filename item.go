@@ -1,11 +1,31 @@
 package main
 
+// item is a retained event. Its title and description are only made strings
+// when it is displayed or filtered.
 type item struct {
-	title       string
-	description string
+	seq       uint64 // Unique per event, in arrival order
+	name      string // Interned: shared by all the events of the same class
+	session   string // "HOSTNAME/SESSION", only set when reading several sessions
+	timestamp int64  // Nanoseconds from the clock origin
+	streamID  uint64
+	traceID   uint32 // See ingest_trace_info()
+
+	// Full rendering of the event, for when more than the payload is needed
+	record []byte
+	// Rendering of the payload alone, within `record`
+	payload []byte
+	// Offset of `payload` within `record`
+	payloadOffset uint32
+	// Bytes of the postings of the event in the eventIndex, counted as retained
+	indexBytes uint32
 }
 
-func (i item) Title() string { return i.title }
+func (i item) Title() string {
+	if i.session != "" {
+		return i.name + " • " + i.session
+	}
+	return i.name
+}
 
-func (i item) Description() string { return i.description }
-func (i item) FilterValue() string { return i.title + i.description }
+func (i item) Description() string { return string(i.payload) }
+func (i item) FilterValue() string { return i.name + string(i.payload) }
@@ -2,28 +2,51 @@ package main
 
 /*
    #cgo pkg-config: babeltrace2
-   #cgo LDFLAGS: -L. -lbabeltrace2 -ljson-c
-   #include <read_live_stream.h>
+   #cgo LDFLAGS: -L. -lbabeltrace2 -lm
+   #include <event_output.h>
 */
 import "C"
 
 import (
+	"errors"
+	"fmt"
 	"log"
 	"os"
+	"runtime"
+	"sort"
+	"strconv"
 	"strings"
+	"sync"
 	"time"
 	"unsafe"
 
+	"github.com/charmbracelet/bubbles/key"
 	"github.com/charmbracelet/bubbles/list"
+	"github.com/charmbracelet/bubbles/textinput"
 	tea "github.com/charmbracelet/bubbletea"
 	"github.com/charmbracelet/lipgloss"
-	"github.com/goccy/go-json"
 	"github.com/muesli/reflow/wordwrap"
 )
 
+const (
+	// Filter input prefix of event filter expressions, which are pushed down
+	// to the ingestion thread instead of filtering the events in the list
+	pushdownPrefix = ":"
+	// Batches the ingestion thread may publish ahead of the UI
+	ingestRingCapacity = 64
+	// The UI takes in new batches at most once per frame
+	frameInterval = time.Second / 60
+)
+
 var (
-	relay_data = C.relay_data{}
-	graph      *C.bt_graph
+	// Event names are interned on the C side: convert each one only once
+	internedStrings = map[*C.char]string{}
+	// Session tags of the traces by id
+	traceSessions = map[uint32]string{}
+	// Descriptions of the traces by id, see traceEnvironment
+	traceEnvironments = map[uint32]string{}
+	// Commands blocking in the ingest, which must return before it is destroyed
+	ingestWaiters waiterGroup
 
 	appStyle   = lipgloss.NewStyle().Padding(1, 2)
 	titleStyle = lipgloss.NewStyle().
@@ -35,6 +58,11 @@ var (
 )
 
 func main() {
+	if len(os.Args) < 2 {
+		fmt.Fprintf(os.Stderr, "Usage: %s URL... | TRACE_DIR\n", os.Args[0])
+		os.Exit(1)
+	}
+
 	/* Set up logger file*/
 	path := os.Getenv("LTTNG_GO_LOG")
 	if path == "" {
@@ -48,46 +76,507 @@ func main() {
 	}
 	defer f.Close()
 
-	/* Create the trace processing graph */
-	url := C.CString(os.Args[1])
-	defer C.free(unsafe.Pointer(url))
-	graph = C.create_graph(url, &relay_data)
-	defer C.bt_graph_put_ref(graph)
-	if graph == nil {
+	/* Set up what to drop when the UI cannot keep up */
+	overflow := os.Getenv("LTTNG_GO_OVERFLOW")
+	if overflow == "" {
+		overflow = "block"
+	}
+	policy, sampleInterval, err := parseOverflowPolicy(overflow)
+	if err != nil {
+		log.Fatalf("Invalid LTTNG_GO_OVERFLOW: %v", err)
+		os.Exit(1)
+	}
+
+	/* Set up how many events to keep */
+	retained := retention{count: defaultRetentionCount}
+	if r := os.Getenv("LTTNG_GO_RETENTION"); r != "" {
+		if retained, err = parseRetention(r); err != nil {
+			log.Fatalf("Invalid LTTNG_GO_RETENTION: %v", err)
+			os.Exit(1)
+		}
+	}
+
+	/* Set up how many threads decode a trace directory */
+	workers := runtime.NumCPU()
+	if w := os.Getenv("LTTNG_GO_WORKERS"); w != "" {
+		if workers, err = strconv.Atoi(w); err != nil || workers <= 0 {
+			log.Fatalf("Invalid LTTNG_GO_WORKERS: %q", w)
+			os.Exit(1)
+		}
+	}
+
+	/* Set up how many more threads render the events of each graph */
+	decodeThreads := 0
+	if d := os.Getenv("LTTNG_GO_DECODE_THREADS"); d != "" {
+		if decodeThreads, err = strconv.Atoi(d); err != nil || decodeThreads < 0 {
+			log.Fatalf("Invalid LTTNG_GO_DECODE_THREADS: %q", d)
+			os.Exit(1)
+		}
+	}
+
+	/* Set up how to render the timestamps */
+	timestamps := os.Getenv("LTTNG_GO_TIME")
+	if timestamps == "" {
+		timestamps = "iso8601"
+	}
+	timestampFormat, err := parseTimestampFormat(timestamps)
+	if err != nil {
+		log.Fatalf("Invalid LTTNG_GO_TIME: %v", err)
+		os.Exit(1)
+	}
+
+	/* Set up how to write the byte arrays */
+	byteArrays, byteArraysMax, err := parseByteArrays(os.Getenv("LTTNG_GO_BYTES"),
+		os.Getenv("LTTNG_GO_BYTES_MAX"))
+	if err != nil {
+		log.Fatalf("Invalid LTTNG_GO_BYTES: %v", err)
+		os.Exit(1)
+	}
+
+	/* Set up how many events each graph keeps by column for exports, if any */
+	var tableSize uint64
+	if t := os.Getenv("LTTNG_GO_TABLE"); t != "" {
+		if tableSize, err = strconv.ParseUint(t, 10, 64); err != nil {
+			log.Fatalf("Invalid LTTNG_GO_TABLE: %q", t)
+			os.Exit(1)
+		}
+	}
+
+	/* Set up which fields of the events to keep histograms of, if any */
+	statsFields := os.Getenv("LTTNG_GO_AGGREGATE_FIELDS")
+
+	/* Set up where to spill the events to, if anywhere, to find them after their eviction */
+	var spill *spillStore
+	if dir := os.Getenv("LTTNG_GO_SPILL"); dir != "" {
+		if spill, err = newSpillStore(dir); err != nil {
+			log.Fatalf("Invalid LTTNG_GO_SPILL: %v", err)
+			os.Exit(1)
+		}
+		defer spill.Close()
+	}
+
+	/* Set up where to write the events to instead of showing them, if anywhere */
+	var output *C.event_output
+	if target := os.Getenv("LTTNG_GO_OUTPUT"); target != "" {
+		output, err = openOutput(target, os.Getenv("LTTNG_GO_OUTPUT_FORMAT"),
+			os.Getenv("LTTNG_GO_OUTPUT_ROTATE"))
+		if err != nil {
+			log.Fatalf("Invalid LTTNG_GO_OUTPUT: %v", err)
+			os.Exit(1)
+		}
+		defer C.destroy_event_output(output)
+	}
+
+	/*
+	 * Create the trace processing graphs reading the trace directory or the
+	 * live sessions given, and run them on their own threads
+	 */
+	sources := os.Args[1:]
+	var ingest *C.ingest
+	if info, err := os.Stat(sources[0]); err == nil && info.IsDir() && len(sources) == 1 {
+		source := C.CString(sources[0])
+		defer C.free(unsafe.Pointer(source))
+		var cError [256]C.char
+		ingest = C.create_offline_ingest(source, C.uint32_t(workers), ingestRingCapacity, policy,
+			C.uint64_t(sampleInterval), &cError[0], C.size_t(len(cError)))
+		if ingest == nil {
+			log.Fatalf("No graph can be created: %s Exiting...", C.GoString(&cError[0]))
+			os.Exit(1)
+		}
+	} else {
+		// One array of C strings, which the ingest copies
+		urls := unsafe.Slice((**C.char)(C.malloc(C.size_t(len(sources))*
+			C.size_t(unsafe.Sizeof((*C.char)(nil))))), len(sources))
+		for i, url := range sources {
+			urls[i] = C.CString(url)
+		}
+		ingest = C.create_ingest(&urls[0], C.uint64_t(len(urls)), ingestRingCapacity, policy,
+			C.uint64_t(sampleInterval))
+		for _, url := range urls {
+			C.free(unsafe.Pointer(url))
+		}
+		C.free(unsafe.Pointer(&urls[0]))
+	}
+	if ingest == nil {
 		log.Fatalf("No graph can be created. Exiting...")
 		os.Exit(1)
 	}
+	defer C.destroy_ingest(ingest)
+	C.ingest_set_timestamp_format(ingest, timestampFormat)
+	C.ingest_set_byte_arrays(ingest, byteArrays, C.uint64_t(byteArraysMax))
+	if !C.ingest_set_decode_threads(ingest, C.uint32_t(decodeThreads)) {
+		log.Fatalf("The decoding threads cannot be started")
+		os.Exit(1)
+	}
+	if statsFields != "" {
+		cFields := C.CString(statsFields)
+		var cError [256]C.char
+		valid := C.ingest_set_stats_fields(ingest, cFields, &cError[0], C.size_t(len(cError)))
+		C.free(unsafe.Pointer(cFields))
+		if !valid {
+			log.Fatalf("Invalid LTTNG_GO_AGGREGATE_FIELDS: %s", C.GoString(&cError[0]))
+			os.Exit(1)
+		}
+	}
+	C.ingest_set_table_size(ingest, C.uint64_t(tableSize))
+	if output != nil {
+		C.ingest_set_format(ingest, output.format)
+	}
+	if !C.start_ingest(ingest) {
+		log.Fatalf("The ingestion thread cannot be started. Exiting...")
+		os.Exit(1)
+	}
+
+	/* Export the metrics of the pipeline periodically, if asked to */
+	var ui *uiMetrics
+	if output == nil {
+		ui = &uiMetrics{}
+	}
+	if path := os.Getenv("LTTNG_GO_METRICS"); path != "" {
+		stop, done := make(chan struct{}), make(chan struct{})
+		go exportMetrics(path, ingest, ui, stop, done)
+		// Runs before destroying `ingest`, which the exporter reads
+		defer func() {
+			close(stop)
+			<-done
+		}()
+	}
+
+	if output != nil {
+		// Headless: no UI, the events only go to the output
+		if !C.run_event_output(ingest, output) {
+			log.Fatalf("Writing the events failed. Exiting...")
+			os.Exit(1)
+		}
+		if C.get_ingest_state(ingest) == C.INGEST_STATE_FAILED {
+			log.Fatal(ingestFailure(ingest))
+			os.Exit(1)
+		}
+		loss := C.get_ingest_loss(ingest)
+		log.Printf("Trace ended, %d events dropped, blocked %d times", droppedEvents(loss),
+			uint64(loss.blocked_batches))
+		return
+	}
 
 	// Initialize our program
 	const defaultWidth = 20
 	const listHeight = 14
-	l := list.NewModel([]list.Item{}, newLttngDelegate(), defaultWidth, listHeight)
-	l.Title = "lttng-go"
+	filter := &eventFilter{}
+	l := list.NewModel([]list.Item{}, newLttngDelegate(filter), defaultWidth, listHeight)
+	connection := C.get_ingest_connection(ingest)
+	l.Title = connectionTitle(connection)
 	l.SetShowStatusBar(true)
-	l.SetFilteringEnabled(true)
+	// Events are filtered with their index instead
+	l.SetFilteringEnabled(false)
+	l.AdditionalShortHelpKeys = func() []key.Binding {
+		keys := []key.Binding{
+			key.NewBinding(key.WithKeys("/"), key.WithHelp("/", "filter")),
+			key.NewBinding(key.WithKeys("t"), key.WithHelp("t", "jump to time")),
+			key.NewBinding(key.WithKeys("n"), key.WithHelp("n", "next of name")),
+			key.NewBinding(key.WithKeys("a"), key.WithHelp("a", "aggregate")),
+			key.NewBinding(key.WithKeys("m"), key.WithHelp("m", "stats")),
+			key.NewBinding(key.WithKeys("e"), key.WithHelp("e", "trace environment")),
+		}
+		if tableSize > 0 {
+			keys = append(keys, key.NewBinding(key.WithKeys("x"), key.WithHelp("x", "export")))
+		}
+		return keys
+	}
 	l.SetShowPagination(true)
 	l.Styles.Title = titleStyle
 	l.Styles.PaginationStyle = paginationStyle
 	l.Styles.HelpStyle = helpStyle
-	m := model{list: l}
+	filterInput := textinput.NewModel()
+	filterInput.Prompt = "Filter: "
+	jumpInput := textinput.NewModel()
+	jumpInput.Prompt = "Jump to: "
+	jumpInput.Placeholder = "14:03:22.5, 2021-11-05T14:03:22.5+01:00 or nanoseconds"
+	exportInput := textinput.NewModel()
+	exportInput.Prompt = "Export to: "
+	exportInput.Placeholder = "events.csv 14:03:22..14:03:25 prev_tid,next_tid"
+	m := model{
+		list:           l,
+		height:         listHeight,
+		store:          newEventStore(retained),
+		index:          newEventIndex(),
+		filter:         filter,
+		filterInput:    filterInput,
+		jumpInput:      jumpInput,
+		exportInput:    exportInput,
+		exportable:     tableSize > 0,
+		spill:          spill,
+		aggregate:      newAggregateView(),
+		ingest:         ingest,
+		connection:     uint64(connection.generation),
+		metrics:        ui,
+		tagSessions:    len(sources) > 1,
+		overflow:       overflow,
+		overflowPolicy: policy,
+	}
+	m.updateLossStatus()
 	p := tea.NewProgram(m)
-	if err := p.Start(); err != nil {
+	err = p.Start()
+	// Commands may still be waiting in the ingest: wake them up and wait for them
+	C.stop_ingest(ingest)
+	ingestWaiters.Close()
+	if err != nil {
 		log.Fatal(err)
 	}
 }
 
-type message map[string]interface{}
+// waiterGroup counts the goroutines calling into a resource until it is
+// closed, after which no more may enter.
+type waiterGroup struct {
+	mu     sync.Mutex
+	closed bool
+	active sync.WaitGroup
+}
+
+// Enter returns whether the calling goroutine may use the resource, in which
+// case it must call Leave once done.
+func (g *waiterGroup) Enter() bool {
+	g.mu.Lock()
+	defer g.mu.Unlock()
+	if g.closed {
+		return false
+	}
+	g.active.Add(1)
+	return true
+}
+
+func (g *waiterGroup) Leave() {
+	g.active.Done()
+}
+
+// Close prevents any more goroutine from entering and waits for the ones which
+// did to leave.
+func (g *waiterGroup) Close() {
+	g.mu.Lock()
+	g.closed = true
+	g.mu.Unlock()
+	g.active.Wait()
+}
 
 type model struct {
-	list     list.Model
-	messages []list.Item
-	width    int
+	list           list.Model
+	width, height  int
+	store          *eventStore
+	nextSeq        uint64
+	index          *eventIndex
+	filter         *eventFilter
+	filterInput    textinput.Model
+	jumpInput      textinput.Model
+	jumping        bool // Whether the time to jump to is being edited
+	exportInput    textinput.Model
+	exporting      bool // Whether what to export is being edited
+	exportable     bool // Whether the ingestion threads keep the events in their tables
+	spill          *spillStore
+	history        []list.Item // Spilled page shown instead of the retained events, if any
+	aggregate      *aggregateView
+	aggregating    bool   // Whether the events are only counted, shown by `aggregate`
+	pushdown       string // Event filter expression of the ingestion thread
+	ingest         *C.ingest
+	connection     uint64 // Generation of the connection shown in the title
+	metrics        *uiMetrics
+	showStats      bool
+	showEnv        bool // Whether the environment of the trace of the selected event is shown
+	tagSessions    bool // Whether several live sessions are read
+	overflow       string
+	overflowPolicy C.overflow_policy
+}
+
+// Names of the overflow policies, by overflow_policy
+var overflowPolicyNames = [C.OVERFLOW_POLICY_COUNT]string{"block", "drop-oldest", "drop-newest",
+	"sample"}
+
+// parseOverflowPolicy parses the overflow policy `policy`: one of "block",
+// "drop-oldest", "drop-newest" or "sample:N". It also returns the N of the
+// sampling policy.
+func parseOverflowPolicy(policy string) (C.overflow_policy, uint64, error) {
+	switch policy {
+	case "block":
+		return C.OVERFLOW_POLICY_BLOCK, 0, nil
+	case "drop-oldest":
+		return C.OVERFLOW_POLICY_DROP_OLDEST, 0, nil
+	case "drop-newest":
+		return C.OVERFLOW_POLICY_DROP_NEWEST, 0, nil
+	}
+
+	if interval := strings.TrimPrefix(policy, "sample:"); interval != policy {
+		n, err := strconv.ParseUint(interval, 10, 64)
+		if err != nil || n == 0 {
+			return 0, 0, fmt.Errorf("invalid sampling interval %q", interval)
+		}
+		return C.OVERFLOW_POLICY_SAMPLE, n, nil
+	}
+
+	return 0, 0, fmt.Errorf("unknown overflow policy %q", policy)
+}
+
+// parseTimestampFormat parses the timestamp format `format`: one of "iso8601",
+// "ns", "delta" or "elapsed".
+func parseTimestampFormat(format string) (C.timestamp_format, error) {
+	switch format {
+	case "iso8601":
+		return C.TIMESTAMP_FORMAT_ISO8601, nil
+	case "ns":
+		return C.TIMESTAMP_FORMAT_NS, nil
+	case "delta":
+		return C.TIMESTAMP_FORMAT_DELTA, nil
+	case "elapsed":
+		return C.TIMESTAMP_FORMAT_ELAPSED, nil
+	}
+	return 0, fmt.Errorf("unknown timestamp format %q", format)
+}
+
+// parseByteArrays parses how to write the byte arrays: `encoding` is one of
+// "list" (the default), "hex" or "base64", and `max`, unless empty, the number
+// of bytes to cut the hex and base64 strings to, such as "256" or "4KiB".
+func parseByteArrays(encoding string, max string) (C.byte_array_encoding, uint64, error) {
+	var cEncoding C.byte_array_encoding
+	switch encoding {
+	case "", "list":
+		cEncoding = C.BYTE_ARRAY_ENCODING_LIST
+	case "hex":
+		cEncoding = C.BYTE_ARRAY_ENCODING_HEX
+	case "base64":
+		cEncoding = C.BYTE_ARRAY_ENCODING_BASE64
+	default:
+		return 0, 0, fmt.Errorf("unknown byte array encoding %q", encoding)
+	}
+
+	if max == "" {
+		return cEncoding, 0, nil
+	}
+	if bytes, ok, err := parseSize(max); ok {
+		return cEncoding, bytes, err
+	}
+	bytes, err := strconv.ParseUint(max, 10, 64)
+	if err != nil || bytes == 0 {
+		return 0, 0, fmt.Errorf("invalid byte array size %q", max)
+	}
+	return cEncoding, bytes, nil
+}
+
+// openOutput opens the headless output `target` (see create_event_output()),
+// writing the events in `format`, "ndjson" (the default) or "binary", and
+// rotating files every `rotate` bytes, such as "512MiB", unless empty.
+func openOutput(target, format, rotate string) (*C.event_output, error) {
+	var outputFormat C.output_format
+	switch format {
+	case "", "ndjson":
+		outputFormat = C.OUTPUT_FORMAT_JSON
+	case "binary":
+		outputFormat = C.OUTPUT_FORMAT_BINARY
+	default:
+		return nil, fmt.Errorf("unknown output format %q", format)
+	}
+
+	var rotateBytes uint64
+	if rotate != "" {
+		bytes, ok, err := parseSize(rotate)
+		if !ok && err == nil {
+			err = fmt.Errorf("invalid size %q", rotate)
+		}
+		if err != nil {
+			return nil, err
+		}
+		rotateBytes = bytes
+	}
+
+	cTarget := C.CString(target)
+	defer C.free(unsafe.Pointer(cTarget))
+
+	var cError [256]C.char
+	output := C.create_event_output(cTarget, outputFormat, C.uint64_t(rotateBytes), &cError[0],
+		C.size_t(len(cError)))
+	if output == nil {
+		return nil, errors.New(C.GoString(&cError[0]))
+	}
+	return output, nil
+}
+
+// updateLossStatus shows in the status bar what each overflow policy dropped so
+// far, and how often the graph waited for the UI. Nothing is dropped when
+// blocking.
+func (m *model) updateLossStatus() {
+	loss := C.get_ingest_loss(m.ingest)
+	var suffix string
+	for policy, name := range overflowPolicyNames {
+		active := C.overflow_policy(policy) == m.overflowPolicy
+		if loss.events[policy] == 0 && (!active || policy == C.OVERFLOW_POLICY_BLOCK) {
+			continue
+		}
+		if active {
+			name = m.overflow
+		}
+		suffix += fmt.Sprintf(" • %d dropped (%s, %s)", uint64(loss.events[policy]),
+			formatBytes(uint64(loss.bytes[policy])), name)
+	}
+	if loss.blocked_batches > 0 {
+		suffix += fmt.Sprintf(" • blocked %d times (%s)", uint64(loss.blocked_batches),
+			time.Duration(loss.blocked_ns).Round(time.Millisecond))
+	}
+	if suffix != "" {
+		m.list.SetStatusBarItemName("event"+suffix, "events"+suffix)
+	}
+}
+
+// droppedEvents returns the events all the overflow policies dropped.
+func droppedEvents(loss C.ingest_loss) uint64 {
+	var events uint64
+	for policy := range overflowPolicyNames {
+		events += uint64(loss.events[policy])
+	}
+	return events
+}
+
+// formatBytes returns `bytes` in a human readable form.
+func formatBytes(bytes uint64) string {
+	const unit = 1024
+	if bytes < unit {
+		return fmt.Sprintf("%d B", bytes)
+	}
+	div, exp := uint64(unit), 0
+	for n := bytes / unit; n >= unit; n /= unit {
+		div *= unit
+		exp++
+	}
+	return fmt.Sprintf("%.1f %ciB", float64(bytes)/float64(div), "KMGTPE"[exp])
+}
+
+// ingestFailure returns the status of the failed `ingest`, with the reason of
+// the failure when it is known.
+func ingestFailure(ingest *C.ingest) string {
+	var cError [256]C.char
+	C.get_ingest_error(ingest, &cError[0], C.size_t(len(cError)))
+	if cError[0] == 0 {
+		return "Trace processing failed"
+	}
+	return "Trace processing failed: " + C.GoString(&cError[0])
+}
+
+// connectionTitle returns the title of the list, which tells how reaching the
+// live sessions goes until they are reached.
+func connectionTitle(connection C.ingest_connection) string {
+	switch connection.state {
+	case C.INGEST_CONNECTION_CONNECTING:
+		if connection.failures > 0 {
+			return fmt.Sprintf("lttng-go (reconnecting, attempt %d)", connection.failures+1)
+		}
+		return "lttng-go (connecting)"
+	case C.INGEST_CONNECTION_WAITING:
+		return fmt.Sprintf("lttng-go (disconnected, retrying in %s)",
+			time.Duration(connection.retry_ns))
+	}
+	return "lttng-go"
 }
 
 // Init optionally returns an initial command we should run. In this case we
-// want to start the timer.
+// want to wait for the first batches, and for the live sessions to be reached.
 func (m model) Init() tea.Cmd {
-	return tea.Batch(tea.EnterAltScreen, tick())
+	return tea.Batch(tea.EnterAltScreen, waitForBatches(m.ingest, time.Now()),
+		waitForConnection(m.ingest, m.connection))
 }
 
 // Update is called when messages are received. The idea is that you inspect the
@@ -98,10 +587,23 @@ func (m model) Update(msg tea.Msg) (tea.Model, tea.Cmd) {
 
 	switch msg := msg.(type) {
 	case tea.WindowSizeMsg:
-		m.width = msg.Width
 		topGap, rightGap, bottomGap, leftGap := appStyle.GetPadding()
-		m.list.SetSize(msg.Width-leftGap-rightGap, msg.Height-topGap-bottomGap)
+		m.width, m.height = msg.Width-leftGap-rightGap, msg.Height-topGap-bottomGap
+		m.resize()
 	case tea.KeyMsg:
+		if m.filter.state == list.Filtering {
+			return m.updateFilter(msg)
+		}
+		if m.jumping {
+			return m.updateJump(msg)
+		}
+		if m.exporting {
+			return m.updateExport(msg)
+		}
+		if m.aggregating {
+			return m.updateAggregate(msg)
+		}
+
 		switch keypress := msg.String(); keypress {
 		case "ctrl+c":
 			return m, tea.Quit
@@ -117,49 +619,103 @@ func (m model) Update(msg tea.Msg) (tea.Model, tea.Cmd) {
 			if !m.list.Paginator.OnLastPage() {
 				m.list.Paginator.Page++
 			}
-		case "esc":
-			if m.list.FilterState() == list.Unfiltered {
-				// Does not let `list` process `esc` to avoid exiting the program with `esc`
+		case "/":
+			m.setFilterState(list.Filtering)
+			return m, nil
+		case "t":
+			m.jumping = true
+			m.jumpInput.Focus()
+			m.resize()
+			return m, nil
+		case "x":
+			if !m.exportable {
+				return m, m.list.NewStatusMessage("Set LTTNG_GO_TABLE to keep events to export")
+			}
+			m.exporting = true
+			m.exportInput.Focus()
+			m.resize()
+			return m, nil
+		case "n":
+			selected, ok := m.list.SelectedItem().(item)
+			if !ok {
 				return m, nil
 			}
-		default:
-			if !m.list.SettingFilter() && (keypress == "q") {
-				return m, tea.Quit
+			if err := m.showNextOfName(selected); err != nil {
+				return m, m.list.NewStatusMessage(err.Error())
+			}
+			return m, m.historyStatus()
+		case "m":
+			m.showStats = !m.showStats
+			m.resize()
+			return m, nil
+		case "e":
+			m.showEnv = !m.showEnv
+			m.resize()
+			return m, nil
+		case "a":
+			m.aggregating = true
+			C.ingest_set_count_only(m.ingest, true)
+			m.refreshAggregate()
+			return m, waitForAggregateFrame()
+		case "esc":
+			if m.history != nil {
+				m.history = nil
+				m.setItems()
+				m.selectLast()
+			} else if m.filter.state == list.FilterApplied {
+				m.clearFilter()
 			}
+			// Does not let `list` process `esc` to avoid exiting the program with `esc`
+			return m, nil
+		case "q":
+			return m, tea.Quit
+		}
+	case batchesReadyMsg:
+		start := time.Now()
+		following := m.list.Index() >= len(m.list.Items())-1
+		selected, _ := m.list.SelectedItem().(item)
+		added := 0
+		for batch := C.ingest_pop(m.ingest); batch != nil; batch = C.ingest_pop(m.ingest) {
+			added += m.appendBatch(batch)
 		}
-	case tickMsg:
-		var string_array **C.char = C.run_graph_once(graph, &relay_data)
-		slice := unsafe.Slice(string_array, relay_data.msg_count)
-
-		if relay_data.msg_count == 0 {
-			return m, tick()
-		}
-		hasValidMsg := false
-		for _, cMsg := range slice {
-			goMsg := C.GoString(cMsg)
-			if goMsg != "" {
-				hasValidMsg = true
-				var data message
-				err := json.Unmarshal([]byte(goMsg), &data)
-				if err != nil {
-					// TODO: log the warning
-					panic(err)
-				}
-
-				payload, _ := json.Marshal(data["payload"])
-				m.messages = append(m.messages, item{
-					title:       data["name"].(string),
-					description: wordwrap.String(strings.Replace(string(payload), ",", ", ", -1), m.width),
-				})
+		// Spilled events stay shown until leaving them
+		if added > 0 && m.history == nil {
+			cmds = append(cmds, m.setItems())
+			if following {
+				m.selectLast()
+			} else {
+				m.selectSeq(selected.seq)
 			}
 		}
-		if hasValidMsg {
-			m.list.SetItems(m.messages)
-			m.list.Paginator.Page = m.list.Paginator.TotalPages - 1
-			m.list.Select(len(m.list.Items()) - 1)
+		m.updateLossStatus()
+		m.metrics.recordIngest(time.Since(start))
+		cmds = append(cmds, waitForBatches(m.ingest, time.Now()))
+	case aggregateFrameMsg:
+		if m.aggregating {
+			m.refreshAggregate()
+			cmds = append(cmds, waitForAggregateFrame())
 		}
-		cmds = append(cmds, tick())
-
+	case connectionMsg:
+		m.connection = uint64(msg.connection.generation)
+		m.list.Title = connectionTitle(msg.connection)
+		if msg.connection.state == C.INGEST_CONNECTION_WAITING {
+			log.Printf("Lost the live sessions, retrying in %s",
+				time.Duration(msg.connection.retry_ns))
+		}
+		if C.get_ingest_state(m.ingest) == C.INGEST_STATE_RUNNING {
+			cmds = append(cmds, waitForConnection(m.ingest, m.connection))
+		}
+	case exportDoneMsg:
+		log.Print(msg.status)
+		cmds = append(cmds, m.list.NewStatusMessage(msg.status))
+	case ingestStoppedMsg:
+		status := "Trace ended"
+		if C.get_ingest_state(m.ingest) == C.INGEST_STATE_FAILED {
+			status = ingestFailure(m.ingest)
+		}
+		m.updateLossStatus()
+		log.Print(status)
+		cmds = append(cmds, m.list.NewStatusMessage(status))
 	}
 	var cmd tea.Cmd
 	m.list, cmd = m.list.Update(msg)
@@ -168,18 +724,549 @@ func (m model) Update(msg tea.Msg) (tea.Model, tea.Cmd) {
 	return m, tea.Batch(cmds...)
 }
 
+// updateFilter handles `msg` while the filter is being edited.
+func (m model) updateFilter(msg tea.KeyMsg) (tea.Model, tea.Cmd) {
+	switch msg.String() {
+	case "ctrl+c":
+		return m, tea.Quit
+	case "ctrl+j":
+		m.list.CursorDown()
+		return m, nil
+	case "ctrl+k":
+		m.list.CursorUp()
+		return m, nil
+	case "esc":
+		m.clearFilter()
+		return m, nil
+	case "enter":
+		value := m.filterInput.Value()
+		expression := strings.TrimPrefix(value, pushdownPrefix)
+		if expression == value {
+			expression = ""
+		}
+		if err := m.pushFilter(expression); err != nil {
+			return m, m.list.NewStatusMessage("Invalid filter: " + err.Error())
+		}
+
+		if m.pushdown != "" {
+			m.setFilterState(list.FilterApplied)
+			return m, m.list.NewStatusMessage("Receiving only the events matching " + m.pushdown)
+		}
+		if m.filter.Active() {
+			m.setFilterState(list.FilterApplied)
+		} else {
+			m.setFilterState(list.Unfiltered)
+		}
+		return m, nil
+	}
+
+	var cmd tea.Cmd
+	m.filterInput, cmd = m.filterInput.Update(msg)
+	query := toLowerASCII(m.filterInput.Value())
+	if strings.HasPrefix(query, pushdownPrefix) {
+		// Event filter expression: only applied on enter
+		query = ""
+	}
+	if query != m.filter.query {
+		m.setQuery(query)
+	}
+	return m, cmd
+}
+
+// updateJump handles `msg` while the time to jump to is being edited.
+func (m model) updateJump(msg tea.KeyMsg) (tea.Model, tea.Cmd) {
+	switch msg.String() {
+	case "ctrl+c":
+		return m, tea.Quit
+	case "esc", "enter":
+		value := m.jumpInput.Value()
+		m.jumping = false
+		m.jumpInput.Blur()
+		m.jumpInput.Reset()
+		m.resize()
+		if msg.String() == "esc" || value == "" {
+			return m, nil
+		}
+
+		reference := time.Now().UnixNano()
+		if selected, ok := m.list.SelectedItem().(item); ok {
+			reference = selected.timestamp
+		}
+		timestamp, err := parseJumpTime(value, reference)
+		if err == nil {
+			err = m.showTime(timestamp)
+		}
+		if err != nil {
+			return m, m.list.NewStatusMessage("Cannot jump: " + err.Error())
+		}
+		return m, m.historyStatus()
+	}
+
+	var cmd tea.Cmd
+	m.jumpInput, cmd = m.jumpInput.Update(msg)
+	return m, cmd
+}
+
+// updateExport handles `msg` while what to export is being edited.
+func (m model) updateExport(msg tea.KeyMsg) (tea.Model, tea.Cmd) {
+	switch msg.String() {
+	case "ctrl+c":
+		return m, tea.Quit
+	case "esc", "enter":
+		value := m.exportInput.Value()
+		m.exporting = false
+		m.exportInput.Blur()
+		m.exportInput.Reset()
+		m.resize()
+		if msg.String() == "esc" || value == "" {
+			return m, nil
+		}
+
+		reference := time.Now().UnixNano()
+		if selected, ok := m.list.SelectedItem().(item); ok {
+			reference = selected.timestamp
+		}
+		request, err := parseExportRequest(value, reference)
+		if err != nil {
+			return m, m.list.NewStatusMessage("Cannot export: " + err.Error())
+		}
+		return m, tea.Batch(m.list.NewStatusMessage("Exporting to "+request.path),
+			exportTable(m.ingest, request))
+	}
+
+	var cmd tea.Cmd
+	m.exportInput, cmd = m.exportInput.Update(msg)
+	return m, cmd
+}
+
+// updateAggregate handles `msg` while the aggregation table is shown.
+func (m model) updateAggregate(msg tea.KeyMsg) (tea.Model, tea.Cmd) {
+	switch msg.String() {
+	case "ctrl+c", "q":
+		return m, tea.Quit
+	case "a", "esc":
+		m.aggregating = false
+		C.ingest_set_count_only(m.ingest, false)
+		return m, m.list.NewStatusMessage("The events of the aggregation were only counted")
+	case "s":
+		m.aggregate.column = (m.aggregate.column + 1) % sortColumns
+		m.aggregate.sort()
+	case "g":
+		m.aggregate.byStream = !m.aggregate.byStream
+		m.refreshAggregate()
+	}
+	return m, nil
+}
+
+// refreshAggregate takes the counters of the events in.
+func (m *model) refreshAggregate() {
+	var session func(uint32) string
+	if m.tagSessions {
+		session = m.traceSession
+	}
+	m.aggregate.refresh(m.ingest, session)
+}
+
+// parseJumpTime parses the time to jump to `s`: nanoseconds from the clock
+// origin, an ISO 8601 date and time, or a time of the day of `reference`, all
+// in local time unless an offset is given.
+func parseJumpTime(s string, reference int64) (int64, error) {
+	if ns, err := strconv.ParseInt(s, 10, 64); err == nil {
+		return ns, nil
+	}
+	if t, err := time.Parse(time.RFC3339Nano, s); err == nil {
+		return t.UnixNano(), nil
+	}
+	if t, err := time.ParseInLocation("2006-01-02T15:04:05", s, time.Local); err == nil {
+		return t.UnixNano(), nil
+	}
+
+	// Fractional seconds are accepted after the seconds of any layout
+	t, err := time.ParseInLocation("15:04:05", s, time.Local)
+	if err != nil {
+		return 0, fmt.Errorf("invalid time %q", s)
+	}
+	day := time.Unix(0, reference).In(time.Local)
+	return time.Date(day.Year(), day.Month(), day.Day(), t.Hour(), t.Minute(), t.Second(),
+		t.Nanosecond(), time.Local).UnixNano(), nil
+}
+
+// showTime selects the first event at or after `timestamp`, or the last one.
+func (m *model) showTime(timestamp int64) error {
+	if m.spill != nil {
+		seq, err := m.spill.SeekTime(timestamp)
+		if err != nil {
+			return err
+		}
+		return m.showSeq(seq)
+	}
+
+	items := m.store.Items()
+	if len(items) == 0 {
+		return errors.New("no events yet")
+	}
+	index := sort.Search(len(items), func(i int) bool {
+		return items[i].(item).timestamp >= timestamp
+	})
+	if index == len(items) {
+		index--
+	}
+	return m.showSeq(items[index].(item).seq)
+}
+
+// showNextOfName selects the first event after `it` of the same name.
+func (m *model) showNextOfName(it item) error {
+	if m.spill != nil {
+		seq, found, err := m.spill.NextOfName(it.name, it.seq)
+		if err != nil {
+			return err
+		}
+		if !found {
+			return fmt.Errorf("no %s event after this one", it.name)
+		}
+		return m.showSeq(seq)
+	}
+
+	seqs := m.index.names[it.name]
+	index := sort.Search(len(seqs), func(i int) bool { return seqs[i] > it.seq })
+	if index == len(seqs) {
+		return fmt.Errorf("no %s event after this one", it.name)
+	}
+	return m.showSeq(seqs[index])
+}
+
+// showSeq selects the event of sequence number `seq`: among the retained
+// events if it still is, or else among the events of its spilled page, shown
+// instead until leaving them with esc.
+func (m *model) showSeq(seq uint64) error {
+	if _, ok := m.store.Get(seq); ok {
+		if m.history != nil {
+			m.history = nil
+			m.setItems()
+		}
+		m.selectSeq(seq)
+		return nil
+	}
+
+	if m.spill == nil {
+		return errors.New("the event is not retained anymore")
+	}
+	page, ok := m.spill.PageOfSeq(seq)
+	if !ok {
+		return errors.New("the event is not retained anymore")
+	}
+	items, err := m.spill.ReadPage(page)
+	if err != nil {
+		return err
+	}
+	m.history = items
+	m.setItems()
+	m.selectSeq(seq)
+	return nil
+}
+
+// historyStatus tells, when showing spilled events, how to leave them.
+func (m *model) historyStatus() tea.Cmd {
+	if m.history == nil {
+		return nil
+	}
+	return m.list.NewStatusMessage("Showing spilled events, esc to go back")
+}
+
+// clearFilter shows all the events again, and receives them all again.
+func (m *model) clearFilter() {
+	m.filterInput.Reset()
+	m.setQuery("")
+	_ = m.pushFilter("")
+	m.setFilterState(list.Unfiltered)
+}
+
+// pushFilter makes the ingestion thread only render the events selected by the
+// event filter `expression` (see event_filter.h), or all of them if
+// `expression` is empty. Events received so far are left as they are.
+func (m *model) pushFilter(expression string) error {
+	if expression == m.pushdown {
+		return nil
+	}
+
+	var filter *C.event_filter
+	if expression != "" {
+		cExpression := C.CString(expression)
+		defer C.free(unsafe.Pointer(cExpression))
+
+		var cError [256]C.char
+		filter = C.create_event_filter(cExpression, &cError[0], C.size_t(len(cError)))
+		if filter == nil {
+			return errors.New(C.GoString(&cError[0]))
+		}
+	}
+
+	C.ingest_set_filter(m.ingest, filter)
+	m.pushdown = expression
+	return nil
+}
+
+// setQuery filters the events with `query` and shows the newest match.
+func (m *model) setQuery(query string) {
+	m.filter.SetQuery(query, m.store, m.index)
+	m.setItems()
+	m.selectLast()
+}
+
+// setFilterState shows the filter input while the filter is being edited or
+// applied, focused only in the former case.
+func (m *model) setFilterState(state list.FilterState) {
+	m.filter.state = state
+	if state == list.Filtering {
+		m.filterInput.Focus()
+	} else {
+		m.filterInput.Blur()
+	}
+	m.resize()
+}
+
+// Lines of the stats panel: one per pipeline stage
+const statsPanelHeight = 5
+
+// Lines of the environment panel, which cuts longer environments
+const envPanelHeight = 4
+
+// resize fits the list in the available space, minus the filter, jump and export
+// input lines and the stats and environment panels when shown.
+func (m *model) resize() {
+	height := m.height
+	if m.filter.state != list.Unfiltered {
+		height--
+	}
+	if m.jumping {
+		height--
+	}
+	if m.exporting {
+		height--
+	}
+	if m.showStats {
+		height -= statsPanelHeight + 1
+	}
+	if m.showEnv {
+		height -= envPanelHeight + 1
+	}
+	m.list.SetSize(m.width, height)
+}
+
+// setItems hands the spilled events being shown, or else the events, or only the
+// matching ones when filtering, over to the list. The list takes them as they
+// are, without copying nor filtering.
+func (m *model) setItems() tea.Cmd {
+	if m.history != nil {
+		return m.list.SetItems(m.history)
+	}
+	if m.filter.Active() {
+		return m.list.SetItems(m.filter.items)
+	}
+	return m.list.SetItems(m.store.Items())
+}
+
+func (m *model) selectLast() {
+	m.list.Paginator.Page = m.list.Paginator.TotalPages - 1
+	m.list.Select(len(m.list.Items()) - 1)
+}
+
+// selectSeq selects the event of sequence number `seq` or, if it is not
+// listed anymore, the following one.
+func (m *model) selectSeq(seq uint64) {
+	items := m.list.Items()
+	if len(items) == 0 {
+		return
+	}
+	index := sort.Search(len(items), func(i int) bool { return items[i].(item).seq >= seq })
+	if index == len(items) {
+		index--
+	}
+	m.list.Select(index)
+}
+
+// appendBatch appends the records of `batch` to the store, indexing them, and
+// releases it. It returns the number of appended records.
+func (m *model) appendBatch(batch *C.event_batch) int {
+	// Copy the whole batch to the Go heap at once: records are sub-slices of it
+	arena := C.GoBytes(unsafe.Pointer(batch.arena.data), C.int(batch.arena.size))
+	records := unsafe.Slice(batch.records, batch.count)
+
+	for i := range records {
+		record := &records[i]
+		payload := arena[record.payload_offset : record.payload_offset+record.payload_length]
+		it := item{
+			seq:       m.nextSeq,
+			name:      internedString(record.name),
+			timestamp: int64(record.timestamp_ns),
+			streamID:  uint64(record.stream_id),
+			traceID:   uint32(record.trace_id),
+			record:    arena[record.offset : record.offset+record.length],
+			payload:   payload,
+
+			payloadOffset: uint32(record.payload_offset - record.offset),
+		}
+		if m.tagSessions {
+			it.session = m.traceSession(uint32(record.trace_id))
+		}
+		it.indexBytes = m.index.Add(it)
+		m.store.Append(it)
+		if m.spill != nil {
+			if err := m.spill.Append(it); err != nil {
+				log.Printf("Cannot spill the events anymore: %v", err)
+				m.spill.Close()
+				m.spill = nil
+			}
+		}
+		m.filter.Append(it)
+		m.nextSeq++
+	}
+	C.release_batch(batch)
+
+	oldest := m.store.OldestSeq()
+	m.index.Evict(oldest)
+	m.filter.Evict(oldest)
+
+	return len(records)
+}
+
+// traceSession returns the session tag of the trace of id `id`.
+func (m *model) traceSession(id uint32) string {
+	session, ok := traceSessions[id]
+	if !ok {
+		if info := C.ingest_trace_info(m.ingest, C.uint32_t(id)); info != nil {
+			session = C.GoString(info.session)
+			traceSessions[id] = session
+		}
+	}
+	return session
+}
+
+// traceEnvironment returns the description of the trace of id `id`: its name
+// and session tag, then its environment entries.
+func (m *model) traceEnvironment(id uint32) string {
+	description, ok := traceEnvironments[id]
+	if ok {
+		return description
+	}
+	info := C.ingest_trace_info(m.ingest, C.uint32_t(id))
+	if info == nil {
+		return "Unknown trace"
+	}
+
+	var b strings.Builder
+	fmt.Fprintf(&b, "Trace %s (%s):", C.GoString(info.name), C.GoString(info.session))
+	for _, entry := range unsafe.Slice(info.env, info.env_count) {
+		if entry.is_integer {
+			fmt.Fprintf(&b, " %s=%d", C.GoString(entry.name), int64(entry.integer))
+		} else {
+			fmt.Fprintf(&b, " %s=%q", C.GoString(entry.name), C.GoString(entry.string))
+		}
+	}
+	description = b.String()
+	traceEnvironments[id] = description
+	return description
+}
+
+// envPanel renders the environment of the trace of the selected event within
+// `width` columns.
+func (m *model) envPanel(width int) string {
+	selected, ok := m.list.SelectedItem().(item)
+	if !ok {
+		return "No event selected"
+	}
+	lines := strings.Split(wordwrap.String(m.traceEnvironment(selected.traceID), width), "\n")
+	if len(lines) > envPanelHeight {
+		lines = lines[:envPanelHeight]
+	}
+	return strings.Join(lines, "\n")
+}
+
+// internedString returns the Go string of the C string `str` interned by the
+// decoder cache, such as an event name.
+func internedString(str *C.char) string {
+	goStr, ok := internedStrings[str]
+	if !ok {
+		goStr = C.GoString(str)
+		internedStrings[str] = goStr
+	}
+	return goStr
+}
+
 // Views return a string based on data in the model. That string which will be
 // rendered to the terminal.
 func (m model) View() string {
-	return appStyle.Render(m.list.View())
+	start := time.Now()
+	defer func() { m.metrics.recordRender(time.Since(start)) }()
+
+	if m.aggregating {
+		return appStyle.Render(m.aggregate.render(m.height, m.tagSessions))
+	}
+
+	view := m.list.View()
+	if m.filter.state != list.Unfiltered {
+		view = m.filterInput.View() + "\n" + view
+	}
+	if m.jumping {
+		view = m.jumpInput.View() + "\n" + view
+	}
+	if m.exporting {
+		view = m.exportInput.View() + "\n" + view
+	}
+	if m.showStats {
+		view += "\n\n" + statsPanel(collectMetrics(m.ingest, m.metrics))
+	}
+	if m.showEnv {
+		view += "\n\n" + m.envPanel(m.width)
+	}
+	return appStyle.Render(view)
 }
 
-// Messages are events that we respond to in our Update function. This
-// particular one indicates that the timer has ticked.
-type tickMsg time.Time
+// batchesReadyMsg indicates that the ingestion thread has published batches.
+type batchesReadyMsg struct{}
 
-func tick() tea.Cmd {
-	return tea.Tick(time.Duration(time.Millisecond), func(t time.Time) tea.Msg {
-		return tickMsg(t)
-	})
+// ingestStoppedMsg indicates that the ingestion thread won't publish batches
+// anymore.
+type ingestStoppedMsg struct{}
+
+// connectionMsg indicates that the connection to the live sessions changed.
+type connectionMsg struct {
+	connection C.ingest_connection
+}
+
+// aggregateFrameMsg indicates that the aggregation table is due for a refresh.
+type aggregateFrameMsg struct{}
+
+// waitForAggregateFrame returns a command which waits for one frame, the
+// counters being refreshed at the frame rate of the UI.
+func waitForAggregateFrame() tea.Cmd {
+	return tea.Tick(frameInterval, func(time.Time) tea.Msg { return aggregateFrameMsg{} })
+}
+
+// waitForConnection returns a command which waits until the connection to the
+// live sessions changes from the one of `generation`, or the ingestion is over.
+func waitForConnection(ingest *C.ingest, generation uint64) tea.Cmd {
+	return func() tea.Msg {
+		if !ingestWaiters.Enter() {
+			return nil
+		}
+		defer ingestWaiters.Leave()
+		return connectionMsg{C.ingest_wait_connection(ingest, C.uint64_t(generation))}
+	}
+}
+
+// waitForBatches returns a command which waits, no sooner than one frame after
+// `lastFrame`, until the ingestion thread has published batches.
+func waitForBatches(ingest *C.ingest, lastFrame time.Time) tea.Cmd {
+	return func() tea.Msg {
+		if !ingestWaiters.Enter() {
+			return ingestStoppedMsg{}
+		}
+		defer ingestWaiters.Leave()
+		time.Sleep(time.Until(lastFrame.Add(frameInterval)))
+		if C.ingest_wait(ingest) {
+			return batchesReadyMsg{}
+		}
+		return ingestStoppedMsg{}
+	}
 }
@@ -0,0 +1,239 @@
+package main
+
+/*
+   #include <ingest.h>
+*/
+import "C"
+
+import (
+	"fmt"
+	"log"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync"
+	"time"
+)
+
+// Same buckets as a metrics_histogram (see pipeline_metrics.h)
+const histogramBuckets = C.METRICS_HISTOGRAM_BUCKETS
+
+// How often the metrics file is written
+const metricsInterval = 5 * time.Second
+
+// histogram counts values in log2 buckets: bucket 0 counts the zero values,
+// and bucket i the values within [2^(i-1), 2^i).
+type histogram struct {
+	buckets [histogramBuckets]uint64
+	count   uint64
+	sum     uint64
+}
+
+func (h *histogram) record(value uint64) {
+	bucket := 0
+	for v := value; v > 0 && bucket < histogramBuckets-1; v >>= 1 {
+		bucket++
+	}
+	h.buckets[bucket]++
+	h.count++
+	h.sum += value
+}
+
+// quantile returns the upper bound of the bucket of the quantile `q`.
+func (h *histogram) quantile(q float64) uint64 {
+	rank := uint64(q * float64(h.count))
+	var seen uint64
+	for i, n := range h.buckets {
+		seen += n
+		if seen > rank {
+			return upperBound(i)
+		}
+	}
+	return upperBound(histogramBuckets - 1)
+}
+
+// upperBound returns the largest value of the bucket `i`.
+func upperBound(i int) uint64 {
+	return (uint64(1) << i) - 1
+}
+
+func fromCHistogram(c *C.metrics_histogram) histogram {
+	var h histogram
+	for i := range h.buckets {
+		h.buckets[i] = uint64(c.buckets[i])
+	}
+	h.count = uint64(c.count)
+	h.sum = uint64(c.sum)
+	return h
+}
+
+// uiMetrics times what the UI does, in nanoseconds.
+type uiMetrics struct {
+	mu     sync.Mutex
+	ingest histogram // Taking the published batches in
+	render histogram // Rendering a frame
+}
+
+func (m *uiMetrics) recordIngest(d time.Duration) {
+	m.mu.Lock()
+	m.ingest.record(uint64(d))
+	m.mu.Unlock()
+}
+
+func (m *uiMetrics) recordRender(d time.Duration) {
+	m.mu.Lock()
+	m.render.record(uint64(d))
+	m.mu.Unlock()
+}
+
+// metric is a histogram of a pipeline stage, and how to show it.
+type metric struct {
+	name  string // Prometheus metric name
+	help  string
+	label string  // Stats panel label
+	scale float64 // From the recorded values to the exported unit
+	unit  string  // Stats panel unit, empty for durations
+	h     histogram
+}
+
+// collectMetrics snapshots the metrics of the pipeline stages, from the graph
+// to the UI, in this order.
+func collectMetrics(ingest *C.ingest, ui *uiMetrics) []metric {
+	pipeline := C.get_ingest_metrics(ingest)
+	metrics := []metric{
+		{"lttng_go_graph_run_seconds", "Duration of the bt_graph_run_once() calls.",
+			"graph run", 1e-9, "", fromCHistogram(&pipeline.graph_run_ns)},
+		{"lttng_go_batch_messages", "Messages consumed per graph run.",
+			"batch", 1, " msgs", fromCHistogram(&pipeline.batch_messages)},
+		{"lttng_go_decode_seconds", "Decoding duration per message.",
+			"decode", 1e-9, "", fromCHistogram(&pipeline.decode_ns)},
+	}
+
+	if ui != nil {
+		ui.mu.Lock()
+		metrics = append(metrics,
+			metric{"lttng_go_ui_ingest_seconds", "Duration of taking the published batches in.",
+				"UI ingest", 1e-9, "", ui.ingest},
+			metric{"lttng_go_ui_render_seconds", "Duration of rendering a frame.",
+				"UI render", 1e-9, "", ui.render})
+		ui.mu.Unlock()
+	}
+	return metrics
+}
+
+// formatMetricValue returns `value`, in the unit of `m`, for the stats panel.
+func (m *metric) formatMetricValue(value float64) string {
+	if m.unit != "" {
+		return fmt.Sprintf("%.0f%s", value, m.unit)
+	}
+	return time.Duration(value).String()
+}
+
+// statsPanel returns one line per metric, to show under the list.
+func statsPanel(metrics []metric) string {
+	var b strings.Builder
+	for i, m := range metrics {
+		if i > 0 {
+			b.WriteByte('\n')
+		}
+		mean := 0.0
+		if m.h.count > 0 {
+			mean = float64(m.h.sum) / float64(m.h.count)
+		}
+		fmt.Fprintf(&b, "%-10s mean %-10s p50 ≤ %-10s p99 ≤ %-10s (%d)", m.label,
+			m.formatMetricValue(mean), m.formatMetricValue(float64(m.h.quantile(0.5))),
+			m.formatMetricValue(float64(m.h.quantile(0.99))), m.h.count)
+	}
+	return b.String()
+}
+
+// writePrometheus writes `metrics`, the events dropped by each overflow policy
+// and the field classes which cannot be decoded so far in the Prometheus text
+// exposition format.
+func writePrometheus(b *strings.Builder, metrics []metric, loss C.ingest_loss,
+	unknownFieldClasses uint64) {
+	fmt.Fprintf(b, "# HELP lttng_go_dropped_events_total Events dropped by the overflow policy.\n")
+	fmt.Fprintf(b, "# TYPE lttng_go_dropped_events_total counter\n")
+	for policy, name := range overflowPolicyNames {
+		fmt.Fprintf(b, "lttng_go_dropped_events_total{policy=\"%s\"} %d\n", name,
+			uint64(loss.events[policy]))
+	}
+	fmt.Fprintf(b, "# HELP lttng_go_dropped_bytes_total Bytes of the renderings dropped by the overflow policy.\n")
+	fmt.Fprintf(b, "# TYPE lttng_go_dropped_bytes_total counter\n")
+	for policy, name := range overflowPolicyNames {
+		fmt.Fprintf(b, "lttng_go_dropped_bytes_total{policy=\"%s\"} %d\n", name,
+			uint64(loss.bytes[policy]))
+	}
+	fmt.Fprintf(b, "# HELP lttng_go_blocked_batches_total Batches published only once the UI freed a slot.\n")
+	fmt.Fprintf(b, "# TYPE lttng_go_blocked_batches_total counter\n")
+	fmt.Fprintf(b, "lttng_go_blocked_batches_total %d\n", uint64(loss.blocked_batches))
+	fmt.Fprintf(b, "# HELP lttng_go_blocked_seconds_total Time the graph waited for the UI to free a slot.\n")
+	fmt.Fprintf(b, "# TYPE lttng_go_blocked_seconds_total counter\n")
+	fmt.Fprintf(b, "lttng_go_blocked_seconds_total %g\n", float64(loss.blocked_ns)/1e9)
+	fmt.Fprintf(b, "# HELP lttng_go_unknown_field_classes_total Field classes left out of the events.\n")
+	fmt.Fprintf(b, "# TYPE lttng_go_unknown_field_classes_total counter\n")
+	fmt.Fprintf(b, "lttng_go_unknown_field_classes_total %d\n", unknownFieldClasses)
+
+	for _, m := range metrics {
+		fmt.Fprintf(b, "# HELP %s %s\n# TYPE %s histogram\n", m.name, m.help, m.name)
+
+		// Every bucket, for the series not to change from a scrape to the next,
+		// but the last one: it counts all the larger values, which +Inf does.
+		// The histograms are read while being written, so the count is summed
+		// from the buckets rather than read, for +Inf not to be below them.
+		var cumulative uint64
+		for i := 0; i < histogramBuckets-1; i++ {
+			cumulative += m.h.buckets[i]
+			fmt.Fprintf(b, "%s_bucket{le=\"%g\"} %d\n", m.name,
+				float64(upperBound(i))*m.scale, cumulative)
+		}
+		count := cumulative + m.h.buckets[histogramBuckets-1]
+		fmt.Fprintf(b, "%s_bucket{le=\"+Inf\"} %d\n", m.name, count)
+		fmt.Fprintf(b, "%s_sum %g\n", m.name, float64(m.h.sum)*m.scale)
+		fmt.Fprintf(b, "%s_count %d\n", m.name, count)
+	}
+}
+
+// exportMetrics writes the metrics to the file at `path` every
+// metricsInterval, and once more when `stop` is closed, before closing `done`.
+func exportMetrics(path string, ingest *C.ingest, ui *uiMetrics, stop <-chan struct{},
+	done chan<- struct{}) {
+	defer close(done)
+	ticker := time.NewTicker(metricsInterval)
+	defer ticker.Stop()
+
+	for {
+		select {
+		case <-stop:
+			writeMetricsFile(path, ingest, ui)
+			return
+		case <-ticker.C:
+			writeMetricsFile(path, ingest, ui)
+		}
+	}
+}
+
+// writeMetricsFile replaces the file at `path` with the current metrics at
+// once, so that a collector never reads it half written.
+func writeMetricsFile(path string, ingest *C.ingest, ui *uiMetrics) {
+	var b strings.Builder
+	writePrometheus(&b, collectMetrics(ingest, ui), C.get_ingest_loss(ingest),
+		uint64(C.get_ingest_metrics(ingest).unknown_field_classes))
+
+	tmp, err := os.CreateTemp(filepath.Dir(path), filepath.Base(path)+".*")
+	if err != nil {
+		log.Printf("Cannot write the metrics: %v", err)
+		return
+	}
+	_, err = tmp.WriteString(b.String())
+	if closeErr := tmp.Close(); err == nil {
+		err = closeErr
+	}
+	if err == nil {
+		err = os.Rename(tmp.Name(), path)
+	}
+	if err != nil {
+		os.Remove(tmp.Name())
+		log.Printf("Cannot write the metrics: %v", err)
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Number of buckets of a metrics_histogram: bucket 0 counts the zero
+ * values, and bucket i the values within [2^(i-1), 2^i), the last one
+ * also counting anything larger.
+ */
+#define METRICS_HISTOGRAM_BUCKETS 48
+
+/*
+ * Log2 histogram written by a single thread and read by any other.
+ *
+ * Having a single writer, recording is a few relaxed loads and stores
+ * instead of locked read-modify-writes. A reader may see a recording
+ * half done, which is fine for monitoring.
+ */
+typedef struct metrics_histogram {
+  uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+} metrics_histogram;
+
+static void metrics_add(uint64_t* const counter, uint64_t const value) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+/*
+ * Records `count` occurrences of `value`. Single writer only.
+ */
+static void histogram_record_n(metrics_histogram* const histogram,
+                               uint64_t const value,
+                               uint64_t const count) {
+  uint32_t bucket = value ? 64 - (uint32_t)__builtin_clzll(value) : 0;
+  if (bucket >= METRICS_HISTOGRAM_BUCKETS) {
+    bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+  }
+
+  metrics_add(&histogram->buckets[bucket], count);
+  metrics_add(&histogram->count, count);
+  metrics_add(&histogram->sum, value * count);
+}
+
+static void histogram_record(metrics_histogram* const histogram, uint64_t const value) {
+  histogram_record_n(histogram, value, 1);
+}
+
+/*
+ * Adds what `from`, written by another thread, recorded so far to `to`.
+ */
+static void histogram_merge(metrics_histogram* const to, const metrics_histogram* const from) {
+  for (uint32_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+    to->buckets[i] += __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+  }
+  to->count += __atomic_load_n(&from->count, __ATOMIC_RELAXED);
+  to->sum += __atomic_load_n(&from->sum, __ATOMIC_RELAXED);
+}
+
+/*
+ * What the thread running a trace processing graph spends its time on.
+ */
+typedef struct pipeline_metrics {
+  metrics_histogram graph_run_ns;   /* Each bt_graph_run_once() call */
+  metrics_histogram batch_messages; /* Messages of each relay_consume() batch */
+  metrics_histogram decode_ns;      /* handle_msg(), per message */
+
+  /* Field classes left out of the events (see is_decodable_field_class_type()),
+   * only set by get_ingest_metrics() */
+  uint64_t unknown_field_classes;
+} pipeline_metrics;
+
+static void pipeline_metrics_merge(pipeline_metrics* const to,
+                                   const pipeline_metrics* const from) {
+  histogram_merge(&to->graph_run_ns, &from->graph_run_ns);
+  histogram_merge(&to->batch_messages, &from->batch_messages);
+  histogram_merge(&to->decode_ns, &from->decode_ns);
+}
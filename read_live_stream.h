@@ -2,23 +2,122 @@
 
 #include <assert.h>
 #include <babeltrace2/babeltrace.h>
-#include <json-c/json.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "decode_event.h"
+#include "decode_pool.h"
+#include "event_batch.h"
+#include "event_filter.h"
+#include "event_stats.h"
+#include "event_table.h"
+#include "pipeline_metrics.h"
 
-static void CheckBtError(int32_t status) {
-  switch (status) {
-    case BT_GRAPH_RUN_STATUS_OK:
-      return;
-    case BT_GRAPH_RUN_STATUS_MEMORY_ERROR:
-      quick_exit(EXIT_FAILURE);
-    default:
-      quick_exit(EXIT_FAILURE);
+/*
+ * Directories searched for the plugin files, after those of the
+ * BABELTRACE_PLUGIN_PATH environment variable, before falling back to
+ * bt_plugin_find(). Override with -DLTTNG_GO_PLUGIN_DIRS=... when
+ * babeltrace2 is installed elsewhere.
+ */
+#ifndef LTTNG_GO_PLUGIN_DIRS
+#define LTTNG_GO_PLUGIN_DIRS                                                         \
+  "/usr/lib/x86_64-linux-gnu/babeltrace2/plugins:/usr/lib/aarch64-linux-gnu/"        \
+  "babeltrace2/plugins:/usr/lib64/babeltrace2/plugins:/usr/lib/babeltrace2/plugins:" \
+  "/usr/local/lib/babeltrace2/plugins"
+#endif
+
+/*
+ * Most plugins kept by find_plugin(): we only use `ctf` and `utils`.
+ */
+#define PLUGIN_CACHE_CAPACITY 4
+
+/*
+ * Plugins found so far, kept for the whole process: finding a plugin
+ * loads shared objects, which takes the same time for every graph.
+ */
+static struct {
+  pthread_mutex_t lock;
+  const char* names[PLUGIN_CACHE_CAPACITY];
+  const bt_plugin* plugins[PLUGIN_CACHE_CAPACITY];
+  uint32_t count;
+} plugin_cache = {PTHREAD_MUTEX_INITIALIZER, {NULL}, {NULL}, 0};
+
+/*
+ * Returns a new reference on the plugin named `name` of the file
+ * `babeltrace-plugin-NAME.so` of one of the directories of `dirs`,
+ * separated by colons, or NULL if there is none.
+ */
+static const bt_plugin* find_plugin_in_dirs(const char* const name, const char* const dirs) {
+  const bt_plugin* plugin = NULL;
+
+  for (const char* dir = dirs; dir && *dir && !plugin;) {
+    const char* const end = strchr(dir, ':');
+    size_t const dir_len = end ? (size_t)(end - dir) : strlen(dir);
+    char path[4096];
+
+    if (dir_len > 0 && snprintf(path, sizeof(path), "%.*s/babeltrace-plugin-%s.so", (int)dir_len,
+                                dir, name) < (int)sizeof(path) &&
+        access(path, R_OK) == 0) {
+      const bt_plugin_set* set = NULL;
+      if (bt_plugin_find_all_from_file(path, BT_FALSE, &set) ==
+          BT_PLUGIN_FIND_ALL_FROM_FILE_STATUS_OK) {
+        for (uint64_t i = 0; i < bt_plugin_set_get_plugin_count(set) && !plugin; i++) {
+          const bt_plugin* const candidate = bt_plugin_set_borrow_plugin_by_index_const(set, i);
+          if (strcmp(bt_plugin_get_name(candidate), name) == 0) {
+            bt_plugin_get_ref(candidate);
+            plugin = candidate;
+          }
+        }
+        bt_plugin_set_put_ref(set);
+      }
+    }
+    dir = end ? end + 1 : NULL;
   }
+  return plugin;
+}
+
+/*
+ * Returns the plugin named `name`, which stays valid for the whole
+ * process, or NULL if there is none.
+ *
+ * Only the file of the plugin is loaded, from the directories of
+ * BABELTRACE_PLUGIN_PATH or LTTNG_GO_PLUGIN_DIRS, instead of every
+ * plugin of every directory as bt_plugin_find() does, which is only the
+ * fallback. Each plugin is found once per process.
+ */
+static const bt_plugin* find_plugin(const char* const name) {
+  pthread_mutex_lock(&plugin_cache.lock);
+  for (uint32_t i = 0; i < plugin_cache.count; i++) {
+    if (strcmp(plugin_cache.names[i], name) == 0) {
+      const bt_plugin* const plugin = plugin_cache.plugins[i];
+      pthread_mutex_unlock(&plugin_cache.lock);
+      return plugin;
+    }
+  }
+
+  const bt_plugin* plugin = find_plugin_in_dirs(name, getenv("BABELTRACE_PLUGIN_PATH"));
+  if (!plugin) {
+    plugin = find_plugin_in_dirs(name, LTTNG_GO_PLUGIN_DIRS);
+  }
+  if (!plugin &&
+      bt_plugin_find(name, BT_TRUE, BT_TRUE, BT_TRUE, BT_TRUE, BT_TRUE, &plugin) !=
+          BT_PLUGIN_FIND_STATUS_OK) {
+    plugin = NULL;
+  }
+
+  /* Keep the reference: the component classes of the plugin are borrowed from it */
+  if (plugin && plugin_cache.count < PLUGIN_CACHE_CAPACITY) {
+    plugin_cache.names[plugin_cache.count] = name;
+    plugin_cache.plugins[plugin_cache.count++] = plugin;
+  }
+  pthread_mutex_unlock(&plugin_cache.lock);
+  return plugin;
 }
 
 /*
@@ -28,8 +127,101 @@ static void CheckBtError(int32_t status) {
 typedef struct relay_data {
   bt_message_array_const msgs;
   uint64_t msg_count;
+
+  /* Status of the last bt_graph_run_once() call of run_graph_once() */
+  bt_graph_run_once_status status;
+
+  /* Compiled field layouts of the event classes seen so far */
+  decoder_cache decoders;
+
+  /* Events to render, all of them if NULL (see set_relay_filter()) */
+  event_filter* filter;
+  uint64_t filter_generation;
+
+  /* Encoding and recycled storage of the batches run_graph_once() returns */
+  output_format format;
+  byte_array_encoding bytes;
+  uint64_t bytes_max;
+  timestamp_formatter timestamps;
+  batch_pool batches;
+
+  /* Threads helping to render each batch, none if NULL (see set_relay_decode_threads()) */
+  decode_pool* decode_pool;
+
+  /* Counters of all the events, rendered or not */
+  event_stats stats;
+
+  /* Last events selected by the filter, by column (see event_table.h) */
+  event_table table;
+
+  /* Written by the thread running the graph only */
+  pipeline_metrics metrics;
 } relay_data;
 
+/*
+ * Initializes the zero-initialized `relay_data`, of which the traces get
+ * their id in `registry`.
+ */
+static void init_relay_data(struct relay_data* const relay_data,
+                            trace_registry* const registry) {
+  init_batch_pool(&relay_data->batches);
+  init_event_table(&relay_data->table);
+  relay_data->decoders.registry = registry;
+}
+
+/*
+ * Releases everything owned by `relay_data`.
+ */
+static void destroy_relay_data(struct relay_data* const relay_data) {
+  destroy_decode_pool(relay_data->decode_pool);
+  destroy_event_stats(&relay_data->stats);
+  destroy_event_table(&relay_data->table);
+  destroy_event_filter(relay_data->filter);
+  decoder_cache_destroy(&relay_data->decoders);
+  destroy_batch_pool(&relay_data->batches);
+}
+
+/*
+ * Forgets the trace classes and traces of the graph `relay_data` was
+ * attached to, once that graph is gone, so that it can be attached to a
+ * new one. The counters of the events and the filter are kept.
+ */
+static void reset_relay_data(struct relay_data* const relay_data) {
+  decoder_cache_reset(&relay_data->decoders);
+  if (relay_data->filter) {
+    forget_filter_trace(relay_data->filter);
+  }
+  relay_data->msg_count = 0;
+}
+
+/*
+ * Only renders the events `filter` selects from now on, or all of them
+ * if `filter` is NULL. `relay_data` takes ownership of `filter`.
+ */
+static void set_relay_filter(struct relay_data* const relay_data, event_filter* const filter) {
+  destroy_event_filter(relay_data->filter);
+  relay_data->filter = filter;
+  if (filter) {
+    filter->generation = ++relay_data->filter_generation;
+  }
+}
+
+/*
+ * Renders the events of each batch on `thread_count` more threads, or
+ * only on the thread running the graph if 0. Returns false if the
+ * threads cannot be started.
+ */
+static bool set_relay_decode_threads(struct relay_data* const relay_data,
+                                     uint32_t const thread_count) {
+  destroy_decode_pool(relay_data->decode_pool);
+  relay_data->decode_pool = NULL;
+  if (thread_count > 0) {
+    relay_data->decode_pool = create_decode_pool(thread_count);
+    return relay_data->decode_pool != NULL;
+  }
+  return true;
+}
+
 /*
  * Consumer method of our relay sink component class.
  *
@@ -44,7 +236,13 @@ static bt_graph_simple_sink_component_consume_func_status relay_consume(
   bt_graph_simple_sink_component_consume_func_status status =
       BT_GRAPH_SIMPLE_SINK_COMPONENT_CONSUME_FUNC_STATUS_OK;
 
-  /* Consume the next messages, storing them in `*relay_data` */
+  /*
+   * Consume the next messages, storing them in `*relay_data`.
+   *
+   * `*relay_data` is only set on success: don't leave the previous,
+   * already released, messages there otherwise.
+   */
+  relay_data->msg_count = 0;
   msg_iter_next_status =
       bt_message_iterator_next(msg_iter, &relay_data->msgs, &relay_data->msg_count);
   switch (msg_iter_next_status) {
@@ -52,6 +250,11 @@ static bt_graph_simple_sink_component_consume_func_status relay_consume(
 
       status = BT_GRAPH_SIMPLE_SINK_COMPONENT_CONSUME_FUNC_STATUS_END;
       break;
+    case BT_MESSAGE_ITERATOR_NEXT_STATUS_AGAIN:
+
+      /* No messages for now (e.g. the live source has nothing new) */
+      status = BT_GRAPH_SIMPLE_SINK_COMPONENT_CONSUME_FUNC_STATUS_AGAIN;
+      break;
     case BT_GRAPH_SIMPLE_SINK_COMPONENT_CONSUME_FUNC_STATUS_MEMORY_ERROR:
 
       status = BT_GRAPH_SIMPLE_SINK_COMPONENT_CONSUME_FUNC_STATUS_MEMORY_ERROR;
@@ -85,68 +288,141 @@ static bt_graph_add_component_status add_relay_comp(bt_graph* const graph,
 
 /*
  * Creates and returns the parameters to initialize the `src.ctf.lttng-live`
- * component with the trace directory `trace_dir`.
+ * component with the live session URL `listening_url`, or NULL if they
+ * cannot be created.
  *
  * See <https://babeltrace.org/docs/v2.0/libbabeltrace2/group__api-val.html>.
  */
 static bt_value* create_ctf_lttng_live_comp_params(const char* const listening_url) {
-  bt_value* params;
-  bt_value* inputs = NULL;
-  bt_value_map_insert_entry_status insert_entry_status;
-  bt_value_array_append_element_status append_elem_status;
-
-  bt_value* url_array = bt_value_array_create();
-
-  params = bt_value_map_create();
+  bt_value* params = bt_value_map_create();
   if (!params) {
-    BT_VALUE_PUT_REF_AND_RESET(params);
-    BT_VALUE_PUT_REF_AND_RESET(url_array);
-    return params;
+    return NULL;
   }
 
-  CheckBtError(bt_value_map_insert_entry(params, "inputs", url_array));
-  CheckBtError(bt_value_map_insert_string_entry(params, "session-not-found-action", "continue"));
-  CheckBtError(bt_value_array_append_string_element(url_array, listening_url));
-
+  bt_value* inputs = NULL;
+  if (bt_value_map_insert_empty_array_entry(params, "inputs", &inputs) !=
+          BT_VALUE_MAP_INSERT_ENTRY_STATUS_OK ||
+      bt_value_array_append_string_element(inputs, listening_url) !=
+          BT_VALUE_ARRAY_APPEND_ELEMENT_STATUS_OK ||
+      bt_value_map_insert_string_entry(params, "session-not-found-action", "continue") !=
+          BT_VALUE_MAP_INSERT_ENTRY_STATUS_OK) {
+    BT_VALUE_PUT_REF_AND_RESET(params);
+  }
   return params;
 }
 
 /*
- * Adds a `src.ctf.lttng-live` component named `ctf` to read the trace directory
- * `trace_dir` to the trace processing graph `graph`.
+ * Adds a `src.ctf.lttng-live` component named `name` to read the live session
+ * at `listening_url` to the trace processing graph `graph`.
  *
  * See <https://babeltrace.org/docs/v2.0/man7/babeltrace2-source.ctf.fs.7/>.
  *
- * On success, `*comp` is the added source component.
+ * On success, `*comp` is the added source component. Otherwise, why it
+ * could not be added is described in `error` unless babeltrace2 tells.
  */
 static bt_graph_add_component_status add_ctf_lttng_live_comp(
     bt_graph* const graph,
     const char* const listening_url,
-    const bt_component_source** const comp) {
+    const char* const name,
+    const bt_component_source** const comp,
+    char* const error,
+    size_t const error_size) {
   const bt_plugin* plugin;
-  bt_plugin_find_status plugin_find_status;
   const bt_component_class_source* comp_cls;
   bt_value* params = NULL;
   bt_graph_add_component_status add_comp_status;
 
   /* Find the `ctf` plugin */
-  plugin_find_status = bt_plugin_find("ctf", BT_TRUE, BT_TRUE, BT_TRUE, BT_TRUE, BT_TRUE, &plugin);
-  if (plugin_find_status != BT_PLUGIN_FIND_STATUS_OK) {
-    puts("Failed to find 'ctf' plugin.");
+  plugin = find_plugin("ctf");
+  if (!plugin) {
+    snprintf(error, error_size, "Failed to find 'ctf' plugin.");
     goto error;
   }
 
   /* Borrow the `lttng-live` source component class within the `ctf` plugin */
   comp_cls = bt_plugin_borrow_source_component_class_by_name_const(plugin, "lttng-live");
   if (!comp_cls) {
-    puts("Failed to find component 'lttng-live' in 'ctf' plugin.");
+    snprintf(error, error_size, "Failed to find component 'lttng-live' in 'ctf' plugin.");
     goto error;
   }
 
   /* Create the parameters to initialize the source component */
   params = create_ctf_lttng_live_comp_params(listening_url);
   if (!params) {
-    puts("Failed to create ctf.lttng-live parameters");
+    snprintf(error, error_size, "Failed to create ctf.lttng-live parameters.");
+    goto error;
+  }
+
+  /* Add the source component to the graph */
+  add_comp_status =
+      bt_graph_add_source_component(graph, comp_cls, name, params, BT_LOGGING_LEVEL_NONE, comp);
+  goto end;
+
+error:
+  add_comp_status = BT_GRAPH_ADD_COMPONENT_STATUS_ERROR;
+
+end:
+  bt_value_put_ref(params);
+  return add_comp_status;
+}
+
+/*
+ * Creates and returns the parameters to initialize the `src.ctf.fs`
+ * component with the trace directory `trace_dir`.
+ */
+static bt_value* create_ctf_fs_comp_params(const char* const trace_dir) {
+  bt_value* params = bt_value_map_create();
+  if (!params) {
+    return NULL;
+  }
+
+  bt_value* inputs = NULL;
+  if (bt_value_map_insert_empty_array_entry(params, "inputs", &inputs) !=
+          BT_VALUE_MAP_INSERT_ENTRY_STATUS_OK ||
+      bt_value_array_append_string_element(inputs, trace_dir) !=
+          BT_VALUE_ARRAY_APPEND_ELEMENT_STATUS_OK) {
+    BT_VALUE_PUT_REF_AND_RESET(params);
+  }
+  return params;
+}
+
+/*
+ * Adds a `src.ctf.fs` component named `ctf` to read the trace directory
+ * `trace_dir` to the trace processing graph `graph`.
+ *
+ * See <https://babeltrace.org/docs/v2.0/man7/babeltrace2-source.ctf.fs.7/>.
+ *
+ * On success, `*comp` is the added source component. Otherwise, why it
+ * could not be added is described in `error` unless babeltrace2 tells.
+ */
+static bt_graph_add_component_status add_ctf_fs_comp(bt_graph* const graph,
+                                                     const char* const trace_dir,
+                                                     const bt_component_source** const comp,
+                                                     char* const error,
+                                                     size_t const error_size) {
+  const bt_plugin* plugin;
+  const bt_component_class_source* comp_cls;
+  bt_value* params = NULL;
+  bt_graph_add_component_status add_comp_status;
+
+  /* Find the `ctf` plugin */
+  plugin = find_plugin("ctf");
+  if (!plugin) {
+    snprintf(error, error_size, "Failed to find 'ctf' plugin.");
+    goto error;
+  }
+
+  /* Borrow the `fs` source component class within the `ctf` plugin */
+  comp_cls = bt_plugin_borrow_source_component_class_by_name_const(plugin, "fs");
+  if (!comp_cls) {
+    snprintf(error, error_size, "Failed to find component 'fs' in 'ctf' plugin.");
+    goto error;
+  }
+
+  /* Create the parameters to initialize the source component */
+  params = create_ctf_fs_comp_params(trace_dir);
+  if (!params) {
+    snprintf(error, error_size, "Failed to create ctf.fs parameters.");
     goto error;
   }
 
@@ -159,7 +435,6 @@ error:
   add_comp_status = BT_GRAPH_ADD_COMPONENT_STATUS_ERROR;
 
 end:
-  bt_plugin_put_ref(plugin);
   bt_value_put_ref(params);
   return add_comp_status;
 }
@@ -175,14 +450,12 @@ end:
 static bt_graph_add_component_status add_muxer_comp(bt_graph* const graph,
                                                     const bt_component_filter** const comp) {
   const bt_plugin* plugin;
-  bt_plugin_find_status plugin_find_status;
   const bt_component_class_filter* comp_cls;
   bt_graph_add_component_status add_comp_status;
 
   /* Find the `utils` plugin */
-  plugin_find_status =
-      bt_plugin_find("utils", BT_TRUE, BT_TRUE, BT_TRUE, BT_TRUE, BT_TRUE, &plugin);
-  if (plugin_find_status != BT_PLUGIN_FIND_STATUS_OK) {
+  plugin = find_plugin("utils");
+  if (!plugin) {
     goto error;
   }
 
@@ -201,98 +474,215 @@ error:
   add_comp_status = BT_GRAPH_ADD_COMPONENT_STATUS_ERROR;
 
 end:
-  bt_plugin_put_ref(plugin);
   return add_comp_status;
 }
 
+/*
+ * Connects the output ports `first`, `first + step`, `first + 2 * step`,
+ * and so on, of the `source_count` source components `sources`, numbered
+ * one source after the other, to the input ports of the `muxer` filter
+ * component, and the `muxer` output port to the `relay` input port.
+ */
+static bt_graph_connect_ports_status connect_graph(bt_graph* const graph,
+                                                   const bt_component_source* const* const sources,
+                                                   uint64_t const source_count,
+                                                   uint64_t const first,
+                                                   uint64_t const step,
+                                                   const bt_component_filter* const muxer,
+                                                   const bt_component_sink* const relay) {
+  bt_graph_connect_ports_status connect_ports_status;
+  uint64_t in_port_index = 0;
+  uint64_t port = 0;
+
+  /*
+   * An `flt.utils.muxer` component adds an input port every time
+   * you connect one, making one always available.
+   *
+   * See <https://babeltrace.org/docs/v2.0/man7/babeltrace2-filter.utils.muxer.7/#doc-_input>.
+   */
+  for (uint64_t s = 0; s < source_count; s++) {
+    uint64_t const port_count = bt_component_source_get_output_port_count(sources[s]);
+
+    for (uint64_t i = 0; i < port_count; i++, port++) {
+      if (port % step != first) {
+        continue;
+      }
+
+      const bt_port_output* const out_port =
+          bt_component_source_borrow_output_port_by_index_const(sources[s], i);
+      const bt_port_input* const in_port =
+          bt_component_filter_borrow_input_port_by_index_const(muxer, in_port_index++);
+
+      /* Connect ports */
+      connect_ports_status = bt_graph_connect_ports(graph, out_port, in_port, NULL);
+
+      if (connect_ports_status != BT_GRAPH_CONNECT_PORTS_STATUS_OK) {
+        return connect_ports_status;
+      }
+    }
+  }
+
+  /* Connect the `muxer` output port to the `relay` input port */
+  return bt_graph_connect_ports(
+      graph, bt_component_filter_borrow_output_port_by_index_const(muxer, 0),
+      bt_component_sink_borrow_input_port_by_index_const(relay, 0), NULL);
+}
+
 /*
  * Creates a trace processing graph having this layout:
  *
- *     +------------+    +-----------------+    +--------------+
- *     | src.ctf.fs |    | flt.utils.muxer |    | Our own sink |
- *     |    [ctf]   |    |     [muxer]     |    |    [relay]   |
- *     |            |    |                 |    |              |
- *     |    stream0 @--->@ in0         out @--->@ in           |
- *     |    stream1 @--->@ in1             |    +--------------+
- *     |    stream2 @--->@ in2             |
- *     |    stream3 @--->@ in3             |
- *     +------------+    @ in4             |
- *                       +-----------------+
+ *     +--------------------+    +-----------------+    +--------------+
+ *     | src.ctf.lttng-live |    | flt.utils.muxer |    | Our own sink |
+ *     |       [ctf0]       |    |     [muxer]     |    |    [relay]   |
+ *     |                    |    |                 |    |              |
+ *     |                out @--->@ in0         out @--->@ in           |
+ *     +--------------------+    |                 |    +--------------+
+ *                               |                 |
+ *     +--------------------+    |                 |
+ *     | src.ctf.lttng-live |    |                 |
+ *     |       [ctf1]       |    |                 |
+ *     |                    |    |                 |
+ *     |                out @--->@ in1             |
+ *     +--------------------+    @ in2             |
+ *                               +-----------------+
  *
- * In the example above, the `src.ctf.fs` component reads a CTF trace
- * having four data streams. The `trace_dir` parameter is the directory
- * containing the CTF trace to read.
+ * In the example above, two `src.ctf.lttng-live` components each read
+ * the live session of one of the two `url_count` URLs of `urls`, which
+ * may be served by different relay daemons. The muxer interleaves their
+ * messages by time; the session of each event is told by the trace id
+ * of its record (see trace_registry).
  *
  * Our own relay sink component, of which the consuming method is
  * relay_consume(), consumes messages from the `flt.utils.muxer`
  * component, storing them to a structure (`*relay_data`) shared with
  * the bt_graph_run_once() call site.
  *
+ * Returns NULL, describing why in `error`, if the graph cannot be
+ * created. The UI owns the terminal, and the standard output may carry
+ * the events (see event_output.h): nothing is printed.
+ *
  * See <https://babeltrace.org/docs/v2.0/libbabeltrace2/group__api-graph.html>.
  */
-static bt_graph* create_graph(const char* const trace_dir, struct relay_data* const relay_data) {
+static bt_graph* create_graph(const char* const* const urls,
+                              uint64_t const url_count,
+                              struct relay_data* const relay_data,
+                              char* const error,
+                              size_t const error_size) {
   bt_graph* graph;
-  const bt_component_source* ctf_lttng_live_comp;
+  const bt_component_source** ctf_lttng_live_comps;
   const bt_component_filter* muxer_comp;
   const bt_component_sink* relay_comp;
   bt_graph_add_component_status add_comp_status;
   bt_graph_connect_ports_status connect_ports_status;
-  uint64_t i;
+
+  ctf_lttng_live_comps =
+      (const bt_component_source**)calloc(url_count, sizeof(bt_component_source*));
+  FAIL_FAST_IF(!ctf_lttng_live_comps);
 
   /* Create an empty trace processing graph */
   graph = bt_graph_create(0);
   if (!graph) {
-    puts("Failed to create an empty trace processing graph.");
+    snprintf(error, error_size, "Failed to create an empty trace processing graph.");
     goto error;
   }
 
-  /* Create and add the three required components to `graph` */
+  /* Create and add the required components to `graph` */
   add_comp_status = add_muxer_comp(graph, &muxer_comp);
   if (add_comp_status != BT_GRAPH_ADD_COMPONENT_STATUS_OK) {
-    puts("Failed to add component 'muxer'.");
+    snprintf(error, error_size, "Failed to add component 'muxer'.");
     goto error;
   }
 
   add_comp_status = add_relay_comp(graph, relay_data, &relay_comp);
   if (add_comp_status != BT_GRAPH_ADD_COMPONENT_STATUS_OK) {
-    puts("Failed to add component 'relay'.");
+    snprintf(error, error_size, "Failed to add component 'relay'.");
     goto error;
   }
 
-  add_comp_status = add_ctf_lttng_live_comp(graph, trace_dir, &ctf_lttng_live_comp);
-  if (add_comp_status != BT_GRAPH_ADD_COMPONENT_STATUS_OK) {
-    printf("Failed to add component 'ctf_lttng_live'. Returned status: %d\n", add_comp_status);
+  for (uint64_t i = 0; i < url_count; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "ctf%" PRIu64, i);
+
+    char comp_error[128] = "";
+    add_comp_status = add_ctf_lttng_live_comp(graph, urls[i], name, &ctf_lttng_live_comps[i],
+                                              comp_error, sizeof(comp_error));
+    if (add_comp_status != BT_GRAPH_ADD_COMPONENT_STATUS_OK) {
+      snprintf(error, error_size,
+               "Failed to add component 'ctf_lttng_live' reading '%s'. Returned status: %d. %s",
+               urls[i], add_comp_status, comp_error);
+      goto error;
+    }
+  }
+
+  connect_ports_status = connect_graph(graph, ctf_lttng_live_comps, url_count, 0, 1, muxer_comp,
+                                       relay_comp);
+  if (connect_ports_status != BT_GRAPH_CONNECT_PORTS_STATUS_OK) {
+    snprintf(error, error_size, "Failed to connect the components.");
     goto error;
   }
 
-  /*
-   * Connect all the output ports of the `ctf` source component to
-   * the input ports of the `muxer` filter component.
-   *
-   * An `flt.utils.muxer` component adds an input port every time
-   * you connect one, making one always available.
-   *
-   * See <https://babeltrace.org/docs/v2.0/man7/babeltrace2-filter.utils.muxer.7/#doc-_input>.
-   */
-  for (i = 0; i < bt_component_source_get_output_port_count(ctf_lttng_live_comp); i++) {
-    const bt_port_output* const out_port =
-        bt_component_source_borrow_output_port_by_index_const(ctf_lttng_live_comp, i);
-    const bt_port_input* const in_port =
-        bt_component_filter_borrow_input_port_by_index_const(muxer_comp, i);
+  goto end;
 
-    /* Connect ports */
-    connect_ports_status = bt_graph_connect_ports(graph, out_port, in_port, NULL);
+error:
+  BT_GRAPH_PUT_REF_AND_RESET(graph);
 
-    if (connect_ports_status != BT_GRAPH_CONNECT_PORTS_STATUS_OK) {
-      goto error;
-    }
+end:
+  free(ctf_lttng_live_comps);
+  return graph;
+}
+
+/*
+ * Creates a trace processing graph like create_graph() does, but reading
+ * the CTF trace of the directory `trace_dir` with a `src.ctf.fs`
+ * component, of which only the data streams `worker`, `worker +
+ * worker_count`, and so on, are connected.
+ *
+ * Graphs of different `worker` indexes thus decode disjoint groups of
+ * data streams and can run in parallel. `*stream_count` is the number of
+ * data streams of the trace.
+ */
+static bt_graph* create_ctf_fs_graph(const char* const trace_dir,
+                                     uint64_t const worker,
+                                     uint64_t const worker_count,
+                                     struct relay_data* const relay_data,
+                                     uint64_t* const stream_count,
+                                     char* const error,
+                                     size_t const error_size) {
+  bt_graph* graph;
+  const bt_component_source* ctf_fs_comp;
+  const bt_component_filter* muxer_comp;
+  const bt_component_sink* relay_comp;
+  char comp_error[128] = "";
+
+  /* Create an empty trace processing graph */
+  graph = bt_graph_create(0);
+  if (!graph) {
+    snprintf(error, error_size, "Failed to create an empty trace processing graph.");
+    goto error;
   }
 
-  /* Connect the `muxer` output port to the `relay` input port */
-  connect_ports_status = bt_graph_connect_ports(
-      graph, bt_component_filter_borrow_output_port_by_index_const(muxer_comp, 0),
-      bt_component_sink_borrow_input_port_by_index_const(relay_comp, 0), NULL);
-  if (connect_ports_status != BT_GRAPH_CONNECT_PORTS_STATUS_OK) {
+  /* Create and add the three required components to `graph` */
+  if (add_muxer_comp(graph, &muxer_comp) != BT_GRAPH_ADD_COMPONENT_STATUS_OK) {
+    snprintf(error, error_size, "Failed to add component 'muxer'.");
+    goto error;
+  }
+
+  if (add_relay_comp(graph, relay_data, &relay_comp) != BT_GRAPH_ADD_COMPONENT_STATUS_OK) {
+    snprintf(error, error_size, "Failed to add component 'relay'.");
+    goto error;
+  }
+
+  if (add_ctf_fs_comp(graph, trace_dir, &ctf_fs_comp, comp_error, sizeof(comp_error)) !=
+      BT_GRAPH_ADD_COMPONENT_STATUS_OK) {
+    snprintf(error, error_size, "Failed to add component 'ctf_fs' reading '%s'. %s", trace_dir,
+             comp_error);
+    goto error;
+  }
+
+  *stream_count = bt_component_source_get_output_port_count(ctf_fs_comp);
+  if (connect_graph(graph, &ctf_fs_comp, 1, worker, worker_count, muxer_comp, relay_comp) !=
+      BT_GRAPH_CONNECT_PORTS_STATUS_OK) {
+    snprintf(error, error_size, "Failed to connect the components.");
     goto error;
   }
 
@@ -306,42 +696,158 @@ end:
 }
 
 /*
- * Handles a single message `msg`, printing its name if it's an event
- * message.
+ * Prepares the rendering of a single message `msg` into `*job`,
+ * describing it in `*record` if it's an event message.
+ *
+ * A stream beginning message announces the trace class of the events to
+ * come: `decoders` is invalidated if that trace class is a new one.
+ *
+ * Every event is counted in `stats`. Events which `filter`, unless NULL,
+ * does not select are then skipped before any of their fields is
+ * decoded. The others are stored in `table`, if it keeps events, then
+ * skipped while `stats` only counts them. Their timestamp is rendered by
+ * `timestamps`.
+ *
+ * Returns whether `*job` is an event to render (see render_decode_job()).
  *
  * See <https://babeltrace.org/docs/v2.0/libbabeltrace2/group__api-msg.html>.
  */
-static char const* handle_msg(const bt_message* const msg) {
-  if (bt_message_get_type(msg) != BT_MESSAGE_TYPE_EVENT) {
-    return NULL;
+static bool prepare_msg(decoder_cache* const decoders,
+                        event_stats* const stats,
+                        event_table* const table,
+                        event_filter* const filter,
+                        timestamp_formatter* const timestamps,
+                        decode_job* const job,
+                        event_record* const record,
+                        const bt_message* const msg) {
+  switch (bt_message_get_type(msg)) {
+    case BT_MESSAGE_TYPE_EVENT:
+      break;
+    case BT_MESSAGE_TYPE_STREAM_BEGINNING: {
+      const bt_stream* stream = bt_message_stream_beginning_borrow_stream_const(msg);
+      decoder_cache_add_trace_class(
+          decoders, bt_stream_class_borrow_trace_class_const(bt_stream_borrow_class_const(stream)));
+      return false;
+    }
+    default:
+      return false;
   }
 
   const bt_event* event = bt_message_event_borrow_event_const(msg);
-  const bt_event_class* eventClass = bt_event_borrow_class_const(event);
-  json_object* const jobj = json_object_new_object();
-
-  AddEventName(jobj, eventClass);
+  event_decoder* decoder = decoder_cache_lookup(decoders, bt_event_borrow_class_const(event));
 
   const bt_clock_snapshot* clock = bt_message_event_borrow_default_clock_snapshot_const(msg);
-  AddTimestamp(jobj, clock);
-
-  AddPacketContext(jobj, event);
-  AddEventHeader(jobj, event);
-  AddStreamEventContext(jobj, event);
-  AddEventContext(jobj, event);
-  AddPayload(jobj, event);
-  char const* output_message = json_object_to_json_string_ext(
-      jobj, JSON_C_TO_STRING_SPACED | JSON_C_TO_STRING_NOSLASHESCAPE);
-  return output_message;
+
+  const bt_stream* stream = bt_event_borrow_stream_const(event);
+  const trace_info* trace =
+      decoder_cache_trace_info(decoders, bt_stream_borrow_trace_const(stream));
+
+  record->name = decoder->name;
+  record->timestamp_ns = GetTimestampNs(clock);
+  record->stream_id = bt_stream_get_id(stream);
+  record->trace_id = trace->id;
+
+  event_stats_count(stats, decoder, event, record->trace_id, record->stream_id,
+                    record->timestamp_ns);
+  bool const count_only = __atomic_load_n(&stats->count_only, __ATOMIC_RELAXED);
+  if ((count_only && table->max_events == 0) ||
+      (filter && !event_filter_accepts(filter, decoder, event))) {
+    return false;
+  }
+  event_table_append(table, decoder, event, record->trace_id, record->stream_id,
+                     record->timestamp_ns);
+  if (count_only) {
+    return false;
+  }
+
+  job->event = event;
+  job->decoder = decoder;
+  job->trace = trace;
+  job->time_len = (uint32_t)format_timestamp(timestamps, record->timestamp_ns, job->time);
+  return true;
+}
+
+/*
+ * Handles a single message `msg`, appending its rendering to the buffer
+ * of `writer` and describing it in `*record` if it's an event message
+ * (see prepare_msg()).
+ *
+ * Returns whether a record was written.
+ */
+static bool handle_msg(decoder_cache* const decoders,
+                       event_stats* const stats,
+                       event_table* const table,
+                       event_filter* const filter,
+                       timestamp_formatter* const timestamps,
+                       event_writer* const writer,
+                       event_record* const record,
+                       const bt_message* const msg) {
+  decode_job job;
+  if (!prepare_msg(decoders, stats, table, filter, timestamps, &job, record, msg)) {
+    return false;
+  }
+
+  render_decode_job(writer, &job, record);
+  return true;
+}
+
+/*
+ * Handles the consumed messages like handle_msg() does, into `batch`,
+ * but renders the events on the threads of `relay_data->decode_pool`.
+ *
+ * The messages are prepared in order on the calling thread, then
+ * rendered together. They are all released once rendered, as the jobs
+ * borrow their events. The pending jobs are rendered before a new trace
+ * class invalidates the decoders they use.
+ */
+static void handle_msgs_in_parallel(struct relay_data* const relay_data,
+                                    event_writer* const writer,
+                                    event_batch* const batch) {
+  decode_pool* const pool = relay_data->decode_pool;
+  decode_job* const jobs = reserve_decode_jobs(pool, relay_data->msg_count);
+  uint64_t first_record = batch->count;
+  uint64_t job_count = 0;
+
+  for (uint64_t i = 0; i < relay_data->msg_count; i++) {
+    const bt_message* const msg = relay_data->msgs[i];
+
+    if (bt_message_get_type(msg) == BT_MESSAGE_TYPE_STREAM_BEGINNING) {
+      const bt_stream* const stream = bt_message_stream_beginning_borrow_stream_const(msg);
+      if (!decoder_cache_has_trace_class(&relay_data->decoders,
+                                         bt_stream_class_borrow_trace_class_const(
+                                             bt_stream_borrow_class_const(stream)))) {
+        run_decode_pool(pool, writer, batch, first_record, job_count);
+        first_record = batch->count;
+        job_count = 0;
+      }
+    }
+
+    if (prepare_msg(&relay_data->decoders, &relay_data->stats, &relay_data->table,
+                    relay_data->filter, &relay_data->timestamps, &jobs[job_count],
+                    next_batch_record(batch), msg)) {
+      batch->count++;
+      job_count++;
+    }
+  }
+  run_decode_pool(pool, writer, batch, first_record, job_count);
+
+  for (uint64_t i = 0; i < relay_data->msg_count; i++) {
+    bt_message_put_ref(relay_data->msgs[i]);
+  }
 }
 
 /*
  * Runs the trace processing graph `graph`, our relay sink component
  * transferring its consumed messages to `*relay_data`.
  *
+ * Returns the batch of records rendered from the consumed event
+ * messages, or NULL if the graph did not run, in which case
+ * `relay_data->status` tells why. The caller owns the returned batch
+ * and must hand it back with release_batch().
+ *
  * See <https://babeltrace.org/docs/v2.0/libbabeltrace2/group__api-graph.html#api-graph-lc-run>.
  */
-static const char** run_graph_once(bt_graph* const graph, struct relay_data* const relay_data) {
+static event_batch* run_graph_once(bt_graph* const graph, struct relay_data* const relay_data) {
   /*
    * bt_graph_run_once() calls the consuming method of
    * our relay sink component (relay_consume()).
@@ -350,26 +856,52 @@ static const char** run_graph_once(bt_graph* const graph, struct relay_data* con
    * `flt.utils.muxer` component and stores them in
    * `*relay_data`.
    */
-  bt_graph_run_once_status status = bt_graph_run_once(graph);
-  assert(status != BT_GRAPH_RUN_ONCE_STATUS_AGAIN);
-  if (status != BT_GRAPH_RUN_ONCE_STATUS_OK) {
+  int64_t const run_start_ns = monotonic_ns();
+  relay_data->status = bt_graph_run_once(graph);
+  int64_t const decode_start_ns = monotonic_ns();
+  histogram_record(&relay_data->metrics.graph_run_ns, (uint64_t)(decode_start_ns - run_start_ns));
+  if (relay_data->status != BT_GRAPH_RUN_ONCE_STATUS_OK) {
     return NULL;
   }
 
-  const char** output_messages = (const char**)malloc((relay_data->msg_count) * sizeof(char*));
-
-  /* Handle each consumed message */
-  for (uint64_t i = 0; i < relay_data->msg_count; i++) {
-    const bt_message* const msg = relay_data->msgs[i];
-
-    output_messages[i] = handle_msg(msg);
-
-    /*
-     * The message reference `msg` is ours: release
-     * it now.
-     */
-    bt_message_put_ref(msg);
+  event_batch* const batch = acquire_batch(&relay_data->batches);
+  reserve_batch(batch, relay_data->msg_count);
+  batch->ingest_ns = decode_start_ns;
+  histogram_record(&relay_data->metrics.batch_messages, relay_data->msg_count);
+
+  event_writer writer;
+  event_writer_init(&writer, &batch->arena, relay_data->format);
+  writer.bytes = relay_data->bytes;
+  writer.bytes_max = relay_data->bytes_max;
+
+  /* Handle each consumed message, exports of the event table waiting meanwhile */
+  lock_event_table(&relay_data->table);
+  if (relay_data->decode_pool) {
+    handle_msgs_in_parallel(relay_data, &writer, batch);
+  } else {
+    for (uint64_t i = 0; i < relay_data->msg_count; i++) {
+      const bt_message* const msg = relay_data->msgs[i];
+
+      if (handle_msg(&relay_data->decoders, &relay_data->stats, &relay_data->table,
+                     relay_data->filter, &relay_data->timestamps, &writer,
+                     next_batch_record(batch), msg)) {
+        push_batch_record(batch);
+      }
+
+      /*
+       * The message reference `msg` is ours: release
+       * it now.
+       */
+      bt_message_put_ref(msg);
+    }
   }
+  unlock_event_table(&relay_data->table);
 
-  return output_messages;
+  /* Timing each message would cost about as much as decoding small ones */
+  if (relay_data->msg_count > 0) {
+    histogram_record_n(&relay_data->metrics.decode_ns,
+                       (uint64_t)(monotonic_ns() - decode_start_ns) / relay_data->msg_count,
+                       relay_data->msg_count);
+  }
+  return batch;
 }
@@ -0,0 +1,57 @@
+package main
+
+import (
+	"container/list"
+
+	"github.com/muesli/reflow/wordwrap"
+)
+
+// Number of wrapped descriptions kept by a rowCache: a few screens worth
+const rowCacheSize = 512
+
+type rowKey struct {
+	seq   uint64
+	width int
+}
+
+type row struct {
+	key         rowKey
+	description string
+}
+
+// rowCache keeps the descriptions of the most recently rendered events,
+// wrapped to the width they were rendered at, so that only the rows which
+// become visible are wrapped, and only once while they stay around.
+type rowCache struct {
+	rows  map[rowKey]*list.Element
+	order *list.List // Most recently used first
+}
+
+func newRowCache() *rowCache {
+	return &rowCache{rows: make(map[rowKey]*list.Element), order: list.New()}
+}
+
+// description returns the description of `it` wrapped to `width`.
+func (c *rowCache) description(it item, width int) string {
+	key := rowKey{seq: it.seq, width: width}
+	if element, ok := c.rows[key]; ok {
+		c.order.MoveToFront(element)
+		return element.Value.(*row).description
+	}
+
+	var r *row
+	if c.order.Len() < rowCacheSize {
+		r = &row{}
+		c.rows[key] = c.order.PushFront(r)
+	} else {
+		// Recycle the least recently used row
+		element := c.order.Back()
+		r = element.Value.(*row)
+		delete(c.rows, r.key)
+		c.order.MoveToFront(element)
+		c.rows[key] = element
+	}
+	r.key = key
+	r.description = wordwrap.String(it.Description(), width)
+	return r.description
+}
@@ -0,0 +1,233 @@
+package main
+
+import (
+	"bufio"
+	"encoding/binary"
+	"fmt"
+	"os"
+	"sort"
+	"syscall"
+
+	"github.com/charmbracelet/bubbles/list"
+)
+
+const (
+	// Events per page of the spill file, the unit of its index and of reading
+	spillPageEvents = 256
+	// Bytes buffered before being written to the spill file
+	spillBufferSize = 1 << 20
+	// Size of the fixed part of a spilled event, see spillStore
+	spillHeaderSize = 48
+)
+
+// spillPage locates the events of a page of the spill file.
+type spillPage struct {
+	firstSeq       uint64
+	firstTimestamp int64
+	offset         int64
+}
+
+// spillStore appends every event to a file, so that those evicted from the
+// eventStore can still be found and shown, with a memory cost bounded by the
+// number of pages instead of the size of the events.
+//
+// Each event is written as a fixed header of little-endian fields, then its
+// record:
+//
+//	uint32 size of the rest of the entry, uint32 name id, uint32 session id,
+//	uint32 payload offset and uint32 payload length within the record,
+//	uint64 sequence number, int64 timestamp, uint64 stream id, uint32 trace id.
+//
+// Names and session tags are kept in memory, once each, and referred to by id.
+//
+// The file is split into pages of spillPageEvents events. `pages` holds the
+// first sequence number, timestamp and offset of each page, and `names` the
+// pages holding events of each name, which is enough to binary search for an
+// event by time or by name and only read its page, mapped in for as long as it
+// is copied out.
+type spillStore struct {
+	file    *os.File
+	writer  *bufio.Writer
+	size    int64 // Of the file, written or buffered
+	count   uint64
+	pages   []spillPage
+	names   map[string][]int // Ascending page numbers of the events of each name
+	nameIDs map[string]uint32
+	strings []string // Names and session tags by id
+	header  [spillHeaderSize]byte
+}
+
+// newSpillStore creates a new spill file in the directory `dir`, leaving the
+// files already there alone.
+func newSpillStore(dir string) (*spillStore, error) {
+	file, err := os.CreateTemp(dir, "lttng-go-spill-*")
+	if err != nil {
+		return nil, err
+	}
+	return &spillStore{
+		file:    file,
+		writer:  bufio.NewWriterSize(file, spillBufferSize),
+		names:   make(map[string][]int),
+		nameIDs: make(map[string]uint32),
+	}, nil
+}
+
+// Close closes and removes the spill file, which newSpillStore created.
+func (s *spillStore) Close() {
+	s.file.Close()
+	os.Remove(s.file.Name())
+}
+
+func (s *spillStore) stringID(str string) uint32 {
+	id, ok := s.nameIDs[str]
+	if !ok {
+		id = uint32(len(s.strings))
+		s.strings = append(s.strings, str)
+		s.nameIDs[str] = id
+	}
+	return id
+}
+
+// Append writes `it`, whose sequence number must follow the one of the previous
+// event and whose timestamp must not precede it.
+func (s *spillStore) Append(it item) error {
+	page := len(s.pages) - 1
+	if s.count%spillPageEvents == 0 {
+		s.pages = append(s.pages, spillPage{it.seq, it.timestamp, s.size})
+		page++
+	}
+	if pages := s.names[it.name]; len(pages) == 0 || pages[len(pages)-1] != page {
+		s.names[it.name] = append(pages, page)
+	}
+
+	h := s.header[:]
+	binary.LittleEndian.PutUint32(h[0:], uint32(spillHeaderSize-4+len(it.record)))
+	binary.LittleEndian.PutUint32(h[4:], s.stringID(it.name))
+	binary.LittleEndian.PutUint32(h[8:], s.stringID(it.session))
+	binary.LittleEndian.PutUint32(h[12:], it.payloadOffset)
+	binary.LittleEndian.PutUint32(h[16:], uint32(len(it.payload)))
+	binary.LittleEndian.PutUint64(h[20:], it.seq)
+	binary.LittleEndian.PutUint64(h[28:], uint64(it.timestamp))
+	binary.LittleEndian.PutUint64(h[36:], it.streamID)
+	binary.LittleEndian.PutUint32(h[44:], it.traceID)
+	if _, err := s.writer.Write(h); err != nil {
+		return err
+	}
+	if _, err := s.writer.Write(it.record); err != nil {
+		return err
+	}
+	s.size += int64(spillHeaderSize + len(it.record))
+	s.count++
+	return nil
+}
+
+// PageOfSeq returns the page of the event of sequence number `seq`, if spilled.
+func (s *spillStore) PageOfSeq(seq uint64) (int, bool) {
+	if len(s.pages) == 0 || seq < s.pages[0].firstSeq || seq >= s.pages[0].firstSeq+s.count {
+		return 0, false
+	}
+	return sort.Search(len(s.pages), func(i int) bool { return s.pages[i].firstSeq > seq }) - 1,
+		true
+}
+
+// SeekTime returns the sequence number of the first event at or after
+// `timestamp`, or of the last event if there is none.
+func (s *spillStore) SeekTime(timestamp int64) (uint64, error) {
+	if len(s.pages) == 0 {
+		return 0, fmt.Errorf("no events yet")
+	}
+
+	// The first event at or after `timestamp` is in the last page starting
+	// before it, or is the first one of the next page
+	page := sort.Search(len(s.pages), func(i int) bool {
+		return s.pages[i].firstTimestamp >= timestamp
+	}) - 1
+	if page < 0 {
+		return s.pages[0].firstSeq, nil
+	}
+
+	items, err := s.ReadPage(page)
+	if err != nil {
+		return 0, err
+	}
+	for _, it := range items {
+		if it.(item).timestamp >= timestamp {
+			return it.(item).seq, nil
+		}
+	}
+	if page+1 < len(s.pages) {
+		return s.pages[page+1].firstSeq, nil
+	}
+	return items[len(items)-1].(item).seq, nil
+}
+
+// NextOfName returns the sequence number of the first event named `name` after
+// the event of sequence number `seq`.
+func (s *spillStore) NextOfName(name string, seq uint64) (uint64, bool, error) {
+	pages := s.names[name]
+	from := 0
+	if page, ok := s.PageOfSeq(seq); ok {
+		from = sort.SearchInts(pages, page)
+	}
+
+	for _, page := range pages[from:] {
+		items, err := s.ReadPage(page)
+		if err != nil {
+			return 0, false, err
+		}
+		for _, it := range items {
+			if it.(item).name == name && it.(item).seq > seq {
+				return it.(item).seq, true, nil
+			}
+		}
+	}
+	return 0, false, nil
+}
+
+// ReadPage returns the events of page `page`, mapping in only that part of the
+// file. The events are copied out: they stay valid once the page is unmapped.
+func (s *spillStore) ReadPage(page int) ([]list.Item, error) {
+	if err := s.writer.Flush(); err != nil {
+		return nil, err
+	}
+
+	start := s.pages[page].offset
+	end := s.size
+	if page+1 < len(s.pages) {
+		end = s.pages[page+1].offset
+	}
+
+	// Mappings start at a multiple of the page size of the system
+	aligned := start - start%int64(os.Getpagesize())
+	mapping, err := syscall.Mmap(int(s.file.Fd()), aligned, int(end-aligned), syscall.PROT_READ,
+		syscall.MAP_SHARED)
+	if err != nil {
+		return nil, err
+	}
+	data := append([]byte(nil), mapping[start-aligned:]...)
+	if err := syscall.Munmap(mapping); err != nil {
+		return nil, err
+	}
+
+	var items []list.Item
+	for len(data) >= spillHeaderSize {
+		size := int(binary.LittleEndian.Uint32(data[0:])) + 4
+		record := data[spillHeaderSize:size:size]
+		payloadStart := binary.LittleEndian.Uint32(data[12:])
+		payloadEnd := payloadStart + binary.LittleEndian.Uint32(data[16:])
+		items = append(items, item{
+			seq:       binary.LittleEndian.Uint64(data[20:]),
+			name:      s.strings[binary.LittleEndian.Uint32(data[4:])],
+			session:   s.strings[binary.LittleEndian.Uint32(data[8:])],
+			timestamp: int64(binary.LittleEndian.Uint64(data[28:])),
+			streamID:  binary.LittleEndian.Uint64(data[36:]),
+			traceID:   binary.LittleEndian.Uint32(data[44:]),
+			record:    record,
+			payload:   record[payloadStart:payloadEnd],
+
+			payloadOffset: payloadStart,
+		})
+		data = data[size:]
+	}
+	return items, nil
+}
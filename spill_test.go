@@ -0,0 +1,156 @@
+package main
+
+import (
+	"bytes"
+	"os"
+	"path/filepath"
+	"testing"
+)
+
+// spillItem returns the event `seq`, named "b" for the seqs of `bs` and "a"
+// otherwise.
+func spillItem(seq uint64, bs map[uint64]bool) item {
+	name := "a"
+	if bs[seq] {
+		name = "b"
+	}
+	it := workerItem(seq)
+	it.name = name
+	it.session = "host/session"
+	it.streamID = seq % 4
+	it.traceID = uint32(seq % 3)
+	return it
+}
+
+// newTestSpill spills `count` events, whose timestamps are 1000 times their
+// seq, to a new spill store in a temporary directory.
+func newTestSpill(t *testing.T, count uint64, bs map[uint64]bool) *spillStore {
+	s, err := newSpillStore(t.TempDir())
+	if err != nil {
+		t.Fatal(err)
+	}
+	for seq := uint64(0); seq < count; seq++ {
+		if err := s.Append(spillItem(seq, bs)); err != nil {
+			t.Fatal(err)
+		}
+	}
+	return s
+}
+
+func TestSpillReadPage(t *testing.T) {
+	s := newTestSpill(t, 3*spillPageEvents+10, nil)
+	defer s.Close()
+
+	for page, want := range []int{spillPageEvents, spillPageEvents, spillPageEvents, 10} {
+		items, err := s.ReadPage(page)
+		if err != nil {
+			t.Fatal(err)
+		}
+		if len(items) != want {
+			t.Fatalf("page %d has %d events, want %d", page, len(items), want)
+		}
+
+		for i, it := range items {
+			got := it.(item)
+			spilled := spillItem(uint64(page*spillPageEvents+i), nil)
+			if got.seq != spilled.seq || got.name != spilled.name || got.session != spilled.session ||
+				got.timestamp != spilled.timestamp || got.streamID != spilled.streamID ||
+				got.traceID != spilled.traceID || got.payloadOffset != spilled.payloadOffset ||
+				!bytes.Equal(got.record, spilled.record) || !bytes.Equal(got.payload, spilled.payload) {
+				t.Fatalf("page %d reads %+v, want %+v", page, got, spilled)
+			}
+		}
+	}
+}
+
+func TestSpillSeekTime(t *testing.T) {
+	const count = 3*spillPageEvents + 10
+	s := newTestSpill(t, count, nil)
+	defer s.Close()
+
+	tests := []struct {
+		timestamp int64
+		want      uint64
+	}{
+		{-5, 0},
+		{0, 0},
+		{1, 1},
+		{300 * 1000, 300},
+		{300*1000 - 1, 300},
+		// First events of a page, and the events just before them
+		{spillPageEvents * 1000, spillPageEvents},
+		{spillPageEvents*1000 - 1, spillPageEvents},
+		{(spillPageEvents-1)*1000 - 1, spillPageEvents - 1},
+		{3 * spillPageEvents * 1000, 3 * spillPageEvents},
+		// Past the last event
+		{(count - 1) * 1000, count - 1},
+		{count * 1000, count - 1},
+	}
+	for _, test := range tests {
+		seq, err := s.SeekTime(test.timestamp)
+		if err != nil || seq != test.want {
+			t.Errorf("SeekTime(%d) = %d, %v, want %d", test.timestamp, seq, err, test.want)
+		}
+	}
+}
+
+func TestSpillNextOfName(t *testing.T) {
+	// Events named "b" within the first page, at the end of the second and
+	// start of the third one, then within the fourth one, the last
+	bs := map[uint64]bool{5: true, 7: true, 2*spillPageEvents - 1: true, 2 * spillPageEvents: true,
+		3*spillPageEvents + 2: true}
+	s := newTestSpill(t, 3*spillPageEvents+10, bs)
+	defer s.Close()
+
+	tests := []struct {
+		name string
+		seq  uint64
+		want uint64
+		ok   bool
+	}{
+		{"b", 0, 5, true},
+		{"b", 5, 7, true},
+		{"b", 7, 2*spillPageEvents - 1, true},
+		{"b", 100, 2*spillPageEvents - 1, true},
+		{"b", 2*spillPageEvents - 1, 2 * spillPageEvents, true},
+		{"b", 2 * spillPageEvents, 3*spillPageEvents + 2, true},
+		{"b", 3*spillPageEvents + 2, 0, false},
+		{"a", 4, 6, true},
+		{"a", 2*spillPageEvents - 2, 2*spillPageEvents + 1, true},
+		{"c", 0, 0, false},
+	}
+	for _, test := range tests {
+		seq, ok, err := s.NextOfName(test.name, test.seq)
+		if err != nil || ok != test.ok || seq != test.want {
+			t.Errorf("NextOfName(%q, %d) = %d, %v, %v, want %d, %v", test.name, test.seq, seq, ok,
+				err, test.want, test.ok)
+		}
+	}
+}
+
+func TestSpillClose(t *testing.T) {
+	dir := t.TempDir()
+	other, err := os.CreateTemp(dir, "lttng-go-spill-*")
+	if err != nil {
+		t.Fatal(err)
+	}
+	other.Close()
+
+	s, err := newSpillStore(dir)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if err := s.Append(workerItem(0)); err != nil {
+		t.Fatal(err)
+	}
+	s.Close()
+
+	// Only the file of the store is removed
+	entries, err := os.ReadDir(dir)
+	if err != nil {
+		t.Fatal(err)
+	}
+	if len(entries) != 1 || entries[0].Name() != filepath.Base(other.Name()) {
+		t.Errorf("%s holds %v, want only %s", dir, entries, other.Name())
+	}
+}
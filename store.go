@@ -0,0 +1,151 @@
+package main
+
+import (
+	"fmt"
+	"strconv"
+	"strings"
+
+	"github.com/charmbracelet/bubbles/list"
+)
+
+// Number of events kept when no retention is configured
+const defaultRetentionCount = 100000
+
+// retention bounds what an eventStore keeps. A zero field means no bound.
+type retention struct {
+	count int
+	bytes uint64
+}
+
+// parseSize parses the size `s`, such as "512MiB", with a B, KiB, MiB or GiB
+// suffix. It returns false if `s` has none of these suffixes.
+func parseSize(s string) (uint64, bool, error) {
+	units := []struct {
+		suffix string
+		size   uint64
+	}{{"GiB", 1 << 30}, {"MiB", 1 << 20}, {"KiB", 1 << 10}, {"B", 1}}
+
+	for _, unit := range units {
+		if number := strings.TrimSuffix(s, unit.suffix); number != s {
+			n, err := strconv.ParseUint(number, 10, 64)
+			if err != nil || n == 0 {
+				return 0, true, fmt.Errorf("invalid size %q", s)
+			}
+			return n * unit.size, true, nil
+		}
+	}
+	return 0, false, nil
+}
+
+// parseRetention parses the retention `s`: either a number of events, such as
+// "100000", or a size (see parseSize()).
+func parseRetention(s string) (retention, error) {
+	if bytes, ok, err := parseSize(s); ok {
+		return retention{bytes: bytes}, err
+	}
+
+	n, err := strconv.Atoi(s)
+	if err != nil || n <= 0 {
+		return retention{}, fmt.Errorf("invalid number of events %q", s)
+	}
+	return retention{count: n}, nil
+}
+
+// eventStore keeps the most recent events within its retention, evicting the
+// oldest ones first.
+//
+// The events live in a ring whose backing slice is twice its capacity: slot i
+// is mirrored at slot i+capacity. The events, from the oldest to the newest,
+// are therefore always a contiguous window of the backing slice, which Items()
+// returns without copying.
+type eventStore struct {
+	retention retention
+	slots     []list.Item
+	capacity  int
+	start     int // Slot of the oldest event, within [0, capacity)
+	count     int
+	bytes     uint64
+	nextSeq   uint64 // Sequence number of the newest event, plus one
+}
+
+func newEventStore(r retention) *eventStore {
+	return &eventStore{retention: r}
+}
+
+// Append adds `it` as the newest event, whose sequence number must follow the
+// one of the previous event, evicting as many of the oldest events as needed
+// to stay within the retention. The size of an event is the one of its
+// rendering plus the one of its postings in the eventIndex.
+func (s *eventStore) Append(it item) {
+	size := uint64(len(it.record)) + uint64(it.indexBytes)
+	for s.count > 0 &&
+		((s.retention.count > 0 && s.count >= s.retention.count) ||
+			(s.retention.bytes > 0 && s.bytes+size > s.retention.bytes)) {
+		s.evictOldest()
+	}
+
+	if s.count == s.capacity {
+		s.grow()
+	}
+	slot := (s.start + s.count) % s.capacity
+	s.slots[slot] = it
+	s.slots[slot+s.capacity] = it
+	s.count++
+	s.bytes += size
+	s.nextSeq = it.seq + 1
+}
+
+func (s *eventStore) evictOldest() {
+	oldest := s.slots[s.start].(item)
+	s.bytes -= uint64(len(oldest.record)) + uint64(oldest.indexBytes)
+
+	// Let the evicted event be garbage collected
+	s.slots[s.start] = nil
+	s.slots[s.start+s.capacity] = nil
+	s.start = (s.start + 1) % s.capacity
+	s.count--
+}
+
+// grow doubles the capacity, up to the retention count if any.
+func (s *eventStore) grow() {
+	capacity := s.capacity * 2
+	if capacity == 0 {
+		capacity = 1024
+	}
+	if s.retention.count > 0 && capacity > s.retention.count {
+		capacity = s.retention.count
+	}
+
+	slots := make([]list.Item, 2*capacity)
+	copy(slots, s.Items())
+	copy(slots[capacity:], s.Items())
+	s.slots = slots
+	s.capacity = capacity
+	s.start = 0
+}
+
+// Items returns the events from the oldest to the newest. The returned slice is
+// only valid until the next Append().
+func (s *eventStore) Items() []list.Item {
+	return s.slots[s.start : s.start+s.count : s.start+s.count]
+}
+
+// Get returns the event of sequence number `seq`, if still retained.
+func (s *eventStore) Get(seq uint64) (item, bool) {
+	oldest := s.OldestSeq()
+	if seq < oldest || seq >= s.nextSeq {
+		return item{}, false
+	}
+	return s.slots[s.start+int(seq-oldest)].(item), true
+}
+
+// OldestSeq returns the sequence number of the oldest event, or of the next
+// one if there is none.
+func (s *eventStore) OldestSeq() uint64 {
+	return s.nextSeq - uint64(s.count)
+}
+
+// Len returns the number of events.
+func (s *eventStore) Len() int {
+	return s.count
+}
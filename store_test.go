@@ -0,0 +1,99 @@
+package main
+
+import (
+	"reflect"
+	"strings"
+	"testing"
+)
+
+func TestParseRetention(t *testing.T) {
+	tests := []struct {
+		in   string
+		want retention
+		ok   bool
+	}{
+		{"100000", retention{count: 100000}, true},
+		{"512MiB", retention{bytes: 512 << 20}, true},
+		{"3KiB", retention{bytes: 3 << 10}, true},
+		{"10B", retention{bytes: 10}, true},
+		{"0", retention{}, false},
+		{"0MiB", retention{}, false},
+		{"-5", retention{}, false},
+		{"12MB", retention{}, false},
+	}
+	for _, test := range tests {
+		got, err := parseRetention(test.in)
+		if (err == nil) != test.ok || (test.ok && got != test.want) {
+			t.Errorf("parseRetention(%q) = %+v, %v", test.in, got, err)
+		}
+	}
+}
+
+func TestStoreGetAcrossWrap(t *testing.T) {
+	const retained = 5
+	s := newEventStore(retention{count: retained})
+	for seq := uint64(0); seq < 13; seq++ {
+		s.Append(workerItem(seq))
+
+		// The ring wraps around every `retained` events
+		oldest := uint64(0)
+		if seq >= retained {
+			oldest = seq - retained + 1
+		}
+		if s.OldestSeq() != oldest || s.Len() != int(seq-oldest+1) {
+			t.Fatalf("after event %d: events %d to %d, want %d to %d", seq, s.OldestSeq(),
+				s.OldestSeq()+uint64(s.Len())-1, oldest, seq)
+		}
+		for want := uint64(0); want <= seq+1; want++ {
+			it, ok := s.Get(want)
+			if ok != (want >= oldest && want <= seq) || (ok && it.seq != want) {
+				t.Fatalf("after event %d: Get(%d) = %d, %v", seq, want, it.seq, ok)
+			}
+		}
+
+		var want []uint64
+		for i := oldest; i <= seq; i++ {
+			want = append(want, i)
+		}
+		if got := seqsOf(s.Items()); !reflect.DeepEqual(got, want) {
+			t.Fatalf("after event %d: Items() = %v, want %v", seq, got, want)
+		}
+	}
+}
+
+func TestStoreByteRetention(t *testing.T) {
+	const maxBytes = 2000
+	s := newEventStore(retention{bytes: maxBytes})
+	index := newEventIndex()
+
+	var sizes []uint64
+	for seq := uint64(0); seq < 200; seq++ {
+		it := testItem(seq, "net_dev_xmit", `{ "data": "`+strings.Repeat("x", int(seq%37))+`" }`)
+		it.indexBytes = index.Add(it)
+		s.Append(it)
+		sizes = append(sizes, uint64(len(it.record))+uint64(it.indexBytes))
+
+		// The newest events whose renderings and postings fit are retained
+		oldest, bytes := seq, sizes[seq]
+		for oldest > 0 && bytes+sizes[oldest-1] <= maxBytes {
+			oldest--
+			bytes += sizes[oldest]
+		}
+		if s.OldestSeq() != oldest || s.bytes != bytes {
+			t.Fatalf("after event %d: oldest %d of %d bytes, want %d of %d bytes", seq,
+				s.OldestSeq(), s.bytes, oldest, bytes)
+		}
+	}
+}
+
+func TestStoreByteRetentionLargeEvent(t *testing.T) {
+	s := newEventStore(retention{bytes: 100})
+	s.Append(testItem(0, "small", `{ }`))
+	s.Append(testItem(1, "large", `{ "data": "`+strings.Repeat("x", 200)+`" }`))
+
+	// An event larger than the retention is still kept, alone
+	if s.OldestSeq() != 1 || s.Len() != 1 {
+		t.Errorf("events %d to %d retained, want only 1", s.OldestSeq(),
+			s.OldestSeq()+uint64(s.Len())-1)
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * How the timestamps of the events are rendered.
+ */
+typedef enum timestamp_format {
+  TIMESTAMP_FORMAT_ISO8601 = 0, /* "2021-11-05T14:03:22.500000001+01:00", local time */
+  TIMESTAMP_FORMAT_NS = 1,      /* Nanoseconds from the clock origin, as a number */
+  TIMESTAMP_FORMAT_DELTA = 2,   /* "+0.000012345" seconds since the previous event */
+  TIMESTAMP_FORMAT_ELAPSED = 3, /* "+12.000012345" seconds since the first event */
+} timestamp_format;
+
+/*
+ * Renders timestamps in a given format.
+ *
+ * A formatter belongs to the thread decoding the events, which keeps it
+ * thread-safe without locking. The ISO 8601 date, time and UTC offset
+ * only change once per second: they are formatted once per second and
+ * only the nanoseconds are formatted per event. DELTA and ELAPSED are
+ * relative to the events of the same formatter.
+ *
+ * A zero-initialized formatter renders ISO 8601 timestamps.
+ */
+typedef struct timestamp_formatter {
+  timestamp_format format;
+
+  /* ISO 8601: rendering of the second of `cached_second` */
+  bool has_cached_second;
+  int64_t cached_second;
+  char date_time[32]; /* "2021-11-05T14:03:22." */
+  size_t date_time_len;
+  char utc_offset[8]; /* "+01:00" */
+  size_t utc_offset_len;
+
+  /* DELTA and ELAPSED */
+  bool has_previous;
+  int64_t first_ns;
+  int64_t previous_ns;
+} timestamp_formatter;
+
+/*
+ * Writes the `digits` last decimal digits of `value` to `out`.
+ */
+static void format_fixed_digits(char* const out, uint64_t value, int const digits) {
+  for (int i = digits - 1; i >= 0; i--) {
+    out[i] = (char)('0' + value % 10);
+    value /= 10;
+  }
+}
+
+/*
+ * Caches the rendering of `second`, in seconds from the Epoch.
+ */
+static void cache_timestamp_second(timestamp_formatter* const formatter, int64_t const second) {
+  time_t const t = (time_t)second;
+  struct tm local;
+
+  localtime_r(&t, &local);
+  formatter->date_time_len =
+      strftime(formatter->date_time, sizeof(formatter->date_time), "%Y-%m-%dT%H:%M:%S.", &local);
+
+  long const offset_minutes = local.tm_gmtoff / 60;
+  long const abs_minutes = offset_minutes < 0 ? -offset_minutes : offset_minutes;
+  formatter->utc_offset_len =
+      (size_t)snprintf(formatter->utc_offset, sizeof(formatter->utc_offset), "%c%02ld:%02ld",
+                       offset_minutes < 0 ? '-' : '+', abs_minutes / 60, abs_minutes % 60);
+
+  formatter->cached_second = second;
+  formatter->has_cached_second = true;
+}
+
+/*
+ * Renders `ns`, in nanoseconds, as "+S.NNNNNNNNN" (or "-S.NNNNNNNNN")
+ * seconds into `out`, and returns its length.
+ */
+static size_t format_seconds(char* const out, int64_t const ns) {
+  uint64_t const abs_ns = ns < 0 ? (uint64_t)0 - (uint64_t)ns : (uint64_t)ns;
+  int len = snprintf(out, 24, "%c%llu.", ns < 0 ? '-' : '+',
+                     (unsigned long long)(abs_ns / 1000000000));
+  format_fixed_digits(out + len, abs_ns % 1000000000, 9);
+  return (size_t)len + 9;
+}
+
+/*
+ * Renders `ns`, in nanoseconds from the Epoch, into `out`, which has
+ * room for at least 48 bytes, and returns its length. Returns 0 with
+ * TIMESTAMP_FORMAT_NS, for which the timestamp is written as a number.
+ */
+static size_t format_timestamp(timestamp_formatter* const formatter,
+                               int64_t const ns,
+                               char* const out) {
+  switch (formatter->format) {
+    case TIMESTAMP_FORMAT_NS:
+      return 0;
+    case TIMESTAMP_FORMAT_DELTA:
+    case TIMESTAMP_FORMAT_ELAPSED: {
+      if (!formatter->has_previous) {
+        formatter->first_ns = ns;
+        formatter->previous_ns = ns;
+        formatter->has_previous = true;
+      }
+      int64_t const since = formatter->format == TIMESTAMP_FORMAT_DELTA ? formatter->previous_ns
+                                                                         : formatter->first_ns;
+      formatter->previous_ns = ns;
+      return format_seconds(out, ns - since);
+    }
+    case TIMESTAMP_FORMAT_ISO8601:
+      break;
+  }
+
+  /* Floor division: the fraction of a timestamp before the Epoch is still positive */
+  int64_t second = ns / 1000000000;
+  int64_t fraction = ns % 1000000000;
+  if (fraction < 0) {
+    second--;
+    fraction += 1000000000;
+  }
+
+  if (!formatter->has_cached_second || formatter->cached_second != second) {
+    cache_timestamp_second(formatter, second);
+  }
+
+  size_t len = formatter->date_time_len;
+  memcpy(out, formatter->date_time, len);
+  format_fixed_digits(out + len, (uint64_t)fraction, 9);
+  len += 9;
+  memcpy(out + len, formatter->utc_offset, formatter->utc_offset_len);
+  return len + formatter->utc_offset_len;
+}
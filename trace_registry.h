@@ -0,0 +1,253 @@
+#pragma once
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <babeltrace2/babeltrace.h>
+
+#include "event_writer.h"
+#include "fail_fast_if.h"
+
+/*
+ * One entry of the environment of a trace (e.g. `hostname`,
+ * `kernel_version`, `tracer_name`), copied out of its bt_value.
+ */
+typedef struct trace_env_entry {
+  char* name;
+  bool is_integer;
+  int64_t integer;
+  char* string; /* Unless `is_integer` */
+} trace_env_entry;
+
+/*
+ * What the events of one trace share, gathered once when the trace
+ * first shows up. Events refer to it by `id`.
+ *
+ * `session` is the session tag of the trace: "HOSTNAME/SESSION" from the
+ * environment LTTng writes in every trace, or the trace name otherwise.
+ * `uuid` identifies the trace when `has_uuid`, as CTF traces usually do.
+ */
+typedef struct trace_info {
+  uint32_t id;
+  char* name;
+  char* session;
+  bool has_uuid;
+  uint8_t uuid[16];
+  trace_env_entry* env;
+  uint64_t env_count;
+} trace_info;
+
+/*
+ * The traces seen by all the workers of an ingest, shared so that the
+ * same trace read by several graphs (e.g. the offline workers) gets a
+ * single id.
+ *
+ * Entries are only ever appended, and stay valid and unchanged until
+ * destroy_trace_registry(): a trace_info can be read without the lock
+ * once obtained. Ids are given in order, from 0.
+ */
+typedef struct trace_registry {
+  pthread_mutex_t lock;
+  trace_info** traces;
+  uint32_t count;
+  uint32_t capacity;
+} trace_registry;
+
+static void init_trace_registry(trace_registry* const registry) {
+  pthread_mutex_init(&registry->lock, NULL);
+  registry->traces = NULL;
+  registry->count = 0;
+  registry->capacity = 0;
+}
+
+static char* copy_string(const char* const str) {
+  char* const copy = strdup(str ? str : "");
+  FAIL_FAST_IF(!copy);
+  return copy;
+}
+
+static void destroy_trace_info(trace_info* const info) {
+  for (uint64_t i = 0; i < info->env_count; i++) {
+    free(info->env[i].name);
+    free(info->env[i].string);
+  }
+  free(info->env);
+  free(info->name);
+  free(info->session);
+  free(info);
+}
+
+static void destroy_trace_registry(trace_registry* const registry) {
+  for (uint32_t i = 0; i < registry->count; i++) {
+    destroy_trace_info(registry->traces[i]);
+  }
+  free(registry->traces);
+  registry->traces = NULL;
+  registry->count = 0;
+  registry->capacity = 0;
+  pthread_mutex_destroy(&registry->lock);
+}
+
+static trace_info* create_trace_info(const bt_trace* const trace) {
+  trace_info* const info = (trace_info*)calloc(1, sizeof(trace_info));
+  FAIL_FAST_IF(!info);
+
+  const char* const name = bt_trace_get_name(trace);
+  info->name = copy_string(name ? name : "Unknown");
+
+  const uint8_t* const uuid = bt_trace_get_uuid(trace);
+  if (uuid) {
+    info->has_uuid = true;
+    memcpy(info->uuid, uuid, sizeof(info->uuid));
+  }
+
+  info->env_count = bt_trace_get_environment_entry_count(trace);
+  info->env = (trace_env_entry*)calloc(info->env_count ? info->env_count : 1,
+                                       sizeof(trace_env_entry));
+  FAIL_FAST_IF(!info->env);
+
+  const char* hostname = NULL;
+  const char* trace_name = NULL;
+  for (uint64_t i = 0; i < info->env_count; i++) {
+    const char* entry_name = NULL;
+    const bt_value* value = NULL;
+    bt_trace_borrow_environment_entry_by_index_const(trace, i, &entry_name, &value);
+
+    trace_env_entry* const entry = &info->env[i];
+    entry->name = copy_string(entry_name);
+    if (bt_value_get_type(value) == BT_VALUE_TYPE_SIGNED_INTEGER) {
+      entry->is_integer = true;
+      entry->integer = bt_value_integer_signed_get(value);
+    } else {
+      entry->string = copy_string(bt_value_string_get(value));
+    }
+
+    if (!entry->is_integer && strcmp(entry->name, "hostname") == 0) {
+      hostname = entry->string;
+    } else if (!entry->is_integer && strcmp(entry->name, "trace_name") == 0) {
+      trace_name = entry->string;
+    }
+  }
+
+  if (hostname && trace_name) {
+    size_t const size = strlen(hostname) + strlen(trace_name) + 2;
+    info->session = (char*)malloc(size);
+    FAIL_FAST_IF(!info->session);
+    snprintf(info->session, size, "%s/%s", hostname, trace_name);
+  } else {
+    info->session = copy_string(info->name);
+  }
+  return info;
+}
+
+/*
+ * Returns whether `a` and `b` describe the same trace: the same UUID
+ * when both have one, else the same name and environment. Two sessions
+ * can share a name and a hostname, but not a UUID nor, in practice,
+ * every environment entry (e.g. `trace_creation_datetime`).
+ */
+static bool same_trace_info(const trace_info* const a, const trace_info* const b) {
+  if (a->has_uuid && b->has_uuid) {
+    return memcmp(a->uuid, b->uuid, sizeof(a->uuid)) == 0;
+  }
+  if (a->has_uuid != b->has_uuid || strcmp(a->name, b->name) != 0 ||
+      a->env_count != b->env_count) {
+    return false;
+  }
+  for (uint64_t i = 0; i < a->env_count; i++) {
+    const trace_env_entry* const entry = &a->env[i];
+    const trace_env_entry* const other = &b->env[i];
+    if (strcmp(entry->name, other->name) != 0 || entry->is_integer != other->is_integer) {
+      return false;
+    }
+    if (entry->is_integer ? entry->integer != other->integer
+                          : strcmp(entry->string, other->string) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Returns the entry of `trace`, adding it if no same trace (see
+ * same_trace_info()) was seen before.
+ */
+static const trace_info* trace_registry_add(trace_registry* const registry,
+                                            const bt_trace* const trace) {
+  trace_info* const info = create_trace_info(trace);
+
+  pthread_mutex_lock(&registry->lock);
+  for (uint32_t i = 0; i < registry->count; i++) {
+    trace_info* const existing = registry->traces[i];
+    if (same_trace_info(existing, info)) {
+      pthread_mutex_unlock(&registry->lock);
+      destroy_trace_info(info);
+      return existing;
+    }
+  }
+
+  if (registry->count == registry->capacity) {
+    registry->capacity = registry->capacity ? registry->capacity * 2 : 4;
+    registry->traces =
+        (trace_info**)realloc(registry->traces, registry->capacity * sizeof(trace_info*));
+    FAIL_FAST_IF(!registry->traces);
+  }
+  info->id = registry->count;
+  registry->traces[registry->count++] = info;
+  pthread_mutex_unlock(&registry->lock);
+  return info;
+}
+
+/*
+ * Returns the number of traces, whose ids are below it.
+ */
+static uint32_t trace_registry_count(trace_registry* const registry) {
+  pthread_mutex_lock(&registry->lock);
+  uint32_t const count = registry->count;
+  pthread_mutex_unlock(&registry->lock);
+  return count;
+}
+
+/*
+ * Returns the trace of id `id`, or NULL if there is none.
+ */
+static const trace_info* trace_registry_get(trace_registry* const registry, uint32_t const id) {
+  pthread_mutex_lock(&registry->lock);
+  const trace_info* const info = id < registry->count ? registry->traces[id] : NULL;
+  pthread_mutex_unlock(&registry->lock);
+  return info;
+}
+
+/*
+ * Writes `info` as a record of its own:
+ *
+ *     { "trace_id": ID, "trace": NAME, "session": SESSION, "env": { ... } }
+ */
+static void write_trace_info(event_writer* const writer, const trace_info* const info) {
+  writer_begin_record(writer);
+  writer_begin_object(writer, NULL, 0);
+
+  writer_int64(writer, "trace_id", 8, info->id);
+  writer_string(writer, "trace", 5, info->name, strlen(info->name));
+  writer_string(writer, "session", 7, info->session, strlen(info->session));
+
+  writer_begin_object(writer, "env", 3);
+  for (uint64_t i = 0; i < info->env_count; i++) {
+    const trace_env_entry* const entry = &info->env[i];
+    if (entry->is_integer) {
+      writer_int64(writer, entry->name, strlen(entry->name), entry->integer);
+    } else {
+      writer_string(writer, entry->name, strlen(entry->name), entry->string,
+                    strlen(entry->string));
+    }
+  }
+  writer_end_object(writer);
+
+  writer_end_object(writer);
+  writer_end_record(writer);
+}
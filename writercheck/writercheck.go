@@ -0,0 +1,99 @@
+// Package writercheck renders integer arrays with the event_writer of
+// lttng-go, one value or one chunk of values per call, for its tests to check
+// that both renderings are the same.
+package writercheck
+
+/*
+   #cgo CFLAGS: -I..
+   #include <event_writer.h>
+
+   // Writes an array of the `count` values of `vals`, signed if `is_signed`,
+   // `chunk` at a time with writer_int64_values() or writer_uint64_values(),
+   // or one at a time with writer_int64() or writer_uint64() if `chunk` is 0.
+   static void write_integer_array(event_writer* const writer,
+                                   const char* const key,
+                                   size_t const key_len,
+                                   bool const is_signed,
+                                   const void* const vals,
+                                   size_t const count,
+                                   size_t const chunk) {
+     writer_begin_array(writer, key, key_len);
+     for (size_t i = 0; i < count;) {
+       size_t const n = chunk == 0 ? 1 : chunk < count - i ? chunk : count - i;
+       if (is_signed && chunk == 0) {
+         writer_int64(writer, NULL, 0, ((const int64_t*)vals)[i]);
+       } else if (is_signed) {
+         writer_int64_values(writer, (const int64_t*)vals + i, n);
+       } else if (chunk == 0) {
+         writer_uint64(writer, NULL, 0, ((const uint64_t*)vals)[i]);
+       } else {
+         writer_uint64_values(writer, (const uint64_t*)vals + i, n);
+       }
+       i += n;
+     }
+     writer_end_array(writer);
+   }
+
+   // Renders a record holding a member, then the array of `vals` (see
+   // write_integer_array()), then an array holding that array twice. Returns
+   // the rendering, of `*size` bytes, which the caller frees.
+   static char* render_integer_arrays(output_format const format,
+                                      bool const is_signed,
+                                      const void* const vals,
+                                      size_t const count,
+                                      size_t const chunk,
+                                      size_t* const size) {
+     byte_buffer buffer = {0};
+     event_writer writer;
+     event_writer_init(&writer, &buffer, format);
+     writer_begin_record(&writer);
+     writer_begin_object(&writer, NULL, 0);
+     writer_uint64(&writer, "count", 5, count);
+     write_integer_array(&writer, "values", 6, is_signed, vals, count, chunk);
+     writer_begin_array(&writer, "nested", 6);
+     write_integer_array(&writer, NULL, 0, is_signed, vals, count, chunk);
+     write_integer_array(&writer, NULL, 0, is_signed, vals, count, chunk);
+     writer_end_array(&writer);
+     writer_end_object(&writer);
+     writer_end_record(&writer);
+     *size = buffer.size;
+     return buffer.data;
+   }
+*/
+import "C"
+
+import "unsafe"
+
+// Format of a rendering
+type Format C.output_format
+
+const (
+	JSON   Format = C.OUTPUT_FORMAT_JSON
+	Binary Format = C.OUTPUT_FORMAT_BINARY
+)
+
+func render(format Format, signed bool, vals unsafe.Pointer, count int, chunk int) []byte {
+	var size C.size_t
+	data := C.render_integer_arrays(C.output_format(format), C.bool(signed), vals, C.size_t(count),
+		C.size_t(chunk), &size)
+	defer C.free(unsafe.Pointer(data))
+	return C.GoBytes(unsafe.Pointer(data), C.int(size))
+}
+
+// Uint64s renders `vals` in `format`, `chunk` values per writer call, or one
+// value per writer_uint64() call if `chunk` is 0.
+func Uint64s(format Format, vals []uint64, chunk int) []byte {
+	if len(vals) == 0 {
+		return render(format, false, nil, 0, chunk)
+	}
+	return render(format, false, unsafe.Pointer(&vals[0]), len(vals), chunk)
+}
+
+// Int64s renders `vals` in `format`, `chunk` values per writer call, or one
+// value per writer_int64() call if `chunk` is 0.
+func Int64s(format Format, vals []int64, chunk int) []byte {
+	if len(vals) == 0 {
+		return render(format, true, nil, 0, chunk)
+	}
+	return render(format, true, unsafe.Pointer(&vals[0]), len(vals), chunk)
+}
@@ -0,0 +1,69 @@
+package writercheck
+
+import (
+	"bytes"
+	"math"
+	"math/rand"
+	"testing"
+)
+
+// Chunks of values written at once, 256 being the one of the array kernels
+var chunks = []int{1, 3, 256, 1000}
+
+func TestUint64sMatchOneAtATime(t *testing.T) {
+	vals := [][]uint64{
+		nil,
+		{0},
+		{0, 1, 9, 10, 99, 100, 999, 1000, 12345678901234567890, math.MaxUint64},
+	}
+	random := make([]uint64, 1000)
+	for i := range random {
+		random[i] = rand.Uint64() >> uint(rand.Intn(64))
+	}
+	vals = append(vals, random)
+
+	for _, format := range []Format{JSON, Binary} {
+		for _, v := range vals {
+			want := Uint64s(format, v, 0)
+			for _, chunk := range chunks {
+				if got := Uint64s(format, v, chunk); !bytes.Equal(got, want) {
+					t.Errorf("format %d, %d values %d at a time: %q, want %q", format, len(v),
+						chunk, got, want)
+				}
+			}
+		}
+	}
+}
+
+func TestInt64sMatchOneAtATime(t *testing.T) {
+	vals := [][]int64{
+		nil,
+		{0},
+		{0, -1, 1, -9, 10, -99, 100, math.MinInt64, math.MinInt64 + 1, math.MaxInt64},
+	}
+	random := make([]int64, 1000)
+	for i := range random {
+		random[i] = int64(rand.Uint64()) >> uint(rand.Intn(64))
+	}
+	vals = append(vals, random)
+
+	for _, format := range []Format{JSON, Binary} {
+		for _, v := range vals {
+			want := Int64s(format, v, 0)
+			for _, chunk := range chunks {
+				if got := Int64s(format, v, chunk); !bytes.Equal(got, want) {
+					t.Errorf("format %d, %d values %d at a time: %q, want %q", format, len(v),
+						chunk, got, want)
+				}
+			}
+		}
+	}
+}
+
+func TestUint64sJSON(t *testing.T) {
+	want := `{ "count": 3, "values": [ 0, 42, 18446744073709551615 ], ` +
+		`"nested": [ [ 0, 42, 18446744073709551615 ], [ 0, 42, 18446744073709551615 ] ] }`
+	if got := string(Uint64s(JSON, []uint64{0, 42, math.MaxUint64}, 256)); got != want {
+		t.Errorf("got %s, want %s", got, want)
+	}
+}